@@ -0,0 +1,4 @@
+Copies its input to its output one byte at a time
+The end of the input reads as minus one so adding one ends the loop
+
+,+[-.,+]
@@ -0,0 +1,47 @@
+>>>--------------------<<<+++++++++++++++++++++[>>[-]---------------------------
+-------------<++++++++++++++++++++++++++++++++++++++++++++++++++++++++[>>>[-]>[-
+]>++++++++++++++++++++++++++++++[<<[->>>>>>+>+<<<<<<<]>>>>>>>[-<<<<<<<+>>>>>>>]<
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++[-<<<<<<[->>>>>>>>>>>>+<<<<<+<<<
+<<<<]>>>>>>>[-<<<<<<<+>>>>>>>]<]<<<<<<[->>>>>>>>>>>>----------------------------
+--------------------------------------------------------------------------------
+--------------------<<<<<+<<<<<<<]>>>>>>>[-<<<<<<<+>>>>>>>]>>>>>[->+<<<<<<+>>>>>
+]<<<<<[->>>>>+<<<<<]>>>>>>++++++++>++++++++++++++++<[->-[>+>>]>[+[-<+>]>+>>]<<<<
+<]>[-]>[-]>[-<<<<<<<<<<<<+>>>>>>>>>>>>]<<<<<<<<<<<<>>>>>>>>[-]<<<<<<<<<<<[->>>>>
++>+<<<<<<]>>>>>>[-<<<<<<+>>>>>>]<+++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++[-<<<<<[->>>>>>>>>>>+<<<<<+<<<<<<]>>>>>>[-<<<<<<+>>>>>>]<]<<<<<[->>>>>>>>>>>---
+--------------------------------------------------------------------------------
+---------------------------------------------<<<<<+<<<<<<]>>>>>>[-<<<<<<+>>>>>>]
+>>>>>[->+<<<<<<+>>>>>]<<<<<[->>>>>+<<<<<]>>>>>>++++++++>++++++++++++++++<[->-[>+
+>>]>[+[-<+>]>+>>]<<<<<]>[-]>[-]>[-<<<<<<<<<<<+>>>>>>>>>>>]<<<<<<<<<<<>>>>>>>[-]<
+<<<<<<<[->>>>+<+<<<]>>>[-<<<+>>>]<<[->>>+<+<<]>>[-<<+>>]>[->>>>>+<<<<<<+>]<[->+<
+]>>>>>>>+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++<[->-[>
++>>]>[+[-<+>]>+>>]<<<<<]>[-]>[-]>[-<<<<<<+>>>>>>]<<<<<<<<[-]>+>[<<<<<<<+<[-]>>>>
+>>>[-]>[-]]<[<<<<<<<<<[->>>>>>+>+<<<<<<<]>>>>>>>[-<<<<<<<+>>>>>>>]<+++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++++++++++++++++++++++++++[-<<<<<[->>>>>>>>>>>+<<<<<+<<<<<<]>>>>>>[-<<<
+<<<+>>>>>>]<]<<<<<[->>>>>>>>>>>-------------------------------------------------
+-------------------------------------------------------------------------------<
+<<<<+<<<<<<]>>>>>>[-<<<<<<+>>>>>>]>>>>>[-<<<<++>>>>]<<<<[->>>>>+<<<<<<+>]<[->+<]
+>>>>>>++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++>++++++++++++++++<[->-[>+>>]>[+[-<+>]>+>>]<<<<<]>[
+-]>[-]>[-<<<<<<+>>>>>>]<<<<<<---------------------------------------------------
+---------------<<[-]<<<<<<<<[-]>>>>[-<<<<+>>>>]>[-<<<<<->>>>>]<<<<<<<[->>+>>>>>>
+>+<<<<<<<<<]>>>>>>>>>[-<<<<<<<<<+>>>>>>>>>]<<<<<<[-]>>>>>>>>>[-<<<<<<<<<+>>>>>>>
+>>]<<<<<<<<<<<[->>+>>>>>>+<<<<<<<<]>>>>>>>>[-<<<<<<<<+>>>>>>>>]<<<<<->>>>>>>-]<<
+<<<[-]>[-]<<<]>>>>>>>>>+++++++++++++++++++++++++++++++++++<<<<<<<<[>>>>>>>>---<<
+<<<<<<-]>>>>>>>>.[-]<<<<<<<<<<<<<+<-]>>>>>>>>>>>>>>++++++++++.[-]<<<<<<<<<<<<++<
+<<-]
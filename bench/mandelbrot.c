@@ -0,0 +1,213 @@
+/*
+ * Generates bench/mandelbrot.bf, a program that draws the Mandelbrot set in
+ * ASCII with fixed-point arithmetic. It needs 32-bit wrapping cells
+ * (run --cells=wrap-u32): numbers are stored in two's complement and the
+ * default 0 to 127 cells cannot hold them.
+ *
+ * Usage: mandelbrot > bench/mandelbrot.bf
+ *
+ * The program is written with a handful of macros over named cells; every
+ * macro leaves the pointer on a known cell, so loops can be nested freely.
+ * Values are in units of 1/SCALE. A product is computed by adding one factor
+ * (offset by BIAS to make it positive) times the other, and a quotient with
+ * the classic divmod loop on the dividend offset to be positive, so the cost
+ * of both grows with the size of the numbers, not with the number of cells.
+ */
+
+#include <stdio.h>
+
+#define SCALE 16
+#define BIAS (8 * SCALE)  // more than any |x| or |y| that gets multiplied
+#define WIDTH 56
+#define HEIGHT 21
+#define X_MIN (-40)       // -2.5
+#define Y_MIN (-20)       // -1.25
+#define X_STEP 1
+#define Y_STEP 2
+#define MAX_ITERATIONS 30
+
+// cells
+enum {
+    ROW, COLUMN, CX, CY, X, Y, ITERATION, ESCAPED, X_SQUARED, Y_SQUARED,
+    TEMP1, TEMP2, SUM, ELSE, QUOTIENT, OUT, PRODUCT,
+    DIVMOD // five cells: dividend, divisor and three for the divmod loop
+};
+
+static int pointer = 0;
+static int column = 0; // of the output, to wrap long lines
+
+static void emit(char command) {
+    putchar(command);
+    if (++column == 80) {
+        putchar('\n');
+        column = 0;
+    }
+}
+
+static void emit_string(const char *commands) {
+    for (; *commands != '\0'; commands++) {
+        emit(*commands);
+    }
+}
+
+static void go(int cell) {
+    for (; pointer < cell; pointer++) {
+        emit('>');
+    }
+    for (; pointer > cell; pointer--) {
+        emit('<');
+    }
+}
+
+static void add(int cell, int amount) {
+    go(cell);
+    for (; amount > 0; amount--) {
+        emit('+');
+    }
+    for (; amount < 0; amount++) {
+        emit('-');
+    }
+}
+
+static void begin_loop(int cell) {
+    go(cell);
+    emit('[');
+}
+
+static void end_loop(int cell) {
+    go(cell);
+    emit(']');
+}
+
+static void clear(int cell) {
+    go(cell);
+    emit_string("[-]");
+}
+
+/*
+ * destination += factor * source; source becomes 0.
+ */
+static void move(int source, int destination, int factor) {
+    begin_loop(source);
+    add(source, -1);
+    add(destination, factor);
+    end_loop(source);
+}
+
+/*
+ * destination += factor * source, keeping source (through TEMP2).
+ */
+static void add_multiple(int source, int destination, int factor) {
+    begin_loop(source);
+    add(source, -1);
+    add(destination, factor);
+    add(TEMP2, 1);
+    end_loop(source);
+    move(TEMP2, source, 1);
+}
+
+/*
+ * result += a * b, for |a| < BIAS.
+ */
+static void multiply(int a, int b, int result) {
+    add_multiple(a, TEMP1, 1);
+    add(TEMP1, BIAS);
+    begin_loop(TEMP1);
+    add(TEMP1, -1);
+    add_multiple(b, result, 1);
+    end_loop(TEMP1);
+    add_multiple(b, result, -BIAS);
+}
+
+/*
+ * result += floor((value + offset) / divisor), for value + offset + bias >= 0
+ * with bias a multiple of divisor.
+ */
+static void divide(int value, int result, int divisor, int offset, int bias) {
+    add_multiple(value, DIVMOD, 1);
+    add(DIVMOD, offset + bias);
+    add(DIVMOD + 1, divisor);
+    go(DIVMOD);
+    // n d 0 0 0 -> 0 d-n%d n%d n/d 0
+    emit_string("[->-[>+>>]>[+[-<+>]>+>>]<<<<<]");
+    clear(DIVMOD + 1);
+    clear(DIVMOD + 2);
+    move(DIVMOD + 3, result, 1);
+    add(result, -bias / divisor);
+}
+
+/*
+ * The iteration z = z * z + c: squares x and y, and either marks the point as
+ * escaped (|z| > 2) and stops, or computes the next x and y.
+ */
+static void iterate() {
+    multiply(X, X, PRODUCT);
+    divide(PRODUCT, X_SQUARED, SCALE, SCALE / 2, 0);
+    clear(PRODUCT);
+    multiply(Y, Y, PRODUCT);
+    divide(PRODUCT, Y_SQUARED, SCALE, SCALE / 2, 0);
+    clear(PRODUCT);
+    add_multiple(X_SQUARED, SUM, 1);
+    add_multiple(Y_SQUARED, SUM, 1);
+    divide(SUM, QUOTIENT, 4 * SCALE + 1, 0, 0);
+    clear(SUM);
+    add(ELSE, 1);
+    begin_loop(QUOTIENT); // escaped
+    add(ESCAPED, 1);
+    clear(ITERATION);
+    clear(ELSE);
+    clear(QUOTIENT);
+    end_loop(QUOTIENT);
+    begin_loop(ELSE);
+    multiply(X, Y, PRODUCT);
+    move(PRODUCT, SUM, 2);
+    divide(SUM, QUOTIENT, SCALE, SCALE / 2, (4 * SCALE + 2) * SCALE);
+    clear(SUM);
+    clear(X);
+    move(X_SQUARED, X, 1);
+    move(Y_SQUARED, X, -1);
+    add_multiple(CX, X, 1);
+    clear(Y);
+    move(QUOTIENT, Y, 1);
+    add_multiple(CY, Y, 1);
+    add(ITERATION, -1);
+    add(ELSE, -1);
+    end_loop(ELSE);
+    clear(X_SQUARED);
+    clear(Y_SQUARED);
+}
+
+int main() {
+    add(CY, Y_MIN);
+    add(ROW, HEIGHT);
+    begin_loop(ROW);
+    clear(CX);
+    add(CX, X_MIN);
+    add(COLUMN, WIDTH);
+    begin_loop(COLUMN);
+    clear(X);
+    clear(Y);
+    add(ITERATION, MAX_ITERATIONS);
+    begin_loop(ITERATION);
+    iterate();
+    end_loop(ITERATION);
+    add(OUT, '#');
+    begin_loop(ESCAPED);
+    add(OUT, ' ' - '#');
+    add(ESCAPED, -1);
+    end_loop(ESCAPED);
+    go(OUT);
+    emit('.');
+    clear(OUT);
+    add(CX, X_STEP);
+    add(COLUMN, -1);
+    end_loop(COLUMN);
+    add(OUT, '\n');
+    emit('.');
+    clear(OUT);
+    add(CY, Y_STEP);
+    add(ROW, -1);
+    end_loop(ROW);
+    putchar('\n');
+    return 0;
+}
@@ -0,0 +1,12 @@
+Counting loops nested four deep
+The innermost body clears a cell on every iteration so it is not recognized as
+a multiplication and every iteration is dispatched
+
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+[->++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+  [->++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+    [->++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+      [->+>[-]+<<]
+    <]
+  <]
+<]
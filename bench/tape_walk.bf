@@ -0,0 +1,13 @@
+Long walks along the tape
+Cell 2 counts rounds and cell 3 stays zero as a wall; every round walks to the
+end of the marked cells and marks 127 more with a counter that travels along
+the tape
+
+>>++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+[>>[>]+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++[-[->+<]+>]<[<]<-]
+
+Then sweeps over all the marked cells: forward adding one to each cell on the
+way and back in one scan
+
+<<++++++++++++++++++++
+[>>+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++[>>[+>]<[<]<-]<<-]
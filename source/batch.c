@@ -0,0 +1,463 @@
+/*
+ * Batch mode: runs many (program, input file, output file) jobs listed in a
+ * manifest inside one process, on a pool of worker threads. Every worker owns a
+ * BfContext (its tape) and a cache of the programs it has compiled, so nothing
+ * is shared between workers except the job queues. Jobs are dealt out to the
+ * workers in equal contiguous shares; a worker that runs out takes jobs from
+ * the back of another worker's share (work stealing), so a few slow jobs do not
+ * leave the other cores idle.
+ *
+ * With a limit of fuel, the jobs run as green threads instead (see
+ * scheduler.c): each one takes turns of a quantum of loop iterations, on any
+ * worker, until it ends or reaches its limit, so an endless program only costs
+ * its share of the workers until it is stopped, and a job whose input is a
+ * named pipe waits for it without holding a worker.
+ *
+ * A manifest has one job per line: the program, the input file and the output
+ * file, separated by whitespace. "-" as the input means no input and as the
+ * output means the output is discarded. Empty lines and lines starting with
+ * "#" are ignored.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "batch.h"
+#include "bf.h"
+#include "source_file.h"
+#include "translator.h"
+#include "scheduler.h"
+
+#define INITIAL_OUTPUT_CAPACITY 65536
+#define MAX_OUTPUT_CAPACITY (1L << 30)
+#define PROGRAM_CACHE_BUCKETS 256
+
+typedef struct {
+    char *program_path;
+    char *input_path;
+    char *output_path;
+    const char *error; // NULL if the job succeeded
+    long output_length;
+    double milliseconds;
+} Job;
+
+// the output of a job, collected as it is written
+typedef struct {
+    char *data;
+    long length;
+    long capacity;
+    int overflowed;
+} JobOutput;
+
+typedef struct CachedProgram {
+    char *path;
+    BfProgram *program; // NULL if the program could not be loaded or compiled
+    const char *error;
+    struct CachedProgram *next;
+} CachedProgram;
+
+// the share of jobs still waiting for one worker: indices next to end - 1
+typedef struct {
+    pthread_mutex_t lock;
+    int next;
+    int end;
+} JobQueue;
+
+typedef struct {
+    Job *jobs;
+    JobQueue *queues;
+    int num_workers;
+    int tape_size;
+} Batch;
+
+typedef struct {
+    Batch *batch;
+    int id;
+    BfContext *context;
+    CachedProgram *cache[PROGRAM_CACHE_BUCKETS];
+    JobOutput output; // reused by the worker's jobs
+} Worker;
+
+/*
+ * Reads the jobs in the manifest into *jobs. Returns the number of jobs, or -1
+ * if the manifest cannot be read or a line is not a job.
+ */
+static int read_manifest(const char *manifest_path, Job **jobs) {
+    FILE *manifest = fopen(manifest_path, "r");
+    if (manifest == NULL) {
+        printf("Error: File \"%s\" not found.\n", manifest_path);
+        return -1;
+    }
+    char line[3 * 4096];
+    int line_number = 0;
+    int num_jobs = 0;
+    int capacity = 64;
+    *jobs = malloc(sizeof(Job) * capacity);
+    while (fgets(line, sizeof(line), manifest) != NULL) {
+        char program_path[4096], input_path[4096], output_path[4096];
+        char extra;
+        line_number++;
+        if (line[strspn(line, " \t\r\n")] == '\0' || line[strspn(line, " \t")] == '#') {
+            continue;
+        }
+        if (sscanf(line, "%4095s %4095s %4095s %c", program_path, input_path,
+                   output_path, &extra) != 3) {
+            printf("Error: line %d of \"%s\" is not \"program input output\".\n",
+                   line_number, manifest_path);
+            fclose(manifest);
+            return -1;
+        }
+        if (num_jobs == capacity) {
+            capacity *= 2;
+            *jobs = realloc(*jobs, sizeof(Job) * capacity);
+        }
+        Job *job = &(*jobs)[num_jobs++];
+        job->program_path = strdup(program_path);
+        job->input_path = strdup(input_path);
+        job->output_path = strdup(output_path);
+        job->error = NULL;
+        job->output_length = 0;
+        job->milliseconds = 0;
+    }
+    fclose(manifest);
+    return num_jobs;
+}
+
+/*
+ * Returns the compiled program at path from the worker's cache, loading and
+ * compiling it on first use.
+ */
+static CachedProgram *find_program(Worker *worker, const char *path) {
+    unsigned long bucket = hash_source(path, strlen(path)) % PROGRAM_CACHE_BUCKETS;
+    CachedProgram *entry;
+    for (entry = worker->cache[bucket]; entry != NULL; entry = entry->next) {
+        if (strcmp(entry->path, path) == 0) {
+            return entry;
+        }
+    }
+    entry = malloc(sizeof(CachedProgram));
+    entry->path = strdup(path);
+    entry->program = NULL;
+    entry->error = NULL;
+    SourceFile *source = load_source(path);
+    if (source == NULL) {
+        entry->error = "program not found";
+    } else {
+        BfStatus status = bf_compile(source->data, source->length,
+                                     &entry->program, NULL);
+        if (status != BF_OK) {
+            entry->error = bf_status_message(status);
+        }
+        free_source(source);
+    }
+    entry->next = worker->cache[bucket];
+    worker->cache[bucket] = entry;
+    return entry;
+}
+
+/*
+ * Writes the job's output_length bytes of output to its output file, if it has
+ * one.
+ */
+static void write_output(Job *job, const char *data) {
+    if (strcmp(job->output_path, "-") == 0) {
+        return;
+    }
+    FILE *output = fopen(job->output_path, "wb");
+    if (output == NULL
+            || fwrite(data, 1, job->output_length, output) != (size_t) job->output_length) {
+        job->error = "cannot write output";
+    }
+    if (output != NULL && fclose(output) != 0) {
+        job->error = "cannot write output";
+    }
+}
+
+static void collect_output(void *target, const char *data, long length) {
+    JobOutput *output = target;
+    if (output->length + length > MAX_OUTPUT_CAPACITY) {
+        output->overflowed = 1;
+        return;
+    }
+    if (output->length + length > output->capacity) {
+        output->capacity = 2 * (output->length + length);
+        output->data = realloc(output->data, output->capacity);
+    }
+    memcpy(output->data + output->length, data, length);
+    output->length += length;
+}
+
+/*
+ * Runs one job, collecting its output in the worker's buffer, which grows as
+ * the output is written.
+ */
+static void run_job(Worker *worker, Job *job) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    CachedProgram *cached = find_program(worker, job->program_path);
+    SourceFile *input = NULL;
+    if (cached->program == NULL) {
+        job->error = cached->error;
+    } else if (strcmp(job->input_path, "-") != 0
+               && (input = load_source(job->input_path)) == NULL) {
+        job->error = "input not found";
+    } else {
+        worker->output.length = 0;
+        worker->output.overflowed = 0;
+        BfStatus status = bf_run_streaming(cached->program, worker->context,
+                                           input ? input->data : NULL,
+                                           input ? input->length : 0,
+                                           collect_output, &worker->output);
+        job->output_length = worker->output.length;
+        if (status != BF_OK) {
+            job->error = bf_status_message(status);
+        } else if (worker->output.overflowed) {
+            job->error = bf_status_message(BF_ERROR_OUTPUT_FULL);
+        }
+        if (input != NULL) {
+            free_source(input);
+        }
+        write_output(job, worker->output.data);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    job->milliseconds = (end.tv_sec - start.tv_sec) * 1e3
+                        + (end.tv_nsec - start.tv_nsec) / 1e6;
+}
+
+/*
+ * Takes the next job from the front of the worker's own queue, or steals one
+ * from the back of another worker's queue. Returns -1 when no jobs are left.
+ */
+static int take_job(Worker *worker) {
+    Batch *batch = worker->batch;
+    int i;
+    for (i = 0; i < batch->num_workers; i++) {
+        int victim = (worker->id + i) % batch->num_workers;
+        JobQueue *queue = &batch->queues[victim];
+        int job_index = -1;
+        pthread_mutex_lock(&queue->lock);
+        if (queue->next < queue->end) {
+            job_index = i == 0 ? queue->next++ : --queue->end;
+        }
+        pthread_mutex_unlock(&queue->lock);
+        if (job_index >= 0) {
+            return job_index;
+        }
+    }
+    return -1;
+}
+
+static void *run_worker(void *argument) {
+    Worker *worker = argument;
+    int job_index;
+    while ((job_index = take_job(worker)) >= 0) {
+        run_job(worker, &worker->batch->jobs[job_index]);
+    }
+    return NULL;
+}
+
+/*
+ * Frees a worker's tape, output buffer and program cache.
+ */
+static void free_worker(Worker *worker) {
+    int i;
+    for (i = 0; i < PROGRAM_CACHE_BUCKETS; i++) {
+        CachedProgram *entry = worker->cache[i];
+        while (entry != NULL) {
+            CachedProgram *next = entry->next;
+            if (entry->program != NULL) {
+                bf_program_free(entry->program);
+            }
+            free(entry->path);
+            free(entry);
+            entry = next;
+        }
+    }
+    if (worker->context != NULL) {
+        bf_context_free(worker->context);
+    }
+    free(worker->output.data);
+}
+
+/*
+ * Opens the input at path for streaming if it is a named pipe, which a program
+ * may have to wait for. Returns the descriptor, or -1 for any other input.
+ */
+static int open_stream(const char *path) {
+    struct stat status;
+    if (stat(path, &status) != 0 || !S_ISFIFO(status.st_mode)) {
+        return -1;
+    }
+    // without O_NONBLOCK, opening would wait for a writer
+    return open(path, O_RDONLY | O_NONBLOCK);
+}
+
+/*
+ * Runs the jobs as green threads on num_threads workers, each with a tape of
+ * tape_size cells and a limit of fuel loop iterations. Input from a named pipe
+ * is streamed, so a job waiting for it holds no worker. A job's time is from
+ * the start of the batch to the job's end, so it includes compiling the
+ * programs, which happens first, for all the jobs.
+ */
+static void run_jobs_with_fuel(Job *jobs, int num_jobs, int num_threads, int tape_size,
+                               long fuel) {
+    Worker loader; // compiles each program once, for all the jobs
+    GreenThread *threads = calloc(num_jobs + 1, sizeof(GreenThread));
+    SourceFile **inputs = calloc(num_jobs + 1, sizeof(SourceFile *));
+    JobOutput *outputs = calloc(num_jobs + 1, sizeof(JobOutput));
+    int *thread_jobs = malloc(sizeof(int) * (num_jobs + 1));
+    int *input_fds = malloc(sizeof(int) * (num_jobs + 1));
+    int i, num_threads_started = 0;
+    struct timespec start, loaded;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    memset(&loader, 0, sizeof(loader));
+    for (i = 0; i < num_jobs; i++) {
+        Job *job = &jobs[i];
+        input_fds[i] = -1;
+        CachedProgram *cached = find_program(&loader, job->program_path);
+        if (cached->program == NULL) {
+            job->error = cached->error;
+        } else if (strcmp(job->input_path, "-") != 0
+                   && (input_fds[i] = open_stream(job->input_path)) < 0
+                   && (inputs[i] = load_source(job->input_path)) == NULL) {
+            job->error = "input not found";
+        } else {
+            GreenThread *thread = &threads[num_threads_started];
+            // a NULL input is streamed from input_fd as it arrives
+            thread->task = bf_task_new(cached->program, tape_size,
+                                       inputs[i] ? inputs[i]->data
+                                                 : input_fds[i] >= 0 ? NULL : "",
+                                       inputs[i] ? inputs[i]->length : 0,
+                                       collect_output, &outputs[i]);
+            thread->fuel = fuel;
+            thread->input_fd = input_fds[i];
+            if (thread->task == NULL) {
+                job->error = bf_status_message(BF_ERROR_NO_MEMORY);
+            } else {
+                thread_jobs[num_threads_started++] = i;
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &loaded);
+    double loading_milliseconds = (loaded.tv_sec - start.tv_sec) * 1e3
+                                  + (loaded.tv_nsec - start.tv_nsec) / 1e6;
+    run_green_threads(threads, num_threads_started, num_threads, GREEN_THREAD_QUANTUM);
+    for (i = 0; i < num_threads_started; i++) {
+        Job *job = &jobs[thread_jobs[i]];
+        JobOutput *output = &outputs[thread_jobs[i]];
+        job->milliseconds = loading_milliseconds + threads[i].milliseconds;
+        job->output_length = output->length;
+        if (threads[i].status != BF_OK) {
+            job->error = bf_status_message(threads[i].status);
+        } else if (output->overflowed) {
+            job->error = bf_status_message(BF_ERROR_OUTPUT_FULL);
+        }
+        write_output(job, output->data);
+        bf_task_free(threads[i].task);
+    }
+    for (i = 0; i < num_jobs; i++) {
+        if (inputs[i] != NULL) {
+            free_source(inputs[i]);
+        }
+        if (input_fds[i] >= 0) {
+            close(input_fds[i]);
+        }
+        free(outputs[i].data);
+    }
+    free_worker(&loader);
+    free(threads);
+    free(inputs);
+    free(outputs);
+    free(thread_jobs);
+    free(input_fds);
+}
+
+/*
+ * Runs every job in the manifest on num_threads worker threads (0: one per
+ * online CPU), each with a tape of tape_size cells, and prints one line per
+ * job, in manifest order, with its program, input, output, result and time.
+ * If fuel is not 0, the jobs run as green threads and each one is stopped
+ * after fuel loop iterations. Returns 0 if every job succeeded, otherwise -1.
+ */
+int run_batch(const char *manifest_path, int num_threads, int tape_size, long fuel) {
+    Job *jobs;
+    int num_jobs = read_manifest(manifest_path, &jobs);
+    int i;
+    if (num_jobs < 0) {
+        free(jobs);
+        return -1;
+    }
+    if (num_threads <= 0) {
+        num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (num_threads > num_jobs) {
+        num_threads = num_jobs > 0 ? num_jobs : 1;
+    }
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    Batch batch = {jobs, malloc(sizeof(JobQueue) * num_threads), num_threads, tape_size};
+    Worker *workers = calloc(num_threads, sizeof(Worker));
+    pthread_t *threads = malloc(sizeof(pthread_t) * num_threads);
+    for (i = 0; i < num_threads; i++) {
+        pthread_mutex_init(&batch.queues[i].lock, NULL);
+        batch.queues[i].next = (long) num_jobs * i / num_threads;
+        batch.queues[i].end = (long) num_jobs * (i + 1) / num_threads;
+        workers[i].batch = &batch;
+        workers[i].id = i;
+    }
+    if (fuel > 0) {
+        run_jobs_with_fuel(jobs, num_jobs, num_threads, tape_size, fuel);
+    } else {
+        for (i = 0; i < num_threads; i++) {
+            workers[i].context = bf_context_new(tape_size);
+            if (workers[i].context == NULL) {
+                printf("Error: cannot allocate a tape of %d cells.\n", tape_size);
+                break;
+            }
+            workers[i].output.capacity = INITIAL_OUTPUT_CAPACITY;
+            workers[i].output.data = malloc(INITIAL_OUTPUT_CAPACITY);
+        }
+        if (i < num_threads) { // no job runs
+            for (i = 0; i < num_jobs; i++) {
+                jobs[i].error = bf_status_message(BF_ERROR_NO_MEMORY);
+            }
+        } else {
+            for (i = 0; i < num_threads; i++) {
+                pthread_create(&threads[i], NULL, run_worker, &workers[i]);
+            }
+            for (i = 0; i < num_threads; i++) {
+                pthread_join(threads[i], NULL);
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    int failures = 0;
+    for (i = 0; i < num_jobs; i++) {
+        Job *job = &jobs[i];
+        printf("%s\t%s\t%s\t%s\t%ld bytes\t%.3f ms\n", job->program_path,
+               job->input_path, job->output_path, job->error ? job->error : "ok",
+               job->output_length, job->milliseconds);
+        failures += job->error != NULL;
+        free(job->program_path);
+        free(job->input_path);
+        free(job->output_path);
+    }
+    printf("%d jobs, %d failed, %d threads, %.3f ms\n", num_jobs, failures,
+           num_threads, (end.tv_sec - start.tv_sec) * 1e3
+                        + (end.tv_nsec - start.tv_nsec) / 1e6);
+    for (i = 0; i < num_threads; i++) {
+        pthread_mutex_destroy(&batch.queues[i].lock);
+        free_worker(&workers[i]);
+    }
+    free(batch.queues);
+    free(workers);
+    free(threads);
+    free(jobs);
+    return failures == 0 ? 0 : -1;
+}
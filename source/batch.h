@@ -0,0 +1,6 @@
+#ifndef BATCH_HEADER
+#define BATCH_HEADER
+
+int run_batch(const char *manifest_path, int num_threads, int tape_size, long fuel);
+
+#endif
@@ -0,0 +1,400 @@
+/*
+ * The library interface declared in bf.h, on top of the compiler and engines
+ * used by the command-line interpreter.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "bf.h"
+#include "interpreter.h"
+#include "jit.h"
+#include "partial_evaluator.h"
+
+struct BfProgram {
+    Program *program;
+    // the state before the first "," and the rest of the program, run instead
+    // on tapes the snapshot fits; NULL if the program starts with ","
+    Snapshot *snapshot;
+    Program *residual;
+    // built by the first bf_run() or bf_run_streaming(), so programs only run
+    // as tasks never pay for them; NULL where the JIT is unavailable
+    pthread_mutex_t jit_lock;
+    int jit_compiled;
+    JitCode *jit_code;
+    JitCode *residual_jit_code;
+};
+
+struct BfContext {
+    SystemMemory mem;
+    size_t tape_bytes;          // the tape mapping, rounded up to whole pages
+    int needs_reset;            // a run has used the tape since it was blank
+    char *output;               // BF_STREAM_BUFFER_SIZE bytes for bf_run_streaming()
+};
+
+struct BfTask {
+    const Program *program; // the program, or the residual run from the snapshot
+    BfContext *context;
+    IoBuffers buffers;
+    int op_index;           // the next instruction to run
+    char *input;            // the input added so far, if it is streamed
+    long input_capacity;
+    int owns_context;       // the context is freed with the task
+};
+
+/*
+ * Compiles and optimizes the first source_length characters of source into
+ * *program, and runs the part of it that does not read input ahead of time
+ * (see evaluate_prefix()) so that every run can start after it. If the
+ * brackets are unbalanced, returns BF_ERROR_UNBALANCED_BRACKETS and stores the
+ * position of the first unmatched bracket in error_position (if it is not
+ * NULL).
+ */
+BfStatus bf_compile(const char *source, long source_length, BfProgram **program,
+                    long *error_position) {
+    long position;
+    Program *compiled = compile_program_quietly(source, source_length, &position);
+    if (compiled == NULL) {
+        if (error_position != NULL) {
+            *error_position = position;
+        }
+        return BF_ERROR_UNBALANCED_BRACKETS;
+    }
+    optimize_program(compiled);
+    BfProgram *result = malloc(sizeof(BfProgram));
+    if (result == NULL) {
+        free_program(compiled);
+        return BF_ERROR_NO_MEMORY;
+    }
+    result->program = compiled;
+    result->snapshot = NULL;
+    result->residual = evaluate_prefix(compiled, NUM_MEMORY_CELLS,
+                                       PARTIAL_EVALUATION_BUDGET, &result->snapshot);
+    pthread_mutex_init(&result->jit_lock, NULL);
+    result->jit_compiled = 0;
+    result->jit_code = NULL;
+    result->residual_jit_code = NULL;
+    *program = result;
+    return BF_OK;
+}
+
+/*
+ * Free a BfProgram. No run of it may still be in progress.
+ */
+void bf_program_free(BfProgram *program) {
+    if (program->jit_code != NULL) {
+        jit_free(program->jit_code);
+    }
+    if (program->residual_jit_code != NULL) {
+        jit_free(program->residual_jit_code);
+    }
+    if (program->residual != NULL) {
+        free_program(program->residual);
+        free_snapshot(program->snapshot);
+    }
+    free_program(program->program);
+    pthread_mutex_destroy(&program->jit_lock);
+    free(program);
+}
+
+/*
+ * Creates a context with a blank tape of tape_size cells. Returns NULL if the
+ * memory cannot be allocated.
+ */
+BfContext *bf_context_new(int tape_size) {
+    long page_size = sysconf(_SC_PAGESIZE);
+    BfContext *context = malloc(sizeof(BfContext));
+    if (context == NULL) {
+        return NULL;
+    }
+    context->tape_bytes = ((size_t) tape_size + page_size - 1) / page_size * page_size;
+    char *tape = mmap(NULL, context->tape_bytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (tape == MAP_FAILED) {
+        free(context);
+        return NULL;
+    }
+    context->output = malloc(BF_STREAM_BUFFER_SIZE);
+    context->mem.tape = tape;
+    context->mem.tape_size = tape_size;
+    context->mem.curr_index = 0;
+    context->mem.guard_size = 0;
+    context->mem.cell_size = 1;
+    context->mem.io = NULL;
+    context->mem.blank = 0; // programs are compiled without knowing the tape
+    context->needs_reset = 0;
+    return context;
+}
+
+/*
+ * Free a BfContext and its tape.
+ */
+void bf_context_free(BfContext *context) {
+    munmap(context->mem.tape, context->tape_bytes);
+    free(context->output);
+    free(context);
+}
+
+/*
+ * Blanks the tape after a run. The tape is a private anonymous mapping, so
+ * MADV_DONTNEED drops its pages, wherever they are (in memory or swapped
+ * out), and the next run gets fresh zero pages for just the cells it touches;
+ * a small program on a large tape costs a few pages.
+ */
+static void reset_tape(BfContext *context) {
+    context->mem.curr_index = 0;
+    if (madvise(context->mem.tape, context->tape_bytes, MADV_DONTNEED) != 0) {
+        memset(context->mem.tape, 0, context->tape_bytes);
+    }
+}
+
+/*
+ * JIT-compiles the program and its residual, if no run has yet. Runs from
+ * other threads wait for the first one to finish compiling.
+ */
+static void compile_jit(const BfProgram *program) {
+    BfProgram *compiling = (BfProgram *) program;
+    if (__atomic_load_n(&program->jit_compiled, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    pthread_mutex_lock(&compiling->jit_lock);
+    if (!compiling->jit_compiled) {
+        compiling->jit_code = jit_compile(program->program, output_current_cell_value,
+                                          store_input_char_in_current_cell);
+        if (program->residual != NULL) {
+            compiling->residual_jit_code = jit_compile(program->residual,
+                                                       output_current_cell_value,
+                                                       store_input_char_in_current_cell);
+        }
+        __atomic_store_n(&compiling->jit_compiled, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&compiling->jit_lock);
+}
+
+static void run_compiled(const Program *program, JitCode *jit_code, SystemMemory *mem) {
+    if (jit_code != NULL) {
+        jit_run(jit_code, mem);
+    } else {
+        execute_program(program, mem);
+    }
+}
+
+/*
+ * Runs program on a blank tape in context, with "." and "," using buffers.
+ */
+static void run_with_buffers(const BfProgram *program, BfContext *context,
+                             IoBuffers *buffers) {
+    if (context->needs_reset) {
+        reset_tape(context);
+    }
+    context->needs_reset = 1;
+    context->mem.io = buffers;
+    compile_jit(program);
+    if (program->residual != NULL && snapshot_fits(program->snapshot, &context->mem)) {
+        restore_snapshot(program->snapshot, &context->mem);
+        run_compiled(program->residual, program->residual_jit_code, &context->mem);
+    } else {
+        run_compiled(program->program, program->jit_code, &context->mem);
+    }
+    context->mem.io = NULL;
+}
+
+/*
+ * Runs program on a blank tape in context. "," reads from the input_length
+ * bytes of input (EOF, -1, after the last one) and "." writes to output, whose
+ * length is stored in output_length. Returns BF_OK, or BF_ERROR_OUTPUT_FULL if
+ * the program wrote more than output_capacity bytes; the rest were dropped.
+ */
+BfStatus bf_run(const BfProgram *program, BfContext *context,
+                const char *input, long input_length,
+                char *output, long output_capacity, long *output_length) {
+    IoBuffers buffers = {.input = input, .input_length = input_length,
+                         .output = output, .output_capacity = output_capacity};
+    run_with_buffers(program, context, &buffers);
+    *output_length = buffers.output_length;
+    return buffers.output_overflowed ? BF_ERROR_OUTPUT_FULL : BF_OK;
+}
+
+/*
+ * Like bf_run(), but streams the output: output_function is called with
+ * output_target and each piece of output, whenever the context's output buffer
+ * fills up and when the program ends. Returns BF_OK.
+ */
+BfStatus bf_run_streaming(const BfProgram *program, BfContext *context,
+                          const char *input, long input_length,
+                          BfOutputFunction output_function, void *output_target) {
+    IoBuffers buffers = {.input = input, .input_length = input_length,
+                         .output = context->output, .output_capacity = BF_STREAM_BUFFER_SIZE,
+                         .flush_output = output_function, .flush_target = output_target};
+    run_with_buffers(program, context, &buffers);
+    if (buffers.output_length > 0) {
+        output_function(output_target, buffers.output, buffers.output_length);
+    }
+    return BF_OK;
+}
+
+/*
+ * Creates a task that runs program on the blank tape of context (see
+ * bf_task_new()).
+ */
+static BfTask *start_task(const BfProgram *program, BfContext *context,
+                          const char *input, long input_length,
+                          BfOutputFunction output_function, void *output_target) {
+    BfTask *task = malloc(sizeof(BfTask));
+    if (task == NULL) {
+        return NULL;
+    }
+    task->context = context;
+    IoBuffers buffers = {.input = input, .input_length = input_length,
+                         .output = context->output, .output_capacity = BF_STREAM_BUFFER_SIZE,
+                         .flush_output = output_function, .flush_target = output_target,
+                         .input_open = input == NULL};
+    task->buffers = buffers;
+    context->mem.io = &task->buffers;
+    task->program = program->program;
+    task->op_index = 0;
+    task->input = NULL;
+    task->input_capacity = 0;
+    task->owns_context = 0;
+    if (program->residual != NULL && snapshot_fits(program->snapshot, &context->mem)) {
+        restore_snapshot(program->snapshot, &context->mem);
+        task->program = program->residual;
+    }
+    return task;
+}
+
+/*
+ * Creates a task that runs program like bf_run_streaming() does, on a blank
+ * tape of tape_size cells of its own, but a piece at a time (see
+ * bf_task_run()). input must remain valid until the task is freed. If input
+ * is NULL, the input is streamed instead: it is passed to bf_task_add_input()
+ * as it arrives. output_function may be called by bf_task_new() as well as
+ * bf_task_run(). Returns NULL if the memory cannot be allocated.
+ */
+BfTask *bf_task_new(const BfProgram *program, int tape_size,
+                    const char *input, long input_length,
+                    BfOutputFunction output_function, void *output_target) {
+    BfContext *context = bf_context_new(tape_size);
+    if (context == NULL) {
+        return NULL;
+    }
+    BfTask *task = start_task(program, context, input, input_length,
+                              output_function, output_target);
+    if (task == NULL) {
+        bf_context_free(context);
+        return NULL;
+    }
+    task->owns_context = 1;
+    return task;
+}
+
+/*
+ * Creates a task like bf_task_new(), but on the tape of context, which is
+ * blanked first, like for a run. The context must not be used for anything
+ * else until the task is freed. Returns NULL if the memory cannot be
+ * allocated.
+ */
+BfTask *bf_task_new_in_context(const BfProgram *program, BfContext *context,
+                               const char *input, long input_length,
+                               BfOutputFunction output_function, void *output_target) {
+    if (context->needs_reset) {
+        reset_tape(context);
+    }
+    context->needs_reset = 1;
+    return start_task(program, context, input, input_length, output_function,
+                      output_target);
+}
+
+/*
+ * Runs task until the program ends or *fuel is used up: one unit each time a
+ * loop jumps back to its start (see execute_program_with_fuel()). The fuel
+ * left is stored in *fuel. Returns BF_YIELDED if the program has not ended,
+ * or BF_WAITING if it is at a "," and the streamed input has not arrived yet;
+ * call bf_task_run() again, from any thread, to continue it. Otherwise passes
+ * the rest of the output to the output function and returns BF_OK.
+ */
+BfStatus bf_task_run(BfTask *task, long *fuel) {
+    switch (execute_program_with_fuel(task->program, &task->context->mem,
+                                      &task->op_index, fuel)) {
+        case PROGRAM_YIELDED:
+            return BF_YIELDED;
+        case PROGRAM_WAITING:
+            return BF_WAITING;
+    }
+    if (task->buffers.output_length > 0) {
+        task->buffers.flush_output(task->buffers.flush_target, task->buffers.output,
+                                   task->buffers.output_length);
+        task->buffers.output_length = 0;
+    }
+    return BF_OK;
+}
+
+/*
+ * Adds the length bytes of data to the streamed input of task, which must not
+ * be running. A length of 0 ends the input: "," reads EOF after the rest.
+ * Returns BF_OK, or BF_ERROR_NO_MEMORY if the input cannot be stored.
+ */
+BfStatus bf_task_add_input(BfTask *task, const char *data, long length) {
+    IoBuffers *buffers = &task->buffers;
+    long unread = buffers->input_length - buffers->input_position;
+    if (length == 0) {
+        buffers->input_open = 0;
+        return BF_OK;
+    }
+    if (unread + length > task->input_capacity) {
+        long capacity = 2 * (unread + length);
+        char *input = malloc(capacity);
+        if (input == NULL) {
+            return BF_ERROR_NO_MEMORY;
+        }
+        memcpy(input, buffers->input + buffers->input_position, unread);
+        free(task->input);
+        task->input = input;
+        task->input_capacity = capacity;
+    } else {
+        memmove(task->input, buffers->input + buffers->input_position, unread);
+    }
+    memcpy(task->input + unread, data, length);
+    buffers->input = task->input;
+    buffers->input_position = 0;
+    buffers->input_length = unread + length;
+    return BF_OK;
+}
+
+/*
+ * Free a BfTask, and its tape unless it was created in a context of the caller.
+ */
+void bf_task_free(BfTask *task) {
+    if (task->owns_context) {
+        bf_context_free(task->context);
+    } else {
+        task->context->mem.io = NULL;
+    }
+    free(task->input);
+    free(task);
+}
+
+/*
+ * Returns a description of status.
+ */
+const char *bf_status_message(BfStatus status) {
+    switch (status) {
+        case BF_OK:
+            return "success";
+        case BF_ERROR_UNBALANCED_BRACKETS:
+            return "unbalanced brackets";
+        case BF_ERROR_OUTPUT_FULL:
+            return "output buffer full";
+        case BF_ERROR_NO_MEMORY:
+            return "out of memory";
+        case BF_ERROR_OUT_OF_FUEL:
+            return "out of fuel";
+        case BF_YIELDED:
+            return "yielded";
+        case BF_WAITING:
+            return "waiting for input";
+    }
+    return "unknown error";
+}
@@ -0,0 +1,68 @@
+#ifndef BF_HEADER
+#define BF_HEADER
+
+/*
+ * Library interface for running Brainf**k programs inside another program.
+ * A BfProgram is compiled once (to native code by its first bf_run()), so one
+ * program can be run any number of times, from any number of threads at once.
+ * Each run needs a BfContext (its tape), which can be reused for run after run
+ * but by only one thread at a time. Nothing is read from stdin or written to
+ * stdout, and errors are returned, never printed.
+ */
+
+typedef enum {
+    BF_OK = 0,
+    BF_ERROR_UNBALANCED_BRACKETS = -1,
+    BF_ERROR_OUTPUT_FULL = -2, // the run finished, but some output was dropped
+    BF_ERROR_NO_MEMORY = -3,
+    BF_ERROR_OUT_OF_FUEL = -4, // the program was stopped at its limit of loop iterations
+    BF_YIELDED = 1,            // bf_task_run() used up its fuel before the program ended
+    BF_WAITING = 2             // bf_task_run() stopped at a "," to wait for more input
+} BfStatus;
+
+#define BF_STREAM_BUFFER_SIZE 65536 // largest piece of output bf_run_streaming() passes on
+
+// receives output from bf_run_streaming()
+typedef void (*BfOutputFunction)(void *target, const char *data, long length);
+
+typedef struct BfProgram BfProgram;
+
+typedef struct BfContext BfContext;
+
+// a run that can be stopped and continued, on a tape of its own
+typedef struct BfTask BfTask;
+
+BfStatus bf_compile(const char *source, long source_length, BfProgram **program,
+                    long *error_position);
+
+void bf_program_free(BfProgram *program);
+
+BfContext *bf_context_new(int tape_size);
+
+void bf_context_free(BfContext *context);
+
+BfStatus bf_run(const BfProgram *program, BfContext *context,
+                const char *input, long input_length,
+                char *output, long output_capacity, long *output_length);
+
+BfStatus bf_run_streaming(const BfProgram *program, BfContext *context,
+                          const char *input, long input_length,
+                          BfOutputFunction output_function, void *output_target);
+
+BfTask *bf_task_new(const BfProgram *program, int tape_size,
+                    const char *input, long input_length,
+                    BfOutputFunction output_function, void *output_target);
+
+BfTask *bf_task_new_in_context(const BfProgram *program, BfContext *context,
+                               const char *input, long input_length,
+                               BfOutputFunction output_function, void *output_target);
+
+BfStatus bf_task_run(BfTask *task, long *fuel);
+
+BfStatus bf_task_add_input(BfTask *task, const char *data, long length);
+
+void bf_task_free(BfTask *task);
+
+const char *bf_status_message(BfStatus status);
+
+#endif
@@ -0,0 +1,305 @@
+/*
+ * The benchmark runner (make bench): runs every benchmark in a list with the
+ * interpreter, a few times to warm up and then a number of timed repetitions,
+ * each in a fresh process. Reports the median wall time, the instructions
+ * executed per second and the peak resident set size of every benchmark, as a
+ * table and, for comparing engines and commits over time, as JSON lines
+ * appended to a results file.
+ *
+ * The instruction count of a benchmark (compiled instructions, as counted by
+ * run --profile) is taken from one extra profiled run, so that the timed runs
+ * are not slowed down by counting.
+ *
+ * Usage: bf-bench [options] benchmark-list
+ * A benchmark list has one benchmark per line: a name, the program, the input
+ * file ("-" for none) and any options for run. Empty lines and lines starting
+ * with "#" are ignored.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define MAX_ARGUMENTS 32
+
+typedef struct {
+    char name[256];
+    char program[4096];
+    char input[4096];
+    char *options[MAX_ARGUMENTS]; // for run, before the program
+    int num_options;
+} Benchmark;
+
+typedef struct {
+    const char *run_path;
+    const char *engine; // NULL: run's default
+    const char *label;  // identifies the build, e.g. the commit
+    int warmup;
+    int repetitions;
+} Settings;
+
+static void print_usage() {
+    printf("Usage: bf-bench [options] benchmark-list\n"
+           "  --run=PATH        the interpreter (default ./run)\n"
+           "  --engine=NAME     run every benchmark without its own --cells with\n"
+           "                    this engine\n"
+           "  --warmup=N        untimed runs before the timed ones (default 1)\n"
+           "  --repetitions=N   timed runs (default 5)\n"
+           "  --label=TEXT      names the build in the results, e.g. the commit\n"
+           "  --results=FILE    append the results to FILE as JSON lines\n");
+}
+
+static double now_in_milliseconds() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1e3 + time.tv_nsec / 1e6;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double difference = *(const double *) a - *(const double *) b;
+    return (difference > 0) - (difference < 0);
+}
+
+/*
+ * Returns the cell model the benchmark's options select, or NULL if they do
+ * not select one.
+ */
+static const char *cell_model(const Benchmark *benchmark) {
+    int i;
+    for (i = 0; i < benchmark->num_options; i++) {
+        if (strncmp(benchmark->options[i], "--cells=", strlen("--cells=")) == 0) {
+            return benchmark->options[i] + strlen("--cells=");
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Runs the benchmark once in a child process, with extra_option (if not NULL)
+ * added to its options, its input on stdin, its output discarded and its
+ * stderr going to stderr_fd (if not -1). Stores the wall time in
+ * *milliseconds and the peak resident set size in *peak_kilobytes. Returns 0,
+ * or -1 if the run failed.
+ */
+static int run_once(const Settings *settings, const Benchmark *benchmark,
+                    const char *extra_option, int stderr_fd, double *milliseconds,
+                    long *peak_kilobytes) {
+    char *arguments[MAX_ARGUMENTS + 4]; // run, options, extra option, program, NULL
+    int num_arguments = 0;
+    int i;
+    arguments[num_arguments++] = (char *) settings->run_path;
+    for (i = 0; i < benchmark->num_options; i++) {
+        arguments[num_arguments++] = benchmark->options[i];
+    }
+    if (extra_option != NULL) {
+        arguments[num_arguments++] = (char *) extra_option;
+    }
+    arguments[num_arguments++] = (char *) benchmark->program;
+    arguments[num_arguments] = NULL;
+
+    double start = now_in_milliseconds();
+    pid_t pid = fork();
+    if (pid == 0) {
+        int input = open(strcmp(benchmark->input, "-") == 0 ? "/dev/null"
+                                                            : benchmark->input, O_RDONLY);
+        int output = open("/dev/null", O_WRONLY);
+        if (input < 0 || output < 0) {
+            _exit(127);
+        }
+        dup2(input, STDIN_FILENO);
+        dup2(output, STDOUT_FILENO);
+        if (stderr_fd >= 0) {
+            dup2(stderr_fd, STDERR_FILENO);
+        }
+        execv(settings->run_path, arguments);
+        _exit(127);
+    }
+    int status;
+    struct rusage usage;
+    if (pid < 0 || wait4(pid, &status, 0, &usage) != pid) {
+        return -1;
+    }
+    *milliseconds = now_in_milliseconds() - start;
+    *peak_kilobytes = usage.ru_maxrss;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+/*
+ * Returns the number of instructions the benchmark executes, from the report
+ * of a profiled run, or -1 if it cannot be profiled.
+ */
+static long count_instructions(const Settings *settings, const Benchmark *benchmark) {
+    FILE *report = tmpfile();
+    double milliseconds;
+    long peak_kilobytes;
+    long instructions = -1;
+    char line[1024];
+    if (report == NULL) {
+        return -1;
+    }
+    if (run_once(settings, benchmark, "--profile", fileno(report), &milliseconds,
+                 &peak_kilobytes) == 0) {
+        rewind(report);
+        while (fgets(line, sizeof(line), report) != NULL
+               && sscanf(line, "Profile: %ld instructions", &instructions) != 1) {
+        }
+    }
+    fclose(report);
+    return instructions;
+}
+
+/*
+ * Runs one benchmark and reports it. Returns 0, or -1 if a run failed.
+ */
+static int run_benchmark(const Settings *settings, const Benchmark *benchmark,
+                         FILE *results) {
+    char engine_option[256];
+    const char *extra_option = NULL;
+    double *times = malloc(sizeof(double) * settings->repetitions);
+    double milliseconds, total = 0;
+    long peak_kilobytes = 0, kilobytes;
+    int i;
+    long instructions = count_instructions(settings, benchmark);
+    const char *engine = "switch";
+    if (cell_model(benchmark) != NULL) {
+        engine = cell_model(benchmark);
+    } else if (settings->engine != NULL) {
+        engine = settings->engine;
+        snprintf(engine_option, sizeof(engine_option), "--engine=%s", engine);
+        extra_option = engine_option;
+    }
+    for (i = 0; i < settings->warmup + settings->repetitions; i++) {
+        if (run_once(settings, benchmark, extra_option, -1, &milliseconds,
+                     &kilobytes) != 0) {
+            printf("%-16s failed\n", benchmark->name);
+            free(times);
+            return -1;
+        }
+        if (i >= settings->warmup) {
+            times[i - settings->warmup] = milliseconds;
+            total += milliseconds;
+            peak_kilobytes = kilobytes > peak_kilobytes ? kilobytes : peak_kilobytes;
+        }
+    }
+    qsort(times, settings->repetitions, sizeof(double), compare_doubles);
+    double median = times[settings->repetitions / 2];
+    double per_second = instructions > 0 ? instructions / (median / 1e3) : 0;
+    printf("%-16s %-10s %12.3f %12.3f %12.3f %14ld %10.1f M %10ld\n", benchmark->name,
+           engine, median, times[0], total / settings->repetitions, instructions,
+           per_second / 1e6, peak_kilobytes);
+    if (results != NULL) {
+        fprintf(results, "{\"label\": \"%s\", \"time\": %ld, \"benchmark\": \"%s\", "
+                "\"engine\": \"%s\", \"repetitions\": %d, \"median_ms\": %.3f, "
+                "\"min_ms\": %.3f, \"mean_ms\": %.3f, \"instructions\": %ld, "
+                "\"instructions_per_second\": %.0f, \"peak_rss_kb\": %ld}\n",
+                settings->label, (long) time(NULL), benchmark->name, engine,
+                settings->repetitions, median, times[0], total / settings->repetitions,
+                instructions, per_second, peak_kilobytes);
+    }
+    free(times);
+    return 0;
+}
+
+/*
+ * Reads the next benchmark from the list into benchmark. Returns 1, 0 at the
+ * end of the list, or -1 if a line is not a benchmark.
+ */
+static int read_benchmark(FILE *list, Benchmark *benchmark, int *line_number) {
+    char line[3 * 4096];
+    while (fgets(line, sizeof(line), list) != NULL) {
+        int offset;
+        (*line_number)++;
+        if (line[strspn(line, " \t\r\n")] == '\0' || line[strspn(line, " \t")] == '#') {
+            continue;
+        }
+        if (sscanf(line, "%255s %4095s %4095s%n", benchmark->name, benchmark->program,
+                   benchmark->input, &offset) != 3) {
+            return -1;
+        }
+        benchmark->num_options = 0;
+        char *option = strtok(line + offset, " \t\r\n");
+        for (; option != NULL; option = strtok(NULL, " \t\r\n")) {
+            if (benchmark->num_options == MAX_ARGUMENTS) {
+                return -1;
+            }
+            benchmark->options[benchmark->num_options++] = strdup(option);
+        }
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    Settings settings = {"./run", NULL, "", 1, 5};
+    const char *results_path = NULL;
+    static struct option options[] = {
+        {"run", required_argument, NULL, 'r'},
+        {"engine", required_argument, NULL, 'e'},
+        {"warmup", required_argument, NULL, 'w'},
+        {"repetitions", required_argument, NULL, 'n'},
+        {"label", required_argument, NULL, 'l'},
+        {"results", required_argument, NULL, 'o'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (option) {
+            case 'r': settings.run_path = optarg; break;
+            case 'e': settings.engine = optarg; break;
+            case 'w': settings.warmup = atoi(optarg); break;
+            case 'n': settings.repetitions = atoi(optarg); break;
+            case 'l': settings.label = optarg; break;
+            case 'o': results_path = optarg; break;
+            case 'h':
+                print_usage();
+                return 0;
+            default:
+                print_usage();
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (optind != argc - 1 || settings.warmup < 0 || settings.repetitions <= 0) {
+        print_usage();
+        exit(EXIT_FAILURE);
+    }
+    FILE *list = fopen(argv[optind], "r");
+    if (list == NULL) {
+        printf("Error: File \"%s\" not found.\n", argv[optind]);
+        exit(EXIT_FAILURE);
+    }
+    FILE *results = NULL;
+    if (results_path != NULL && (results = fopen(results_path, "a")) == NULL) {
+        printf("Error: cannot write \"%s\".\n", results_path);
+        exit(EXIT_FAILURE);
+    }
+    printf("%-16s %-10s %12s %12s %12s %14s %12s %10s\n", "benchmark", "engine",
+           "median ms", "min ms", "mean ms", "instructions", "per second", "peak KB");
+    Benchmark benchmark;
+    int line_number = 0;
+    int status, failures = 0;
+    while ((status = read_benchmark(list, &benchmark, &line_number)) != 0) {
+        if (status < 0) {
+            printf("Error: line %d of \"%s\" is not \"name program input [options]\".\n",
+                   line_number, argv[optind]);
+            exit(EXIT_FAILURE);
+        }
+        fflush(stdout);
+        failures += run_benchmark(&settings, &benchmark, results) != 0;
+        int i;
+        for (i = 0; i < benchmark.num_options; i++) {
+            free(benchmark.options[i]);
+        }
+    }
+    fclose(list);
+    if (results != NULL) {
+        fclose(results);
+    }
+    return failures == 0 ? 0 : EXIT_FAILURE;
+}
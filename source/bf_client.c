@@ -0,0 +1,60 @@
+/*
+ * A client for the daemon (run --serve): sends one program and its input and
+ * writes the program's output to stdout as it arrives.
+ *
+ * Usage: bf-client socket program [input]
+ * The input is a file, "-" for stdin, or nothing for no input.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "daemon_protocol.h"
+#include "source_file.h"
+#include "bf.h"
+
+static void write_output(void *target, const char *data, long length) {
+    (void) target;
+    if (write_fully(STDOUT_FILENO, data, length) != 0) {
+        exit(EXIT_FAILURE);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3 && argc != 4) {
+        printf("Usage: bf-client socket program [input]\n");
+        exit(EXIT_FAILURE);
+    }
+    SourceFile *program = load_source(argv[2]);
+    if (program == NULL) {
+        printf("Error: File \"%s\" not found.\n", argv[2]);
+        exit(EXIT_FAILURE);
+    }
+    SourceFile *input = NULL;
+    if (argc == 4 && (input = load_source(argv[3])) == NULL) {
+        printf("Error: File \"%s\" not found.\n", argv[3]);
+        exit(EXIT_FAILURE);
+    }
+    int fd = connect_to_daemon(argv[1]);
+    if (fd < 0) {
+        printf("Error: cannot connect to \"%s\".\n", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+    int status;
+    if (send_request(fd, program->data, program->length,
+                     input ? input->data : NULL, input ? input->length : 0) != 0
+            || receive_response(fd, write_output, NULL, &status) != 0) {
+        printf("Error: the connection to the daemon failed.\n");
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+    free_source(program);
+    if (input != NULL) {
+        free_source(input);
+    }
+    if (status != BF_OK) {
+        fprintf(stderr, "Error: %s.\n", bf_status_message(status));
+        exit(EXIT_FAILURE);
+    }
+    return 0;
+}
@@ -0,0 +1,108 @@
+/*
+ * A load generator for the daemon (run --serve): opens a number of
+ * connections, each sending the same program (and input) over and over, and
+ * reports the throughput and the request latencies.
+ *
+ * Usage: bf-load socket program [connections [requests [input]]]
+ * Each connection sends requests requests (default 4 connections of 1000).
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "daemon_protocol.h"
+#include "source_file.h"
+#include "bf.h"
+
+typedef struct {
+    const char *socket_path;
+    SourceFile *program;
+    SourceFile *input;
+    int num_requests;
+    double *latencies; // milliseconds, one per request
+    int failures;
+} Client;
+
+static double now_in_milliseconds() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1e3 + time.tv_nsec / 1e6;
+}
+
+static void *run_client(void *argument) {
+    Client *client = argument;
+    int i;
+    int fd = connect_to_daemon(client->socket_path);
+    for (i = 0; i < client->num_requests; i++) {
+        int status;
+        double start = now_in_milliseconds();
+        if (fd < 0 || send_request(fd, client->program->data, client->program->length,
+                                   client->input ? client->input->data : NULL,
+                                   client->input ? client->input->length : 0) != 0
+                || receive_response(fd, NULL, NULL, &status) != 0
+                || status != BF_OK) {
+            client->failures++;
+        }
+        client->latencies[i] = now_in_milliseconds() - start;
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    return NULL;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double difference = *(const double *) a - *(const double *) b;
+    return (difference > 0) - (difference < 0);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3 || argc > 6) {
+        printf("Usage: bf-load socket program [connections [requests [input]]]\n");
+        exit(EXIT_FAILURE);
+    }
+    int num_clients = argc > 3 ? atoi(argv[3]) : 4;
+    int num_requests = argc > 4 ? atoi(argv[4]) : 1000;
+    SourceFile *program = load_source(argv[2]);
+    SourceFile *input = argc > 5 ? load_source(argv[5]) : NULL;
+    if (program == NULL || (argc > 5 && input == NULL) || num_clients <= 0
+            || num_requests <= 0) {
+        printf("Error: cannot read the program or input, or invalid counts.\n");
+        exit(EXIT_FAILURE);
+    }
+    int i, total = num_clients * num_requests;
+    int failures = 0;
+    Client *clients = calloc(num_clients, sizeof(Client));
+    pthread_t *threads = malloc(sizeof(pthread_t) * num_clients);
+    double *latencies = malloc(sizeof(double) * total);
+    double start = now_in_milliseconds();
+    for (i = 0; i < num_clients; i++) {
+        clients[i].socket_path = argv[1];
+        clients[i].program = program;
+        clients[i].input = input;
+        clients[i].num_requests = num_requests;
+        clients[i].latencies = latencies + (long) i * num_requests;
+        pthread_create(&threads[i], NULL, run_client, &clients[i]);
+    }
+    for (i = 0; i < num_clients; i++) {
+        pthread_join(threads[i], NULL);
+        failures += clients[i].failures;
+    }
+    double elapsed = now_in_milliseconds() - start;
+    qsort(latencies, total, sizeof(double), compare_doubles);
+    printf("%d requests over %d connections in %.1f ms: %.0f requests/s, %d failed\n",
+           total, num_clients, elapsed, total / (elapsed / 1e3), failures);
+    printf("latency ms: p50 %.3f  p90 %.3f  p99 %.3f  max %.3f\n",
+           latencies[total / 2], latencies[total * 9 / 10],
+           latencies[total * 99 / 100], latencies[total - 1]);
+    free(latencies);
+    free(threads);
+    free(clients);
+    free_source(program);
+    if (input != NULL) {
+        free_source(input);
+    }
+    return failures == 0 ? 0 : EXIT_FAILURE;
+}
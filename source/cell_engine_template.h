@@ -0,0 +1,157 @@
+/*
+ * The body of an execution engine for one cell model. cell_models.c includes
+ * this file once per model, after defining:
+ *   CELL_ENGINE           the name of the engine function
+ *   CELL                  the type of a tape cell
+ *   ADD_TO_CELL(c, n)     statement adding the int n to the cell lvalue c
+ *   ADD_PRODUCT(c, f, n)  statement adding f * n to c, as if ADD_TO_CELL(c, f)
+ *                         ran n times
+ *   CELL_CAN_OVERFLOW     (optional) if defined, the statements above may
+ *                         "goto overflow" to stop the program with an error
+ *   LOOP_CLEARS(n)        whether a loop adding n to its counter each time
+ *                         ("[-]", "[+]", ...) always ends with the counter at 0
+ *   CELL_SINGLE_STEP      (optional) if defined, CELL_ENGINE is a Stepper that
+ *                         runs only the instruction at pc (for the profiler)
+ * The model is fixed at compile time: the dispatch loop below has no checks of
+ * which model is running. Pointer moves stick at the tape edges and recognized
+ * loops fall into their body when the shortcut would not be exact, as in the
+ * saturating engines.
+ *
+ * There is deliberately no include guard.
+ */
+
+#ifdef CELL_SINGLE_STEP
+int CELL_ENGINE(SystemMemory *mem, const Program *program, int pc) {
+#else
+int CELL_ENGINE(const Program *program, SystemMemory *mem) {
+    if (mem->cell_size != sizeof(CELL)) {
+        printf("Error: the tape has %d-byte cells, expected %d.\n",
+               mem->cell_size, (int) sizeof(CELL));
+        return -1;
+    }
+    int pc;
+#endif
+    const Instruction *ops = program->ops;
+    CELL *tape = (CELL *) mem->tape;
+    int last_index = mem->tape_size - 1;
+    int index = mem->curr_index;
+    int i;
+#ifdef CELL_SINGLE_STEP
+    {
+#else
+    for (pc = 0; pc < program->num_ops; pc++) {
+#endif
+        const Instruction *op = &ops[pc];
+        switch (op->code) {
+            case OP_ADD:
+                ADD_TO_CELL(tape[index + op->offset], op->arg);
+                break;
+            case OP_MOVE:
+                index += op->arg;
+                index = index < 0 ? 0 : (index > last_index ? last_index : index);
+                break;
+            case OP_MOVE_UNCHECKED:
+                index += op->arg;
+                break;
+            case OP_OUTPUT:
+                if (mem->io != NULL) {
+                    io_buffers_write(mem->io, (unsigned char) tape[index]);
+                } else {
+                    io_write_byte((unsigned char) tape[index]);
+                }
+                break;
+            case OP_INPUT:
+                tape[index] = (CELL) (mem->io != NULL ? io_buffers_read(mem->io)
+                                                      : io_read_byte());
+                break;
+            case OP_JUMP_IF_ZERO:
+                if (tape[index] == 0) {
+                    pc = op->jump;
+                }
+                break;
+            case OP_JUMP_IF_NOT_ZERO:
+                if (tape[index] != 0) {
+                    pc = op->jump;
+                }
+                break;
+            case OP_SET_ZERO:
+                if (tape[index] == 0) {
+                    pc = op->jump;
+                } else if (LOOP_CLEARS(op->arg)) {
+                    tape[index] = 0;
+                    pc = op->jump;
+                }
+                break;
+            case OP_SCAN:
+                while (tape[index] != 0 && index + op->arg >= 0
+                       && index + op->arg <= last_index) {
+                    index += op->arg;
+                }
+                if (tape[index] == 0) {
+                    pc = op->jump;
+                }
+                break;
+            case OP_CLEAR_RANGE:
+                if (!LOOP_CLEARS(ops[pc + 2].arg)) {
+                    if (tape[index] == 0) {
+                        pc = op->jump;
+                    }
+                    break;
+                }
+                while (tape[index] != 0 && index + op->arg >= 0
+                       && index + op->arg <= last_index) {
+                    tape[index] = 0;
+                    index += op->arg;
+                }
+                if (tape[index] == 0) {
+                    pc = op->jump;
+                }
+                break;
+            case OP_CHECK_RANGE:
+                if (index + op->offset < 0 || index + op->arg > last_index) {
+                    pc = op->jump;
+                }
+                break;
+            case OP_JUMP:
+                pc = op->jump;
+                break;
+            case OP_MULTIPLY_LOOP: {
+                const MultiplyTarget *targets = &program->targets[op->offset];
+                if (tape[index] == 0) {
+                    pc = op->jump;
+                    break;
+                }
+                for (i = 0; i < op->arg; i++) {
+                    if (index + targets[i].offset < 0
+                            || index + targets[i].offset > last_index) {
+                        break;
+                    }
+                }
+                if (i < op->arg) { // a target is off the tape: run the body
+                    break;
+                }
+                for (i = 0; i < op->arg; i++) {
+                    ADD_PRODUCT(tape[index + targets[i].offset], targets[i].factor,
+                                tape[index]);
+                }
+                tape[index] = 0;
+                pc = op->jump;
+                break;
+            }
+        }
+    }
+    mem->curr_index = index;
+#ifdef CELL_SINGLE_STEP
+    return pc + 1;
+#else
+    return 0;
+#endif
+#ifdef CELL_CAN_OVERFLOW
+overflow:
+    mem->curr_index = index;
+    io_flush();
+    // the source position: instruction indices change with every optimization
+    printf("\nError: cell value out of range at position %d.\n", ops[pc].position);
+    return -1;
+#endif
+}
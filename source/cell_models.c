@@ -0,0 +1,112 @@
+/*
+ * Execution engines for cell models other than the default saturating 7-bit
+ * cells. Each model gets its own copy of the engine in cell_engine_template.h,
+ * specialized with macros, so that "+" and "-" compile to exactly the
+ * arithmetic of that model. A second copy of each runs one instruction at a
+ * time, for the profiler.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "cell_models.h"
+#include "io.h"
+
+/*
+ * Wrapping cells: arithmetic modulo 2^bits, and any loop stepping by an odd
+ * amount ends at 0.
+ */
+#define ADD_TO_CELL(c, n) ((c) += (CELL) (n))
+#define ADD_PRODUCT(c, f, n) ((c) += (CELL) ((uint64_t) (int64_t) (f) * (n)))
+#define LOOP_CLEARS(n) ((n) % 2 != 0)
+
+#define CELL_ENGINE execute_program_wrap_u8
+#define CELL uint8_t
+#include "cell_engine_template.h"
+#undef CELL_ENGINE
+#define CELL_SINGLE_STEP
+#define CELL_ENGINE step_wrap_u8
+#include "cell_engine_template.h"
+#undef CELL_SINGLE_STEP
+#undef CELL_ENGINE
+#undef CELL
+
+#define CELL_ENGINE execute_program_wrap_u16
+#define CELL uint16_t
+#include "cell_engine_template.h"
+#undef CELL_ENGINE
+#define CELL_SINGLE_STEP
+#define CELL_ENGINE step_wrap_u16
+#include "cell_engine_template.h"
+#undef CELL_SINGLE_STEP
+#undef CELL_ENGINE
+#undef CELL
+
+#define CELL_ENGINE execute_program_wrap_u32
+#define CELL uint32_t
+#include "cell_engine_template.h"
+#undef CELL_ENGINE
+#define CELL_SINGLE_STEP
+#define CELL_ENGINE step_wrap_u32
+#include "cell_engine_template.h"
+#undef CELL_SINGLE_STEP
+#undef CELL_ENGINE
+#undef CELL
+
+#undef ADD_TO_CELL
+#undef ADD_PRODUCT
+#undef LOOP_CLEARS
+
+/*
+ * Checked cells: 0 to 255, and leaving that range stops the program with an
+ * error. Only "[-]" is sure to end at 0; "[+]" overflows.
+ */
+#define CELL_CAN_OVERFLOW
+#define ADD_TO_CELL(c, n) do { \
+        int sum = (c) + (n); \
+        if (sum < 0 || sum > UINT8_MAX) { \
+            goto overflow; \
+        } \
+        (c) = sum; \
+    } while (0)
+#define ADD_PRODUCT(c, f, n) do { \
+        long sum = (c) + (long) (f) * (n); \
+        if (sum < 0 || sum > UINT8_MAX) { \
+            goto overflow; \
+        } \
+        (c) = sum; \
+    } while (0)
+#define LOOP_CLEARS(n) ((n) == -1)
+
+#define CELL_ENGINE execute_program_checked_u8
+#define CELL uint8_t
+#include "cell_engine_template.h"
+#undef CELL_ENGINE
+#define CELL_SINGLE_STEP
+#define CELL_ENGINE step_checked_u8
+#include "cell_engine_template.h"
+#undef CELL_SINGLE_STEP
+#undef CELL_ENGINE
+#undef CELL
+
+static const CellModel cell_models[] = {
+    {"saturating-7-bit", sizeof(char), NULL, execute_instruction},
+    {"wrap-u8", sizeof(uint8_t), execute_program_wrap_u8, step_wrap_u8},
+    {"wrap-u16", sizeof(uint16_t), execute_program_wrap_u16, step_wrap_u16},
+    {"wrap-u32", sizeof(uint32_t), execute_program_wrap_u32, step_wrap_u32},
+    {"checked-u8", sizeof(uint8_t), execute_program_checked_u8, step_checked_u8}
+};
+
+/*
+ * Returns the cell model with the given name, or NULL if there is no such
+ * model.
+ */
+const CellModel *find_cell_model(const char *name) {
+    int i;
+    for (i = 0; i < (int) (sizeof(cell_models) / sizeof(cell_models[0])); i++) {
+        if (strcmp(cell_models[i].name, name) == 0) {
+            return &cell_models[i];
+        }
+    }
+    return NULL;
+}
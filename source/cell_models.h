@@ -0,0 +1,34 @@
+#include "interpreter.h"
+
+#ifndef CELL_MODELS_HEADER
+#define CELL_MODELS_HEADER
+
+/*
+ * What a tape cell holds and what "+" and "-" do at the ends of its range.
+ */
+typedef struct {
+    const char *name;
+    int cell_size; // bytes per cell
+    Engine engine; // NULL: the model of the general engines (find_engine())
+    Stepper step;  // runs one instruction, for the profiler
+} CellModel;
+
+int execute_program_wrap_u8(const Program *program, SystemMemory *mem);
+
+int execute_program_wrap_u16(const Program *program, SystemMemory *mem);
+
+int execute_program_wrap_u32(const Program *program, SystemMemory *mem);
+
+int execute_program_checked_u8(const Program *program, SystemMemory *mem);
+
+int step_wrap_u8(SystemMemory *mem, const Program *program, int pc);
+
+int step_wrap_u16(SystemMemory *mem, const Program *program, int pc);
+
+int step_wrap_u32(SystemMemory *mem, const Program *program, int pc);
+
+int step_checked_u8(SystemMemory *mem, const Program *program, int pc);
+
+const CellModel *find_cell_model(const char *name);
+
+#endif
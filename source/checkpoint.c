@@ -0,0 +1,373 @@
+/*
+ * Checkpoints: run --checkpoint=FILE saves the state of a running program to
+ * FILE every N loop iterations and whenever it gets SIGUSR1 (and, before it
+ * stops, SIGTERM), and run --resume=FILE continues it from there, in a new
+ * process. The program runs in the threaded engine (or, for other cell models,
+ * their single-step engine) with fuel (see execute_program_with_fuel()), which
+ * stops it at a loop's jump back to its start every CHECKPOINT_SLICE
+ * iterations; a checkpoint is only ever taken there, so the cost of looking
+ * for one is a counter on the loops' back edges.
+ *
+ * The state is the tape, the pointer, the index of the next instruction and
+ * how much input the program has read. The compiled program has no call stack
+ * (a loop is just a jump back to its "["), so the instruction index is all
+ * the control state there is. A checkpoint stores only the tape pages in use:
+ * pages that are neither in memory nor swapped out were never written and are
+ * found in /proc/self/pagemap without reading them, and pages of zeroes are
+ * left out. The stored pages start at a page boundary in the file, so
+ * resuming maps the file and copies just those pages; both cost time in
+ * proportion to the pages in use, not to the size of the tape.
+ *
+ * A checkpoint is written to a temporary file that then replaces FILE, so a
+ * run killed halfway through writing one leaves the previous one intact.
+ * Output is delivered at least once: whatever the program wrote after the
+ * last checkpoint is written again by the resumed run.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "checkpoint.h"
+#include "translator.h"
+#include "io.h"
+
+#define CHECKPOINT_SLICE 65536L // loop iterations between looks at the signals
+
+static const char checkpoint_magic[8] = {'B', 'F', 'C', 'K', 'P', 'T', '\r', '\n'};
+
+static volatile sig_atomic_t checkpoint_requested = 0;
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_checkpoint(int signal) {
+    checkpoint_requested = 1;
+    if (signal == SIGTERM) {
+        stop_requested = 1;
+    }
+}
+
+static long round_up(long value, long multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+static long tape_bytes(const SystemMemory *mem) {
+    return (long) mem->tape_size * mem->cell_size;
+}
+
+#define PAGEMAP_ENTRIES 512             // pagemap entries read at a time
+#define PAGEMAP_PRESENT (1ULL << 63)    // the page is in memory
+#define PAGEMAP_SWAPPED (1ULL << 62)    // the page is in swap
+
+/*
+ * Stores in pages the indices of the page_size-byte pages of the tape that
+ * hold something other than zeroes, and returns how many there are. A page
+ * whose memory /proc/self/pagemap shows as neither present nor swapped out
+ * has never been written, and is skipped without reading it; where pagemap
+ * cannot be read, every page is read.
+ */
+static long find_used_pages(const SystemMemory *mem, long page_size, long *pages) {
+    long bytes = tape_bytes(mem);
+    long num_tape_pages = round_up(bytes, page_size) / page_size;
+    int pagemap = open("/proc/self/pagemap", O_RDONLY);
+    uint64_t entries[PAGEMAP_ENTRIES];
+    uintptr_t entries_start = 0; // the first memory page entries describes
+    long num_entries = 0;
+    long i, j, num_pages = 0;
+    for (i = 0; i < num_tape_pages; i++) {
+        const char *page = mem->tape + i * page_size;
+        long length = bytes - i * page_size < page_size ? bytes - i * page_size : page_size;
+        int mapped = pagemap < 0;
+        uintptr_t memory_page;
+        // the tape need not be page-aligned, so a tape page can span two memory pages
+        for (memory_page = (uintptr_t) page / page_size;
+             memory_page <= ((uintptr_t) page + length - 1) / page_size && !mapped;
+             memory_page++) {
+            if (memory_page < entries_start || memory_page >= entries_start + num_entries) {
+                ssize_t result = pread(pagemap, entries, sizeof(entries),
+                                       (off_t) (memory_page * sizeof(uint64_t)));
+                entries_start = memory_page;
+                num_entries = result > 0 ? result / (ssize_t) sizeof(uint64_t) : 0;
+                if (num_entries == 0) {
+                    mapped = 1; // unknown: read the page
+                    break;
+                }
+            }
+            mapped = (entries[memory_page - entries_start]
+                      & (PAGEMAP_PRESENT | PAGEMAP_SWAPPED)) != 0;
+        }
+        for (j = 0; mapped && j < length && page[j] == 0; j++) {
+        }
+        if (mapped && j < length) {
+            pages[num_pages++] = i;
+        }
+    }
+    if (pagemap >= 0) {
+        close(pagemap);
+    }
+    return num_pages;
+}
+
+/*
+ * Writes a checkpoint of mem, with the rest of the state in header, to path.
+ * Fills in the header's magic number, version and page fields. Returns 0 on
+ * success, or -1 if the file cannot be written.
+ */
+int write_checkpoint(const char *path, CheckpointHeader *header, const SystemMemory *mem) {
+    long page_size = sysconf(_SC_PAGESIZE);
+    long bytes = tape_bytes(mem);
+    long *pages = malloc(sizeof(long) * (round_up(bytes, page_size) / page_size + 1));
+    char temp_path[4200];
+    long i;
+    memcpy(header->magic, checkpoint_magic, sizeof(checkpoint_magic));
+    header->version = CHECKPOINT_VERSION;
+    header->page_size = page_size;
+    header->num_pages = find_used_pages(mem, page_size, pages);
+    long data_offset = round_up(sizeof(CheckpointHeader) + sizeof(long) * header->num_pages,
+                                page_size);
+
+    snprintf(temp_path, sizeof(temp_path), "%s.%d.tmp", path, getpid());
+    FILE *file = fopen(temp_path, "w");
+    int ok = file != NULL
+             && fwrite(header, sizeof(CheckpointHeader), 1, file) == 1
+             && fwrite(pages, sizeof(long), header->num_pages, file) == (size_t) header->num_pages
+             && fseek(file, data_offset, SEEK_SET) == 0;
+    for (i = 0; ok && i < header->num_pages; i++) {
+        long offset = pages[i] * page_size;
+        long length = bytes - offset < page_size ? bytes - offset : page_size;
+        ok = fwrite(mem->tape + offset, 1, length, file) == (size_t) length;
+    }
+    // a short last page is padded with zeroes
+    ok = ok && fflush(file) == 0
+         && ftruncate(fileno(file), data_offset + header->num_pages * page_size) == 0;
+    if (file != NULL) {
+        ok = fclose(file) == 0 && ok;
+    }
+    free(pages);
+    if (!ok || rename(temp_path, path) != 0) {
+        unlink(temp_path);
+        fprintf(stderr, "Error: cannot write the checkpoint \"%s\".\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static int valid_header(const CheckpointHeader *header) {
+    return memcmp(header->magic, checkpoint_magic, sizeof(checkpoint_magic)) == 0
+           && header->version == CHECKPOINT_VERSION && header->page_size > 0
+           && header->num_pages >= 0 && header->cell_model[sizeof(header->cell_model) - 1] == '\0';
+}
+
+/*
+ * Reads the header of the checkpoint at path, to find out which tape and cell
+ * model to resume it with. Returns 0 on success, or -1 if path is not a
+ * checkpoint.
+ */
+int read_checkpoint_header(const char *path, CheckpointHeader *header) {
+    FILE *file = fopen(path, "r");
+    int ok = file != NULL && fread(header, sizeof(CheckpointHeader), 1, file) == 1
+             && valid_header(header);
+    if (file != NULL) {
+        fclose(file);
+    }
+    if (!ok) {
+        fprintf(stderr, "Error: \"%s\" is not a checkpoint.\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Loads the checkpoint at path into mem, whose tape must be blank and of the
+ * checkpoint's size, and its header into header. Returns 0 on success, or -1
+ * if path is not a checkpoint or not one of a tape like mem's.
+ */
+int load_checkpoint(const char *path, CheckpointHeader *header, SystemMemory *mem) {
+    int fd = open(path, O_RDONLY);
+    struct stat status;
+    if (fd < 0 || fstat(fd, &status) != 0 || status.st_size < (off_t) sizeof(CheckpointHeader)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        fprintf(stderr, "Error: \"%s\" is not a checkpoint.\n", path);
+        return -1;
+    }
+    char *file = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED) {
+        fprintf(stderr, "Error: cannot map \"%s\".\n", path);
+        return -1;
+    }
+    memcpy(header, file, sizeof(CheckpointHeader));
+    long bytes = tape_bytes(mem);
+    long page_size = header->page_size;
+    int ok = valid_header(header)
+             && header->num_pages <= round_up(bytes, page_size) / page_size
+             && header->tape_size == mem->tape_size && header->cell_size == mem->cell_size
+             && header->curr_index >= 0 && header->curr_index < mem->tape_size;
+    long data_offset = ok ? round_up(sizeof(CheckpointHeader) + sizeof(long) * header->num_pages,
+                                     page_size) : 0;
+    ok = ok && status.st_size == data_offset + header->num_pages * page_size;
+    const long *pages = (const long *) (file + sizeof(CheckpointHeader));
+    long i;
+    for (i = 0; ok && i < header->num_pages; i++) {
+        ok = pages[i] >= 0 && pages[i] * page_size < bytes;
+    }
+    for (i = 0; ok && i < header->num_pages; i++) {
+        long offset = pages[i] * page_size;
+        long length = bytes - offset < page_size ? bytes - offset : page_size;
+        memcpy(mem->tape + offset, file + data_offset + i * page_size, length);
+    }
+    munmap(file, status.st_size);
+    if (!ok) {
+        fprintf(stderr, "Error: \"%s\" is not a checkpoint of this tape.\n", path);
+        return -1;
+    }
+    mem->curr_index = header->curr_index;
+    mem->blank = 0;
+    return 0;
+}
+
+/*
+ * Loads the checkpoint at path into mem and the state in header, after
+ * checking that it was taken of the same program and tape, and skips the input
+ * the program had already read.
+ */
+static int resume(const char *path, CheckpointHeader *header, SystemMemory *mem) {
+    CheckpointHeader loaded;
+    long i;
+    if (load_checkpoint(path, &loaded, mem) != 0) {
+        return -1;
+    }
+    if (loaded.source_hash != header->source_hash || loaded.num_ops != header->num_ops
+            || strcmp(loaded.cell_model, header->cell_model) != 0
+            || loaded.virtual_tape != header->virtual_tape
+            || loaded.pc < 0 || loaded.pc > loaded.num_ops) {
+        fprintf(stderr, "Error: \"%s\" is a checkpoint of another program or run.\n", path);
+        return -1;
+    }
+    header->pc = loaded.pc;
+    header->iterations = loaded.iterations;
+    header->input_offset = loaded.input_offset;
+    for (i = 0; i < header->input_offset; i++) {
+        io_read_byte();
+    }
+    return 0;
+}
+
+/*
+ * Runs program from *pc with step like execute_program_with_fuel() does with
+ * direct threading: until it ends or *fuel loop iterations have run. Returns 0
+ * when the program ends, PROGRAM_YIELDED when the fuel is used up (with the
+ * instruction to continue from in *pc and the fuel left in *fuel), or -1 if
+ * the program stopped with an error.
+ */
+static int step_with_fuel(const Program *program, SystemMemory *mem, Stepper step,
+                          int *pc, long *fuel) {
+    int index = *pc;
+    while (index < program->num_ops) {
+        int next = step(mem, program, index);
+        if (next < 0) {
+            return -1;
+        }
+        if (next <= index && --*fuel <= 0) {
+            *pc = next;
+            return PROGRAM_YIELDED;
+        }
+        index = next;
+    }
+    *pc = index;
+    return 0;
+}
+
+/*
+ * Runs program from the instruction in state, with the threaded engine for
+ * the default cells (step is execute_instruction()) and with step otherwise,
+ * writing checkpoints as settings asks. Returns 0 on success, -1 if the
+ * program stopped with an error or a checkpoint cannot be written, or
+ * CHECKPOINT_STOPPED after the checkpoint for a SIGTERM.
+ */
+static int run_checkpointed(const Program *program, SystemMemory *mem, Stepper step,
+                            const CheckpointSettings *settings, CheckpointHeader *state) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_checkpoint;
+    action.sa_flags = SA_RESTART; // a read of input is finished, not cut short
+    sigaction(SIGUSR1, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    long next_checkpoint = settings->interval > 0 ? state->iterations + settings->interval
+                                                  : -1;
+    int pc = state->pc;
+    int status = PROGRAM_YIELDED;
+    while (status == PROGRAM_YIELDED) {
+        long slice = CHECKPOINT_SLICE;
+        if (next_checkpoint > 0 && next_checkpoint - state->iterations < slice) {
+            slice = next_checkpoint - state->iterations;
+        }
+        long fuel = slice;
+        status = step == execute_instruction
+                 ? execute_program_with_fuel(program, mem, &pc, &fuel)
+                 : step_with_fuel(program, mem, step, &pc, &fuel);
+        state->iterations += slice - fuel;
+        if (status == PROGRAM_YIELDED
+                && (state->iterations == next_checkpoint || checkpoint_requested)) {
+            checkpoint_requested = 0;
+            next_checkpoint = settings->interval > 0 ? state->iterations + settings->interval
+                                                     : -1;
+            state->pc = pc;
+            state->curr_index = mem->curr_index;
+            state->input_offset = io_input_bytes_read();
+            io_flush(); // the output so far belongs to the checkpoint
+            if (write_checkpoint(settings->path, state, mem) != 0) {
+                return -1;
+            }
+            if (stop_requested) {
+                return CHECKPOINT_STOPPED;
+            }
+        }
+    }
+    return status == 0 ? 0 : -1;
+}
+
+/*
+ * Executes source like execute_code_with_engine(), with the threaded engine
+ * or step (see run_checkpointed()), writing checkpoints to settings->path. If
+ * resume_path is not NULL, the program continues from the checkpoint there
+ * instead of starting on mem's blank tape. The checkpoint file is removed
+ * when the program ends. Returns 0 on success, CHECKPOINT_STOPPED if the
+ * program was stopped by SIGTERM after a checkpoint, or -1 if the brackets
+ * are unbalanced, the checkpoint cannot be resumed or written or the program
+ * stopped with an error.
+ */
+int execute_code_checkpointed(const char *source, long source_length, SystemMemory *mem,
+                              Stepper step, const CheckpointSettings *settings,
+                              const char *resume_path) {
+    CheckpointHeader header;
+    memset(&header, 0, sizeof(header));
+    Program *program = compile_program(source, source_length);
+    if (program == NULL) {
+        return -1;
+    }
+    // the same passes as the first run, so the instruction indices match
+    optimize_for_memory(program, mem);
+    header.source_hash = hash_source(source, source_length);
+    snprintf(header.cell_model, sizeof(header.cell_model), "%s", settings->cell_model);
+    header.cell_size = mem->cell_size;
+    header.tape_size = mem->tape_size;
+    header.virtual_tape = settings->virtual_tape;
+    header.num_ops = program->num_ops;
+    int status = resume_path != NULL ? resume(resume_path, &header, mem) : 0;
+    if (status == 0) {
+        status = run_checkpointed(program, mem, step, settings, &header);
+    }
+    io_flush();
+    free_program(program);
+    if (status == 0) {
+        unlink(settings->path);
+    }
+    return status;
+}
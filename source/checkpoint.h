@@ -0,0 +1,51 @@
+#include "interpreter.h"
+
+#ifndef CHECKPOINT_HEADER
+#define CHECKPOINT_HEADER
+
+#define CHECKPOINT_VERSION 3
+#define CHECKPOINT_STOPPED 1 // execute_code_checkpointed() stopped after a checkpoint
+
+/*
+ * The start of a checkpoint file. It is followed by the indices of the stored
+ * tape pages and, from the first page boundary after those, the pages
+ * themselves; every other page of the tape is 0.
+ */
+typedef struct {
+    char magic[8];
+    int version;
+    int page_size;           // bytes per stored page
+    unsigned long source_hash;
+    char cell_model[32];
+    int cell_size;
+    int tape_size;           // cells
+    int virtual_tape;
+    int num_ops;             // of the compiled program the instruction index is into
+    int pc;                  // the next instruction to run
+    int curr_index;
+    long iterations;         // loop iterations run so far
+    long input_offset;       // bytes of input read so far
+    long num_pages;
+} CheckpointHeader;
+
+/*
+ * Where and when execute_code_checkpointed() writes checkpoints.
+ */
+typedef struct {
+    const char *path;
+    long interval;           // loop iterations between checkpoints; 0: only on signals
+    const char *cell_model;  // recorded, so that the run resumes with the same cells
+    int virtual_tape;
+} CheckpointSettings;
+
+int write_checkpoint(const char *path, CheckpointHeader *header, const SystemMemory *mem);
+
+int read_checkpoint_header(const char *path, CheckpointHeader *header);
+
+int load_checkpoint(const char *path, CheckpointHeader *header, SystemMemory *mem);
+
+int execute_code_checkpointed(const char *source, long source_length, SystemMemory *mem,
+                              Stepper step, const CheckpointSettings *settings,
+                              const char *resume_path);
+
+#endif
@@ -0,0 +1,220 @@
+/*
+ * Compiled program files (.bfc): run --emit-bfc writes a program as it is
+ * after compiling and every optimization pass, and run --bfc runs it from the
+ * file, so the passes, however expensive, run once at build time instead of
+ * on every start.
+ *
+ * A file is a header followed by the instructions and then the multiply
+ * targets, exactly as they are laid out in memory. Loading maps the file and
+ * points the program into the mapping, so nothing is parsed or copied; the
+ * header's checks only have to read it once for the checksum. A file is
+ * rejected if it is not a .bfc file of this version and build, if it is
+ * damaged (wrong size or checksum), if the source has changed since it was
+ * compiled (source hash), or if it was optimized for another tape.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "compiled_file.h"
+#include "translator.h"
+
+#define BYTE_ORDER_MARK 0x01020304u
+
+static const char compiled_file_magic[8] = {'B', 'F', 'C', '\0', '\r', '\n', 0x1a, '\n'};
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;       // BYTE_ORDER_MARK as written by this machine
+    uint32_t header_size;
+    uint32_t instruction_size; // sizeof(Instruction) of the build that wrote it
+    uint64_t checksum;         // of everything after the header
+    uint64_t source_hash;
+    uint64_t source_length;
+    int32_t tape_size;         // the tape the program was optimized for
+    int32_t guard_size;
+    int32_t cell_size;
+    int32_t num_ops;
+    int32_t num_targets;
+    int32_t reserved;
+} CompiledFileHeader;
+
+/*
+ * Returns the size of a .bfc file of a program with num_ops instructions and
+ * num_targets multiply targets.
+ */
+static size_t file_size(long num_ops, long num_targets) {
+    return sizeof(CompiledFileHeader) + sizeof(Instruction) * num_ops
+           + sizeof(MultiplyTarget) * num_targets;
+}
+
+/*
+ * Writes program, compiled from the source_length characters of source and
+ * optimized for a run on mem (see optimize_for_memory()), to a .bfc file at
+ * path. Returns 0 on success, or -1 if the file cannot be written.
+ */
+int write_compiled_file(const char *path, const Program *program, const char *source,
+                        long source_length, const SystemMemory *mem) {
+    CompiledFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, compiled_file_magic, sizeof(compiled_file_magic));
+    header.version = COMPILED_FILE_VERSION;
+    header.byte_order = BYTE_ORDER_MARK;
+    header.header_size = sizeof(CompiledFileHeader);
+    header.instruction_size = sizeof(Instruction);
+    header.source_hash = hash_source(source, source_length);
+    header.source_length = source_length;
+    header.tape_size = mem->tape_size;
+    header.guard_size = mem->guard_size;
+    header.cell_size = mem->cell_size;
+    header.num_ops = program->num_ops;
+    header.num_targets = program->num_targets;
+    // the checksum covers the instructions and targets as one byte sequence
+    size_t ops_size = sizeof(Instruction) * program->num_ops;
+    size_t targets_size = sizeof(MultiplyTarget) * program->num_targets;
+    char *body = malloc(ops_size + targets_size + 1);
+    memcpy(body, program->ops, ops_size);
+    memcpy(body + ops_size, program->targets, targets_size);
+    header.checksum = hash_source(body, ops_size + targets_size);
+
+    FILE *file = fopen(path, "wb");
+    int ok = file != NULL && fwrite(&header, sizeof(header), 1, file) == 1
+             && fwrite(body, 1, ops_size + targets_size, file) == ops_size + targets_size;
+    if (file != NULL) {
+        ok = fclose(file) == 0 && ok;
+    }
+    free(body);
+    if (!ok) {
+        fprintf(stderr, "Error: cannot write \"%s\".\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Returns an error message if the header does not describe a valid .bfc file
+ * of size bytes, compiled from source and for mem's tape; otherwise NULL.
+ */
+static const char *check_header(const CompiledFileHeader *header, size_t size,
+                                const char *source, long source_length,
+                                const SystemMemory *mem) {
+    if (size < sizeof(CompiledFileHeader)
+            || memcmp(header->magic, compiled_file_magic, sizeof(compiled_file_magic)) != 0) {
+        return "is not a compiled program";
+    }
+    if (header->version != COMPILED_FILE_VERSION || header->byte_order != BYTE_ORDER_MARK
+            || header->header_size != sizeof(CompiledFileHeader)
+            || header->instruction_size != sizeof(Instruction)) {
+        return "was compiled by another version of run";
+    }
+    if (header->num_ops < 0 || header->num_targets < 0
+            || size != file_size(header->num_ops, header->num_targets)
+            || header->checksum != hash_source((const char *) (header + 1),
+                                               size - sizeof(CompiledFileHeader))) {
+        return "is damaged";
+    }
+    if (header->source_length != (uint64_t) source_length
+            || header->source_hash != hash_source(source, source_length)) {
+        return "was compiled from another version of the program";
+    }
+    if (header->tape_size != mem->tape_size || header->guard_size != mem->guard_size
+            || header->cell_size != mem->cell_size) {
+        return "was compiled for another tape (--tape-size, --virtual-tape or --cells)";
+    }
+    return NULL;
+}
+
+/*
+ * Loads the .bfc file at path, which must have been compiled from the
+ * source_length characters of source for a tape like mem's. Returns the
+ * program, or NULL if the file cannot be read or is rejected. Free it with
+ * free_compiled_file().
+ */
+CompiledFile *load_compiled_file(const char *path, const char *source, long source_length,
+                                 const SystemMemory *mem) {
+    int fd = open(path, O_RDONLY);
+    struct stat status;
+    if (fd < 0 || fstat(fd, &status) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        fprintf(stderr, "Error: File \"%s\" not found.\n", path);
+        return NULL;
+    }
+    size_t size = status.st_size;
+    // copy-on-write, so that passes that rewrite instructions in place still work
+    void *mapping = size > 0 ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)
+                             : MAP_FAILED;
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "Error: \"%s\" is not a compiled program.\n", path);
+        return NULL;
+    }
+    const CompiledFileHeader *header = mapping;
+    const char *error = check_header(header, size, source, source_length, mem);
+    if (error != NULL) {
+        fprintf(stderr, "Error: \"%s\" %s.\n", path, error);
+        munmap(mapping, size);
+        return NULL;
+    }
+    CompiledFile *file = malloc(sizeof(CompiledFile));
+    file->program.ops = (Instruction *) (header + 1);
+    file->program.num_ops = header->num_ops;
+    file->program.targets = (MultiplyTarget *) (file->program.ops + header->num_ops);
+    file->program.num_targets = header->num_targets;
+    file->mapping = mapping;
+    file->mapping_size = size;
+    return file;
+}
+
+/*
+ * Free a CompiledFile and unmap its file.
+ */
+void free_compiled_file(CompiledFile *file) {
+    munmap(file->mapping, file->mapping_size);
+    free(file);
+}
+
+/*
+ * Compiles the source_length characters of source, optimizes the program for
+ * a run on mem, whose tape must be blank, and writes it to a .bfc file at
+ * path. Returns 0 on success, or -1 if the brackets are unbalanced or the
+ * file cannot be written.
+ */
+int compile_to_file(const char *path, const char *source, long source_length,
+                    SystemMemory *mem) {
+    Program *program = compile_program(source, source_length);
+    if (program == NULL) {
+        return -1;
+    }
+    optimize_for_memory(program, mem);
+    int status = write_compiled_file(path, program, source, source_length, mem);
+    free_program(program);
+    return status;
+}
+
+/*
+ * Executes the program in the .bfc file at path, compiled from the
+ * source_length characters of source, on mem's blank tape with engine, like
+ * execute_code_with_engine() but without compiling or optimizing anything.
+ * Returns 0 on success, or -1 if the file is rejected or the engine stopped
+ * the program with an error.
+ */
+int execute_compiled_file(const char *path, const char *source, long source_length,
+                          SystemMemory *mem, Engine engine) {
+    CompiledFile *file = load_compiled_file(path, source, source_length, mem);
+    if (file == NULL) {
+        return -1;
+    }
+    mem->blank = 0;
+    int status = engine(&file->program, mem);
+    io_flush();
+    free_compiled_file(file);
+    return status;
+}
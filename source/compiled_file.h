@@ -0,0 +1,32 @@
+#include "interpreter.h"
+
+#ifndef COMPILED_FILE_HEADER
+#define COMPILED_FILE_HEADER
+
+#define COMPILED_FILE_VERSION 2 // change with the instruction set or the optimizations
+
+/*
+ * A compiled program loaded from a .bfc file. The instructions and multiply
+ * targets are not copied: they point into the file's mapping.
+ */
+typedef struct {
+    Program program;
+    void *mapping;
+    size_t mapping_size;
+} CompiledFile;
+
+int write_compiled_file(const char *path, const Program *program, const char *source,
+                        long source_length, const SystemMemory *mem);
+
+CompiledFile *load_compiled_file(const char *path, const char *source, long source_length,
+                                 const SystemMemory *mem);
+
+void free_compiled_file(CompiledFile *file);
+
+int compile_to_file(const char *path, const char *source, long source_length,
+                    SystemMemory *mem);
+
+int execute_compiled_file(const char *path, const char *source, long source_length,
+                          SystemMemory *mem, Engine engine);
+
+#endif
@@ -0,0 +1,159 @@
+/*
+ * Compiles Brainf**k source code into a compact list of instructions before
+ * anything is executed. Comments (every non-command character) are dropped,
+ * runs of the same command are folded into a single instruction and every
+ * bracket is matched with its partner, so the interpreter never has to look at
+ * the source text again.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "compiler.h"
+#include "stack.h"
+
+/*
+ * Appends an instruction to the program, growing its storage when needed.
+ * Returns the index of the new instruction.
+ */
+static int emit(Program *program, int *capacity, OpCode code, int arg,
+                long position) {
+    if (program->num_ops == *capacity) {
+        *capacity = *capacity * 2;
+        program->ops = realloc(program->ops, sizeof(Instruction) * *capacity);
+    }
+    program->ops[program->num_ops].code = code;
+    program->ops[program->num_ops].arg = arg;
+    program->ops[program->num_ops].offset = 0;
+    program->ops[program->num_ops].jump = 0;
+    program->ops[program->num_ops].position = position;
+    return program->num_ops++;
+}
+
+/*
+ * Adds amount to the previous instruction if it is an instruction of the same
+ * code whose argument has the same sign; otherwise appends a new instruction.
+ * Only runs in one direction are folded: because cells saturate and the pointer
+ * sticks at the tape edges, "+-" or "<>" are not always no-ops.
+ */
+static void emit_folded(Program *program, int *capacity, OpCode code, int amount,
+                        long position) {
+    if (program->num_ops > 0) {
+        Instruction *last = &program->ops[program->num_ops - 1];
+        if (last->code == code && (last->arg > 0) == (amount > 0)) {
+            last->arg += amount;
+            return;
+        }
+    }
+    emit(program, capacity, code, amount, position);
+}
+
+/*
+ * Compiles the first source_length characters of source. Returns the compiled
+ * Program, or NULL if the brackets in the source are unbalanced. Free the
+ * result with free_program().
+ */
+Program *compile_program(const char *source, long source_length) {
+    long error_position;
+    Program *program = compile_program_quietly(source, source_length,
+                                               &error_position);
+    if (program == NULL && source[error_position] == ']') {
+        fprintf(stderr, "Error: no matching left-bracket found for right-bracket at position %ld\n",
+                error_position);
+    } else if (program == NULL) {
+        fprintf(stderr, "Error: no matching right-bracket found for left-bracket at position %ld\n",
+                error_position);
+    }
+    return program;
+}
+
+/*
+ * Like compile_program(), but prints nothing: if the brackets are unbalanced,
+ * the position of the first bracket without a partner is stored in
+ * error_position.
+ */
+Program *compile_program_quietly(const char *source, long source_length,
+                                 long *error_position) {
+    long i;
+    int capacity = 64;
+    Program *program = malloc(sizeof(Program));
+    program->ops = malloc(sizeof(Instruction) * capacity);
+    program->num_ops = 0;
+    program->targets = NULL;
+    program->num_targets = 0;
+    program->threaded_code = NULL;
+    Stack *left_bracket_stack = new_stack(); // stores the instruction indices of
+                                             // left brackets not yet matched
+    Stack *left_bracket_positions = new_stack(); // and their source positions
+    for (i = 0; i < source_length; i++) {
+        switch (source[i]) {
+            case '+':
+                emit_folded(program, &capacity, OP_ADD, 1, i);
+                break;
+            case '-':
+                emit_folded(program, &capacity, OP_ADD, -1, i);
+                break;
+            case '>':
+                emit_folded(program, &capacity, OP_MOVE, 1, i);
+                break;
+            case '<':
+                emit_folded(program, &capacity, OP_MOVE, -1, i);
+                break;
+            case '.':
+                emit(program, &capacity, OP_OUTPUT, 0, i);
+                break;
+            case ',':
+                emit(program, &capacity, OP_INPUT, 0, i);
+                break;
+            case '[':
+                stack_push(left_bracket_stack,
+                           emit(program, &capacity, OP_JUMP_IF_ZERO, 0, i));
+                stack_push(left_bracket_positions, i);
+                break;
+            case ']':
+                if (stack_size(left_bracket_stack) == 0) {
+                    *error_position = i;
+                    stack_free(left_bracket_stack);
+                    stack_free(left_bracket_positions);
+                    free_program(program);
+                    return NULL;
+                } else {
+                    int left_bracket_index = stack_pop(left_bracket_stack);
+                    stack_pop(left_bracket_positions);
+                    int right_bracket_index = emit(program, &capacity,
+                                                   OP_JUMP_IF_NOT_ZERO, 0, i);
+                    program->ops[right_bracket_index].jump = left_bracket_index;
+                    program->ops[left_bracket_index].jump = right_bracket_index;
+                }
+                break;
+            // the language ignores all other characters
+        }
+    }
+    if (stack_size(left_bracket_stack) != 0) {
+        *error_position = stack_peek(left_bracket_positions);
+        stack_free(left_bracket_stack);
+        stack_free(left_bracket_positions);
+        free_program(program);
+        return NULL;
+    }
+    stack_free(left_bracket_stack);
+    stack_free(left_bracket_positions);
+    return program;
+}
+
+/*
+ * Free a compiled Program and all internal pointers.
+ */
+void free_program(Program *program) {
+    free(program->ops);
+    free(program->targets);
+    free(program->threaded_code);
+    free(program);
+}
+
+/*
+ * Returns 1 if instructions with code open a loop: "[" or a recognized loop.
+ */
+int is_loop_start(OpCode code) {
+    return code == OP_JUMP_IF_ZERO || code == OP_SET_ZERO || code == OP_SCAN
+           || code == OP_MULTIPLY_LOOP || code == OP_CLEAR_RANGE;
+}
@@ -0,0 +1,76 @@
+#ifndef COMPILER_HEADER
+#define COMPILER_HEADER
+
+typedef enum {
+    OP_ADD,             // add arg to the cell offset cells from the pointer
+                        // (saturating at 0 and 127)
+    OP_MOVE,            // move the pointer arg cells (sticking at the tape edges)
+    OP_OUTPUT,
+    OP_INPUT,
+    OP_JUMP_IF_ZERO,    // "["
+    OP_JUMP_IF_NOT_ZERO,// "]"
+    /*
+     * Loops recognized by optimize_program(). Each replaces the "[" of the loop
+     * it was recognized from and jumps past the loop in one step. The loop body
+     * is left in place: when the shortcut would not behave exactly like the
+     * loop (e.g. the pointer would stick at a tape edge) execution falls
+     * through into the body as if it were a plain "[".
+     */
+    OP_SET_ZERO,        // "[-]": arg is the amount added by the loop body
+    OP_SCAN,            // "[>]", "[<<]": arg is the distance moved by the body
+    OP_MULTIPLY_LOOP,   // "[->++>+++<<]": arg is the number of targets,
+                        // offset is the index of the first one in targets
+    OP_CLEAR_RANGE,     // "[[-]>]": arg is the distance moved by the body
+    OP_MOVE_UNCHECKED,  // OP_MOVE that cannot reach a tape edge: on a virtual
+                        // tape (moving off the tape hits a guard page instead)
+                        // or after an OP_CHECK_RANGE
+    /*
+     * Straight-line code rewritten by address_cells_by_offset(): the cells are
+     * addressed at offsets from the pointer, which moves once at the end. The
+     * original code follows as a fallback for when the pointer would stick at a
+     * tape edge:
+     *   OP_CHECK_RANGE  the offset code  OP_JUMP  the original code
+     */
+    OP_CHECK_RANGE,     // jump to the original code unless the cells offset
+                        // and arg cells away from the pointer are on the tape
+    OP_JUMP             // jump past the original code
+} OpCode;
+
+typedef struct {
+    OpCode code;
+    int arg;
+    int offset;
+    int jump; // loops: index of the matching bracket; OP_CHECK_RANGE and
+              // OP_JUMP: execution continues after the instruction at jump
+    int position; // index in the source of the instruction's first command
+} Instruction;
+
+/*
+ * One cell updated by a multiply loop: each iteration adds factor to the cell
+ * offset cells away from the loop counter.
+ */
+typedef struct {
+    int offset;
+    int factor;
+} MultiplyTarget;
+
+typedef struct {
+    Instruction *ops;
+    int num_ops;
+    MultiplyTarget *targets;
+    int num_targets;
+    // the ops as direct-threaded code, built by the threaded engine when it
+    // first runs the program (after every optimization pass); NULL until then
+    void **threaded_code;
+} Program;
+
+Program *compile_program(const char *source, long source_length);
+
+Program *compile_program_quietly(const char *source, long source_length,
+                                 long *error_position);
+
+void free_program(Program *program);
+
+int is_loop_start(OpCode code);
+
+#endif
@@ -0,0 +1,260 @@
+/*
+ * Daemon mode (run --serve): a long-running server on a Unix domain socket that
+ * runs (program, input) requests and streams their output back (see
+ * daemon_protocol.h). Compiled programs are kept in an LRU cache keyed by their
+ * source, so a warm daemon runs a known program without reading, parsing or
+ * compiling anything. A fixed pool of worker threads waits on one epoll set
+ * holding the listening socket and every idle connection; each worker owns a
+ * pre-allocated tape that is reset (not reallocated) between requests.
+ *
+ * A worker serves one request of a connection at a time and then returns the
+ * connection to the epoll set, so clients that stay connected without sending
+ * anything hold no worker. Connections are registered with EPOLLONESHOT, so
+ * only one worker at a time serves a connection, and have timeouts for
+ * reading and writing, so a client that stops halfway through a request or
+ * stops reading its output only holds a worker that long.
+ *
+ * A request runs as a task (see bf_task_run()) in turns of fuel, so that it
+ * can be stopped at the daemon's limit of loop iterations, and as soon as its
+ * client has gone away: an endless program only holds its worker while
+ * someone waits for it.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "daemon.h"
+#include "daemon_protocol.h"
+#include "program_cache.h"
+
+#define CONNECTION_CHECK_INTERVAL (1L << 20) // loop iterations between checks on the client
+#define CONNECTION_TIMEOUT_SECONDS 10 // for a read or write once a request has started
+
+typedef struct {
+    int listen_fd;
+    int epoll_fd;       // the listening socket and the idle connections
+    long fuel;          // loop iterations a request may run; 0: no limit
+    ProgramCache *cache;
+    BfContext *context; // this worker's tape
+    char *request;      // this worker's request buffer
+    uint32_t request_capacity;
+} Worker;
+
+typedef struct {
+    int fd;
+    int failed; // the client went away; the rest of the output is dropped
+} Connection;
+
+/*
+ * Sends a piece of program output to the client as one frame.
+ */
+static void send_output(void *target, const char *data, long length) {
+    Connection *connection = target;
+    if (!connection->failed && send_frame(connection->fd, data, length) != 0) {
+        connection->failed = 1;
+    }
+}
+
+/*
+ * Returns 1 if the client has closed the connection or it failed, without
+ * waiting for anything. A request the client has already sent after this one
+ * is left to be read.
+ */
+static int client_gone(Connection *connection) {
+    char byte;
+    ssize_t received = recv(connection->fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK
+                          && errno != EINTR)) {
+        connection->failed = 1;
+    }
+    return connection->failed;
+}
+
+/*
+ * Runs program with the input_length bytes of input on the worker's tape,
+ * sending the output to the client as it is written. Returns BF_OK, or
+ * BF_ERROR_OUT_OF_FUEL if the program was stopped at the worker's limit of
+ * fuel. A run whose client has gone away is stopped early and marks the
+ * connection as failed.
+ */
+static BfStatus run_request(Worker *worker, const BfProgram *program,
+                            const char *input, long input_length,
+                            Connection *connection) {
+    BfTask *task = bf_task_new_in_context(program, worker->context, input,
+                                          input_length, send_output, connection);
+    if (task == NULL) {
+        return BF_ERROR_NO_MEMORY;
+    }
+    long limit = worker->fuel > 0 ? worker->fuel : LONG_MAX;
+    long fuel_used = 0;
+    BfStatus status;
+    do {
+        long turn = limit - fuel_used < CONNECTION_CHECK_INTERVAL
+                    ? limit - fuel_used : CONNECTION_CHECK_INTERVAL;
+        long fuel = turn;
+        status = bf_task_run(task, &fuel);
+        fuel_used += turn - fuel;
+    } while (status == BF_YIELDED && fuel_used < limit && !client_gone(connection));
+    bf_task_free(task);
+    return status == BF_YIELDED ? BF_ERROR_OUT_OF_FUEL : status;
+}
+
+/*
+ * Reads one request from the connection, runs it and sends the response.
+ * Returns -1 if the client closed the connection or it failed.
+ */
+static int serve_request(Worker *worker, Connection *connection) {
+    uint32_t lengths[2];
+    if (read_fully(connection->fd, lengths, sizeof(lengths)) != 0) {
+        return -1;
+    }
+    uint32_t program_length = ntohl(lengths[0]);
+    uint32_t input_length = ntohl(lengths[1]);
+    if (program_length > MAX_REQUEST_PART || input_length > MAX_REQUEST_PART) {
+        return -1;
+    }
+    if (program_length + input_length > worker->request_capacity) {
+        worker->request_capacity = program_length + input_length;
+        worker->request = realloc(worker->request, worker->request_capacity);
+    }
+    if (read_fully(connection->fd, worker->request, program_length + input_length) != 0) {
+        return -1;
+    }
+    BfStatus status;
+    CacheEntry *entry = program_cache_acquire(worker->cache, worker->request,
+                                              program_length, &status);
+    if (entry != NULL) {
+        status = run_request(worker, cache_entry_program(entry),
+                             worker->request + program_length, input_length,
+                             connection);
+        program_cache_release(worker->cache, entry);
+    }
+    uint32_t network_status = htonl((uint32_t) status);
+    if (connection->failed || send_frame(connection->fd, NULL, 0) != 0
+            || write_fully(connection->fd, &network_status, sizeof(network_status)) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Accepts a waiting connection, if another worker has not taken it, and adds
+ * it to the epoll set.
+ */
+static void accept_connection(Worker *worker) {
+    struct timeval timeout = {CONNECTION_TIMEOUT_SECONDS, 0};
+    struct epoll_event event;
+    int fd = accept(worker->listen_fd, NULL, NULL);
+    if (fd < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR
+                && errno != ECONNABORTED) {
+            perror("accept");
+        }
+        return;
+    }
+    Connection *connection = malloc(sizeof(Connection));
+    connection->fd = fd;
+    connection->failed = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.ptr = connection;
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        close(fd);
+        free(connection);
+    }
+}
+
+static void *run_worker(void *argument) {
+    Worker *worker = argument;
+    struct epoll_event event;
+    while (1) {
+        if (epoll_wait(worker->epoll_fd, &event, 1, -1) != 1) {
+            continue;
+        }
+        Connection *connection = event.data.ptr;
+        if (connection == NULL) { // the listening socket
+            accept_connection(worker);
+            continue;
+        }
+        // one request, then the connection waits in the epoll set again
+        event.events = EPOLLIN | EPOLLONESHOT;
+        if (serve_request(worker, connection) != 0
+                || epoll_ctl(worker->epoll_fd, EPOLL_CTL_MOD, connection->fd, &event) != 0) {
+            close(connection->fd);
+            free(connection);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Listens on socket_path (replacing a stale socket file) and serves requests
+ * on num_workers threads (0: one per online CPU), each with a tape of
+ * tape_size cells, caching up to cache_capacity compiled programs. If fuel is
+ * not 0, a request is stopped after fuel loop iterations. Only returns, with
+ * -1, if the socket cannot be set up.
+ */
+int serve(const char *socket_path, int num_workers, int tape_size,
+          int cache_capacity, long fuel) {
+    struct sockaddr_un address;
+    int i;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        printf("Error: socket path \"%s\" is too long.\n", socket_path);
+        return -1;
+    }
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_path);
+    unlink(socket_path);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *) &address, sizeof(address)) != 0
+            || listen(listen_fd, SOMAXCONN) != 0) {
+        printf("Error: cannot listen on \"%s\": %s.\n", socket_path, strerror(errno));
+        return -1;
+    }
+    int epoll_fd = epoll_create1(0);
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    if (epoll_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) != 0) {
+        printf("Error: cannot wait for connections: %s.\n", strerror(errno));
+        return -1;
+    }
+    signal(SIGPIPE, SIG_IGN); // a client that goes away is only a failed write
+    if (num_workers <= 0) {
+        num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    ProgramCache *cache = new_program_cache(cache_capacity);
+    Worker *workers = calloc(num_workers, sizeof(Worker));
+    pthread_t thread;
+    for (i = 0; i < num_workers; i++) {
+        workers[i].listen_fd = listen_fd;
+        workers[i].epoll_fd = epoll_fd;
+        workers[i].fuel = fuel;
+        workers[i].cache = cache;
+        workers[i].context = bf_context_new(tape_size);
+        if (workers[i].context == NULL) {
+            printf("Error: cannot allocate a tape of %d cells.\n", tape_size);
+            return -1;
+        }
+    }
+    printf("Listening on %s with %d workers.\n", socket_path, num_workers);
+    fflush(stdout);
+    for (i = 1; i < num_workers; i++) {
+        pthread_create(&thread, NULL, run_worker, &workers[i]);
+        pthread_detach(thread);
+    }
+    run_worker(&workers[0]);
+    return -1;
+}
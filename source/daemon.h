@@ -0,0 +1,9 @@
+#ifndef DAEMON_HEADER
+#define DAEMON_HEADER
+
+#define DEFAULT_CACHE_CAPACITY 256 // compiled programs kept by the daemon
+
+int serve(const char *socket_path, int num_workers, int tape_size,
+          int cache_capacity, long fuel);
+
+#endif
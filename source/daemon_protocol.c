@@ -0,0 +1,133 @@
+/*
+ * Reading and writing the messages of the daemon protocol (see
+ * daemon_protocol.h). Every function returns 0 on success, or -1 if the
+ * connection failed or the peer sent something malformed.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "daemon_protocol.h"
+
+int read_fully(int fd, void *data, size_t length) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t result = read(fd, (char *) data + done, length - done);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return -1;
+        }
+        done += result;
+    }
+    return 0;
+}
+
+int write_fully(int fd, const void *data, size_t length) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t result = write(fd, (const char *) data + done, length - done);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return -1;
+        }
+        done += result;
+    }
+    return 0;
+}
+
+/*
+ * Connects to the daemon listening on socket_path. Returns the connected
+ * socket, or -1.
+ */
+int connect_to_daemon(const char *socket_path) {
+    struct sockaddr_un address;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_path);
+    if (connect(fd, (struct sockaddr *) &address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int send_request(int fd, const char *program, uint32_t program_length,
+                 const char *input, uint32_t input_length) {
+    uint32_t header[2] = {htonl(program_length), htonl(input_length)};
+    if (write_fully(fd, header, sizeof(header)) != 0
+            || write_fully(fd, program, program_length) != 0
+            || write_fully(fd, input, input_length) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Sends one output frame; an empty frame ends the output.
+ */
+int send_frame(int fd, const char *data, uint32_t length) {
+    uint32_t header = htonl(length);
+    if (write_fully(fd, &header, sizeof(header)) != 0
+            || write_fully(fd, data, length) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Reads one response, passing every output frame to frame_function (which may
+ * be NULL to discard the output), and stores its status.
+ */
+int receive_response(int fd, FrameFunction frame_function, void *target,
+                     int *status) {
+    char *data = NULL;
+    uint32_t capacity = 0;
+    while (1) {
+        uint32_t length;
+        if (read_fully(fd, &length, sizeof(length)) != 0) {
+            free(data);
+            return -1;
+        }
+        length = ntohl(length);
+        if (length == 0) {
+            break;
+        }
+        if (length > MAX_REQUEST_PART) {
+            free(data);
+            return -1;
+        }
+        if (length > capacity) {
+            capacity = length;
+            data = realloc(data, capacity);
+        }
+        if (read_fully(fd, data, length) != 0) {
+            free(data);
+            return -1;
+        }
+        if (frame_function != NULL) {
+            frame_function(target, data, length);
+        }
+    }
+    free(data);
+    uint32_t network_status;
+    if (read_fully(fd, &network_status, sizeof(network_status)) != 0) {
+        return -1;
+    }
+    *status = (int32_t) ntohl(network_status);
+    return 0;
+}
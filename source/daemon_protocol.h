@@ -0,0 +1,37 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef DAEMON_PROTOCOL_HEADER
+#define DAEMON_PROTOCOL_HEADER
+
+/*
+ * The protocol between the daemon (run --serve) and its clients, over a Unix
+ * domain stream socket. All numbers are 32-bit, in network byte order.
+ *
+ * Request:  program length, input length, the program, the input.
+ * Response: any number of output frames (a length, then that many bytes of
+ *           output), an empty frame, then the status (a BfStatus).
+ *
+ * A connection can carry any number of requests, one after the other.
+ */
+
+#define MAX_REQUEST_PART (64 * 1024 * 1024) // bytes of program or of input
+
+// receives output frames in receive_response()
+typedef void (*FrameFunction)(void *target, const char *data, long length);
+
+int read_fully(int fd, void *data, size_t length);
+
+int write_fully(int fd, const void *data, size_t length);
+
+int connect_to_daemon(const char *socket_path);
+
+int send_request(int fd, const char *program, uint32_t program_length,
+                 const char *input, uint32_t input_length);
+
+int send_frame(int fd, const char *data, uint32_t length);
+
+int receive_response(int fd, FrameFunction frame_function, void *target,
+                     int *status);
+
+#endif
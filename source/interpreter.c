@@ -1,7 +1,12 @@
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <stdio.h>
 #include "interpreter.h"
+#include "tape_kernels.h"
+#include "jit.h"
+#include "io.h"
+#include "virtual_tape.h"
 
 const int NUM_MEMORY_CELLS = 30000; // initialize with 30 kb of memory
 
@@ -15,11 +20,31 @@ void log_system_error(const char *function_name, const char *message) {
  * and a completely blank tape (zeroes in all cells).
  */
 SystemMemory *initialize_memory() {
+    return initialize_memory_with_size(NUM_MEMORY_CELLS);
+}
+
+/*
+ * Initializes system memory like initialize_memory(), with a tape of
+ * num_tape_cells cells.
+ */
+SystemMemory *initialize_memory_with_size(int num_tape_cells) {
+    return initialize_memory_with_cells(num_tape_cells, sizeof(char));
+}
+
+/*
+ * Initializes system memory with a blank tape of num_tape_cells cells that are
+ * cell_size bytes wide, for the engines of the wider cell models.
+ */
+SystemMemory *initialize_memory_with_cells(int num_tape_cells, int cell_size) {
     SystemMemory *mem = malloc(sizeof(SystemMemory));
-    mem->tape_size = NUM_MEMORY_CELLS;
-    char *tape = malloc(sizeof(char) * NUM_MEMORY_CELLS);
+    mem->tape_size = num_tape_cells;
+    char *tape = calloc(num_tape_cells, cell_size);
     mem->curr_index = 0;
     mem->tape = tape;
+    mem->guard_size = 0;
+    mem->cell_size = cell_size;
+    mem->io = NULL;
+    mem->blank = 1;
     return mem;
 }
 
@@ -27,6 +52,10 @@ SystemMemory *initialize_memory() {
  * Free allocated SystemMemory and all internal pointers.
  */
 void free_mem(SystemMemory *mem) {
+    if (mem->guard_size > 0) {
+        free_virtual_memory(mem);
+        return;
+    }
     free(mem->tape);
     free(mem);
 }
@@ -80,166 +109,510 @@ int decrement_memory_cell_value(SystemMemory *mem) {
 }
 
 /*
- * Outputs to the console the value of the tape-cell under the pointer. Returns
- * the cell's value.
+ * Returns value + amount as it would be after |amount| single increments or
+ * decrements: increments stop at 127, and decrements stop at 0 (and never change
+ * a value that is already 0 or below).
+ */
+static int saturating_add(int value, long amount) {
+    if (amount > 0) {
+        return value > 127 - amount ? 127 : value + amount;
+    } else if (value > 0) {
+        return value < -amount ? 0 : value + amount;
+    }
+    return value;
+}
+
+/*
+ * Adds amount (which may be negative) to the value of the tape-cell under the
+ * pointer. Has the same effect as calling increment_memory_cell_value() or
+ * decrement_memory_cell_value() |amount| times, so the value saturates at 127
+ * and 0. Returns the cell's new value.
+ */
+int add_to_memory_cell_value(SystemMemory *mem, int amount) {
+    mem->tape[mem->curr_index] = saturating_add(mem->tape[mem->curr_index], amount);
+    return mem->tape[mem->curr_index];
+}
+
+/*
+ * Like add_to_memory_cell_value(), for the tape-cell offset cells away from the
+ * pointer, which must be on the tape. Returns the cell's new value.
+ */
+int add_to_memory_cell_at_offset(SystemMemory *mem, int offset, int amount) {
+    char *cell = &mem->tape[mem->curr_index + offset];
+    *cell = saturating_add(*cell, amount);
+    return *cell;
+}
+
+/*
+ * Moves the system memory's pointer distance tape-cells to the right (or to the
+ * left, for a negative distance). Like move_memory_pointer_left() and
+ * move_memory_pointer_right(), the pointer sticks at either end of the tape.
+ * Returns the new index of the memory pointer.
+ */
+int move_memory_pointer(SystemMemory *mem, int distance) {
+    long new_index = (long) mem->curr_index + distance;
+    if (new_index < 0) {
+        new_index = 0;
+    } else if (new_index > mem->tape_size - 1) {
+        new_index = mem->tape_size - 1;
+    }
+    mem->curr_index = new_index;
+    return mem->curr_index;
+}
+
+/*
+ * Outputs to the console the value of the tape-cell under the pointer. Output
+ * is buffered (see io.c). Returns the cell's value.
  */
 int output_current_cell_value(SystemMemory *mem) {
     char current_cell_value = mem->tape[mem->curr_index];
-    printf("%c", current_cell_value);
+    if (mem->io != NULL) {
+        io_buffers_write(mem->io, current_cell_value);
+    } else {
+        io_write_byte(current_cell_value);
+    }
     return current_cell_value;
 }
 
 /*
  * Reads a single character as input and stores it in the tape-cell under the
- * pointer. Returns the stored value.
+ * pointer. At the end of input the cell holds EOF (-1). Returns the stored
+ * value.
  */
 int store_input_char_in_current_cell(SystemMemory *mem) {
-    char input_char = getchar();
+    char input_char = mem->io != NULL ? io_buffers_read(mem->io) : io_read_byte();
     mem->tape[mem->curr_index] = input_char;
     return input_char;
 }
 
 /*
- * Scans instructions for a right bracket to match the left bracket at position
- * instruction_index in the instructions string. Returns the index of the matching
- * right bracket. Returns -1 if no matching right bracket is found.
- *
- * Note: This could be optimized by taking a pass through the instructions
- * before executing anything. The compiler could iterate through the code
- * and store with each left bracket the index of its corresponding right bracket,
- * making later jumps to the right bracket O(1). In the case of nested loops,
- * where we might repeat the scan for a right bracket when the outer loop is executed
- * more than once and the inner loop is not executed, this pre-work is more efficient.
- * The optimization would also catch unmatched brackets before execution.
+ * Executed when a left bracket (OP_JUMP_IF_ZERO) is encountered. If the
+ * tape-cell under the pointer is 0, the instruction after the matching right
+ * bracket is set as the current instruction. This is equivalent to skipping a
+ * loop. If the tape-cell under the pointer is not 0, the loop will be entered.
+ * Returns the index of the current instruction after running this algorithm.
  */
-static int find_matching_right_bracket(char *instructions, int instruction_index) {
-    int i;
-    int nested_loop_offset = 0;
-    int instr_length = strlen(instructions);
-    // search ahead of the left bracket for a matching right bracket
-    for (i = instruction_index + 1; i < instr_length; i++) {
-        // if we encounter another left bracket, ignore its corresponding right bracket
-        if (instructions[i] == '[') {
-            nested_loop_offset++;
-        }
-        if (instructions[i] == ']') {
-            // if end of source-code loop that starts at instruction_index
-            if (nested_loop_offset-- == 0) {
-                // set the current instruction to the instruction after the loop
-                return i + 1;
-            }
-        }
+int conditional_loop_entry(SystemMemory *mem, const Instruction *ops,
+                           int op_index) {
+    if (mem->tape[mem->curr_index] == 0) {
+        // skip over the loop
+        return ops[op_index].jump + 1;
     }
-    log_system_error("conditional_loop_entry", "Error: no matching right-bracket found for left-bracket");
-    return -1;
+    return op_index + 1;
 }
 
 /*
- * Executed when a left bracket ("[") is encountered. If the tape-cell under the
- * pointer is 0, attempts to find the index of the matching right bracket. If it
- * can be found, the instruction after the right bracket is set as the current
- * instruction. This is equivalent to skipping a loop.
- * If the tape-cell under the pointer is not 0, the loop will be entered and
- * the left bracket's index will be added to the stack.
- * Returns the index of the current instruction after running this algorithm. If
- * there is no matching right bracket but a loop-skip is called for, returns -1.
+ * Executed when a right bracket (OP_JUMP_IF_NOT_ZERO) is encountered. If the
+ * tape-cell under the pointer is NOT 0, the instruction after the matching left
+ * bracket is set as the current instruction. This is equivalent to continuing a
+ * loop. If the pointer value is 0, execution may continue beyond the loop.
+ * Returns the index of the current instruction after this algorithm is run.
  */
-int conditional_loop_entry(SystemMemory *mem, char *instructions,
-                           int instruction_index, Stack *stack) {
+int conditional_continue(SystemMemory *mem, const Instruction *ops,
+                         int op_index) {
     if (mem->tape[mem->curr_index] == 0) {
-        // skip over the loop
-        return find_matching_right_bracket(instructions, instruction_index);
+        return op_index + 1;
     }
-    // add left bracket index to stack--entering loop
-    stack_push(stack, instruction_index);
-    return instruction_index + 1;
+    return ops[op_index].jump + 1;
 }
 
 /*
- * Executed when a right bracket ("]") is encountered. If the tape-cell under
- * the pointer is NOT 0, jumps to the instruction after the previous left bracket.
- * If a matching left bracket can be found, the instruction after the left
- * bracket is set as the current instruction. This is equivalent to continuing
- * a loop.
- * If the pointer value is 0, the left bracket that marked the beginning of
- * the loop is removed from the stack and execution may continue beyond the loop.
- * Returns the index of the current instruction after this algorithm is run.
- * Regardless of the pointer value, if no matching left bracket is found,
- * returns -1.
+ * Executed for OP_SET_ZERO ("[-]"). Clears the tape-cell under the pointer and
+ * skips the loop if the loop would have counted the cell down (or up) to 0. A
+ * cell the loop can never clear is left to the loop body, just as with "[".
+ * Returns the index of the next instruction to execute.
  */
-int conditional_continue(SystemMemory *mem, int instruction_index,
-                         Stack *stack) {
-    if (stack_size(stack) == 0) {
-        log_system_error("conditional_continue", "Error: no matching left-bracket found for right-bracket");
-        return -1;
+int set_zero_loop(SystemMemory *mem, const Instruction *ops, int op_index) {
+    char value = mem->tape[mem->curr_index];
+    if (value != 0 && (value > 0) != (ops[op_index].arg < 0)) {
+        return op_index + 1; // e.g. "[-]" on a negative cell never terminates
     }
-    if (mem->tape[mem->curr_index] == 0) {
-        // remove the left bracket that started the loop from the stack
-        stack_pop(stack);
-        return instruction_index + 1;
+    mem->tape[mem->curr_index] = 0;
+    return ops[op_index].jump + 1;
+}
+
+/*
+ * Executed for OP_SCAN ("[>]"). Moves the pointer by the loop's stride until it
+ * reaches a tape-cell holding 0, then skips the loop. If the scan would run into
+ * a tape edge first, the pointer stops on the last cell before the edge and the
+ * remaining iterations are left to the loop body.
+ * Returns the index of the next instruction to execute.
+ */
+int scan_loop(SystemMemory *mem, const Instruction *ops, int op_index) {
+    int stride = ops[op_index].arg;
+    long zero_index = find_zero_cell(mem->tape, mem->tape_size, mem->curr_index,
+                                     stride);
+    if (zero_index == -1) {
+        mem->curr_index = last_cell_in_range(mem->tape_size, mem->curr_index,
+                                             stride);
+        return op_index + 1;
+    }
+    mem->curr_index = zero_index;
+    return ops[op_index].jump + 1;
+}
+
+/*
+ * Executed for OP_CLEAR_RANGE ("[[-]>]"). Clears tape-cells from the pointer
+ * onward with the loop's stride until it reaches a cell holding 0, then skips
+ * the loop. The loop body takes over at a negative cell (which "[-]" can never
+ * clear) or at the last cell before a tape edge.
+ * Returns the index of the next instruction to execute.
+ */
+int clear_range_loop(SystemMemory *mem, const Instruction *ops, int op_index) {
+    long i;
+    int stride = ops[op_index].arg;
+    long start = mem->curr_index;
+    long stop = find_non_positive_cell(mem->tape, mem->tape_size, start, stride);
+    if (stop == -1) {
+        stop = last_cell_in_range(mem->tape_size, start, stride);
+    }
+    if (stride == 1) {
+        memset(mem->tape + start, 0, stop - start);
     } else {
-        int left_bracket_index = stack_peek(stack);
-        return left_bracket_index + 1;
+        for (i = start; i != stop; i += stride) {
+            mem->tape[i] = 0;
+        }
     }
+    mem->curr_index = stop;
+    if (mem->tape[stop] == 0) {
+        return ops[op_index].jump + 1;
+    }
+    return op_index + 1;
 }
 
 /*
- * Executes the instruction at instruction_index. Returns the index of the next
+ * Executed for OP_MULTIPLY_LOOP ("[->++<]"). Adds factor times the value of the
+ * tape-cell under the pointer to each target cell, clears the cell and skips the
+ * loop. Falls back to the loop body if the counter is negative (the loop would
+ * never terminate) or if a target lies beyond a tape edge.
+ * Returns the index of the next instruction to execute.
+ */
+int multiply_loop(SystemMemory *mem, const Program *program, int op_index) {
+    int i;
+    const Instruction *op = &program->ops[op_index];
+    const MultiplyTarget *targets = &program->targets[op->offset];
+    char count = mem->tape[mem->curr_index];
+    if (count == 0) {
+        return op->jump + 1;
+    }
+    if (count < 0) {
+        return op_index + 1;
+    }
+    for (i = 0; i < op->arg; i++) {
+        long target_index = (long) mem->curr_index + targets[i].offset;
+        if (target_index < 0 || target_index > mem->tape_size - 1) {
+            return op_index + 1;
+        }
+    }
+    for (i = 0; i < op->arg; i++) {
+        char *cell = &mem->tape[mem->curr_index + targets[i].offset];
+        *cell = saturating_add(*cell, (long) targets[i].factor * count);
+    }
+    mem->tape[mem->curr_index] = 0;
+    return op->jump + 1;
+}
+
+/*
+ * Executed for OP_CHECK_RANGE. Continues with the offset-addressed code that
+ * follows if every cell it reaches is on the tape, otherwise with the original
+ * code after the OP_JUMP at the end of it.
+ * Returns the index of the next instruction to execute.
+ */
+int check_range(SystemMemory *mem, const Instruction *ops, int op_index) {
+    long first = (long) mem->curr_index + ops[op_index].offset;
+    long last = (long) mem->curr_index + ops[op_index].arg;
+    if (first < 0 || last > mem->tape_size - 1) {
+        return ops[op_index].jump + 1;
+    }
+    return op_index + 1;
+}
+
+/*
+ * Executes the compiled instruction at op_index. Returns the index of the next
  * instruction to execute.
  */
-int execute_instruction(SystemMemory *mem, char *instructions,
-                         int instruction_index, Stack *stack) {
-    char instruction = instructions[instruction_index];
-    int next_instruction_index = instruction_index + 1;
-    switch(instruction) {
-        case '<':
-            move_memory_pointer_left(mem);
-            break;
-        case '>':
-            move_memory_pointer_right(mem);
+int execute_instruction(SystemMemory *mem, const Program *program,
+                        int op_index) {
+    const Instruction *op = &program->ops[op_index];
+    switch(op->code) {
+        case OP_ADD:
+            add_to_memory_cell_at_offset(mem, op->offset, op->arg);
             break;
-        case '+':
-            increment_memory_cell_value(mem);
+        case OP_MOVE:
+            move_memory_pointer(mem, op->arg);
             break;
-        case '-':
-            decrement_memory_cell_value(mem);
+        case OP_MOVE_UNCHECKED:
+            mem->curr_index += op->arg;
             break;
-        case '.':
+        case OP_OUTPUT:
             output_current_cell_value(mem);
             break;
-        case ',':
+        case OP_INPUT:
             store_input_char_in_current_cell(mem);
             break;
-        case '[':
-            next_instruction_index = conditional_loop_entry(mem, instructions,
-                                                       instruction_index, stack);
-            if (next_instruction_index == -1) {
-                exit(EXIT_FAILURE);
-            }
-            break;
-        case ']':
-            next_instruction_index = conditional_continue(mem, instruction_index, stack);
-            if (next_instruction_index == -1) {
-                exit(EXIT_FAILURE);
-            }
-            break;
-        // the language ignores all other characters
+        case OP_JUMP_IF_ZERO:
+            return conditional_loop_entry(mem, program->ops, op_index);
+        case OP_JUMP_IF_NOT_ZERO:
+            return conditional_continue(mem, program->ops, op_index);
+        case OP_SET_ZERO:
+            return set_zero_loop(mem, program->ops, op_index);
+        case OP_SCAN:
+            return scan_loop(mem, program->ops, op_index);
+        case OP_MULTIPLY_LOOP:
+            return multiply_loop(mem, program, op_index);
+        case OP_CLEAR_RANGE:
+            return clear_range_loop(mem, program->ops, op_index);
+        case OP_CHECK_RANGE:
+            return check_range(mem, program->ops, op_index);
+        case OP_JUMP:
+            return op->jump + 1;
+    }
+    return op_index + 1;
+}
+
+/*
+ * Executes a compiled program using the provided SystemMemory. Returns 0.
+ */
+int execute_program(const Program *program, SystemMemory *mem) {
+    int curr_op_index = 0;
+    while (curr_op_index < program->num_ops) {
+        curr_op_index = execute_instruction(mem, program, curr_op_index);
+    }
+    return 0;
+}
+
+/*
+ * Returns 1 if a "," would have to wait for input that has not arrived yet.
+ */
+static int input_pending(const SystemMemory *mem) {
+    return mem->io != NULL && mem->io->input_open
+           && mem->io->input_position == mem->io->input_length;
+}
+
+/*
+ * Executes a compiled program using the provided SystemMemory, from the
+ * instruction at *op_index, until it ends or *fuel runs out. A unit of fuel is
+ * used each time a loop's "]" jumps back to the start of the loop, the only
+ * jump backwards, so the rest of the code costs nothing to count. Dispatches
+ * with one indirect jump per instruction instead of a call to
+ * execute_instruction() and a switch: every instruction is translated into
+ * the address of the code that executes it (direct threading), which relies
+ * on the GCC labels-as-values extension. The translation is made on the first
+ * run and kept in the program, so a program continued turn after turn (see
+ * execute_program_with_fuel()) costs nothing per turn but its work. Other
+ * compilers single-step with execute_instruction(). Returns 0 when the program
+ * ends, PROGRAM_YIELDED when the fuel is used up, or PROGRAM_WAITING at a ","
+ * with no input yet on a tape whose input is still open; then the index of the
+ * instruction to continue from is in *op_index and the fuel left in *fuel.
+ */
+static int run_threaded(const Program *program, SystemMemory *mem, int *op_index,
+                        long *fuel) {
+    long fuel_left = *fuel;
+    int pc = *op_index;
+    int next;
+#ifdef __GNUC__
+    static void *op_labels[] = {
+        [OP_ADD] = &&op_add,
+        [OP_MOVE] = &&op_move,
+        [OP_OUTPUT] = &&op_output,
+        [OP_INPUT] = &&op_input,
+        [OP_JUMP_IF_ZERO] = &&op_jump_if_zero,
+        [OP_JUMP_IF_NOT_ZERO] = &&op_jump_if_not_zero,
+        [OP_SET_ZERO] = &&op_set_zero,
+        [OP_SCAN] = &&op_scan,
+        [OP_MULTIPLY_LOOP] = &&op_multiply_loop,
+        [OP_CLEAR_RANGE] = &&op_clear_range,
+        [OP_MOVE_UNCHECKED] = &&op_move_unchecked,
+        [OP_CHECK_RANGE] = &&op_check_range,
+        [OP_JUMP] = &&op_jump
+    };
+    int i;
+    const Instruction *ops = program->ops;
+    void **code = __atomic_load_n(&program->threaded_code, __ATOMIC_ACQUIRE);
+    if (code == NULL) {
+        void **translated = malloc(sizeof(void *) * (program->num_ops + 1));
+        for (i = 0; i < program->num_ops; i++) {
+            translated[i] = op_labels[ops[i].code];
+        }
+        translated[program->num_ops] = &&done;
+        // threads running the program at once may all translate it; one wins
+        code = NULL;
+        if (__atomic_compare_exchange_n(&((Program *) program)->threaded_code, &code,
+                                        translated, 0, __ATOMIC_ACQ_REL,
+                                        __ATOMIC_ACQUIRE)) {
+            code = translated;
+        } else {
+            free(translated);
+        }
+    }
+    goto *code[pc];
+
+op_add:
+    add_to_memory_cell_at_offset(mem, ops[pc].offset, ops[pc].arg);
+    goto *code[++pc];
+op_move:
+    move_memory_pointer(mem, ops[pc].arg);
+    goto *code[++pc];
+op_move_unchecked:
+    mem->curr_index += ops[pc].arg;
+    goto *code[++pc];
+op_output:
+    output_current_cell_value(mem);
+    goto *code[++pc];
+op_input:
+    if (input_pending(mem)) {
+        goto wait;
+    }
+    store_input_char_in_current_cell(mem);
+    goto *code[++pc];
+op_jump_if_zero:
+    pc = conditional_loop_entry(mem, ops, pc);
+    goto *code[pc];
+op_jump_if_not_zero:
+    next = conditional_continue(mem, ops, pc);
+    if (next <= pc && --fuel_left <= 0) {
+        pc = next;
+        goto yield;
     }
-    return next_instruction_index;
+    pc = next;
+    goto *code[pc];
+op_set_zero:
+    pc = set_zero_loop(mem, ops, pc);
+    goto *code[pc];
+op_scan:
+    pc = scan_loop(mem, ops, pc);
+    goto *code[pc];
+op_multiply_loop:
+    pc = multiply_loop(mem, program, pc);
+    goto *code[pc];
+op_clear_range:
+    pc = clear_range_loop(mem, ops, pc);
+    goto *code[pc];
+op_check_range:
+    pc = check_range(mem, ops, pc);
+    goto *code[pc];
+op_jump:
+    pc = ops[pc].jump + 1;
+    goto *code[pc];
+yield:
+    *op_index = pc;
+    *fuel = 0;
+    return PROGRAM_YIELDED;
+wait:
+    *op_index = pc;
+    *fuel = fuel_left;
+    return PROGRAM_WAITING;
+done:
+#else
+    while (pc < program->num_ops) {
+        if (program->ops[pc].code == OP_INPUT && input_pending(mem)) {
+            *op_index = pc;
+            *fuel = fuel_left;
+            return PROGRAM_WAITING;
+        }
+        next = execute_instruction(mem, program, pc);
+        if (next <= pc && --fuel_left <= 0) {
+            *op_index = next;
+            *fuel = 0;
+            return PROGRAM_YIELDED;
+        }
+        pc = next;
+    }
+#endif
+    *op_index = pc;
+    *fuel = fuel_left;
+    return 0;
+}
+
+/*
+ * Executes a compiled program like execute_program_threaded(), but from the
+ * instruction at *op_index and only until *fuel runs out (see run_threaded()),
+ * so that a scheduler can stop it and continue it later. Returns 0 when the
+ * program ends, or PROGRAM_YIELDED or PROGRAM_WAITING (for input) with the
+ * instruction to continue from in *op_index.
+ */
+int execute_program_with_fuel(const Program *program, SystemMemory *mem,
+                              int *op_index, long *fuel) {
+    return run_threaded(program, mem, op_index, fuel);
+}
+
+/*
+ * Executes a compiled program using the provided SystemMemory with direct
+ * threading (see run_threaded()). Returns 0.
+ */
+int execute_program_threaded(const Program *program, SystemMemory *mem) {
+    int op_index = 0;
+    long fuel = LONG_MAX;
+    return run_threaded(program, mem, &op_index, &fuel);
+}
+
+/*
+ * Returns the execution engine with the given name ("switch", "threaded",
+ * "jit" or "tiered"), or NULL if there is no such engine.
+ */
+Engine find_engine(const char *name) {
+    if (strcmp(name, "switch") == 0) {
+        return execute_program;
+    }
+    if (strcmp(name, "threaded") == 0) {
+        return execute_program_threaded;
+    }
+    if (strcmp(name, "jit") == 0) {
+        return execute_program_jit;
+    }
+    if (strcmp(name, "tiered") == 0) {
+        return execute_program_tiered;
+    }
+    return NULL;
 }
 
 /*
- * Executes Brainf**k source code stored in the provided instructions using the
- * provided SystemMemory.
+ * Runs the optimization passes that suit running the program on mem: all of
+ * them, the blank-tape specialization if nothing has used the tape yet, and
+ * unchecked moves on a virtual tape. The specialization assumes the pointer
+ * sticks at the edges, so it is not used on a virtual tape, where a loop
+ * starting off the tape must stop the program instead of being removed. The
+ * tape no longer counts as blank afterwards, since the program is about to
+ * use it.
  */
-void execute_code(char *instructions, SystemMemory *mem) {
-    int curr_instruction_index = 0;
-    int num_instructions = strlen(instructions);
-    Stack *left_bracket_stack = new_stack(); // stores the indices of left brackets in
-                                             // the instructions array to support looping
-    while (curr_instruction_index < num_instructions) {
-        curr_instruction_index = execute_instruction(mem, instructions, 
-                                    curr_instruction_index, left_bracket_stack);
+void optimize_for_memory(Program *program, SystemMemory *mem) {
+    optimize_program(program);
+    if (mem->blank && mem->guard_size == 0) {
+        specialize_for_blank_tape(program, mem->tape_size);
     }
-    stack_free(left_bracket_stack);
+    mem->blank = 0;
+    if (mem->guard_size > 0) {
+        use_unchecked_moves(program, mem->guard_size / mem->cell_size);
+    }
+}
+
+/*
+ * Executes the num_instructions characters of Brainf**k source code stored in
+ * the provided instructions (which need not be NUL-terminated) using the
+ * provided SystemMemory and execution engine. The source is compiled and
+ * optimized before execution starts. Returns 0 on success, or -1 if the
+ * brackets are unbalanced (without executing anything) or the engine stopped
+ * the program with an error.
+ */
+int execute_code_with_engine(const char *instructions, long num_instructions,
+                             SystemMemory *mem, Engine engine) {
+    Program *program = compile_program(instructions, num_instructions);
+    if (program == NULL) {
+        return -1;
+    }
+    optimize_for_memory(program, mem);
+    int status = engine(program, mem);
+    io_flush();
+    free_program(program);
+    return status;
+}
+
+/*
+ * Executes the NUL-terminated Brainf**k source code stored in the provided
+ * instructions using the provided SystemMemory. Returns 0 on success, or -1
+ * (without executing anything) if the brackets are unbalanced.
+ */
+int execute_code(const char *instructions, SystemMemory *mem) {
+    return execute_code_with_engine(instructions, strlen(instructions), mem,
+                                    execute_program);
 }
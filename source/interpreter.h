@@ -1,4 +1,5 @@
-#include "stack.h"
+#include "optimizer.h"
+#include "io.h"
 
 #ifndef INTERPRETER_HEADER
 #define INTERPRETER_HEADER
@@ -7,10 +8,31 @@ typedef struct {
     char *tape;
     int tape_size;
     int curr_index;
+    int guard_size; // bytes of guard pages around a virtual tape, otherwise 0
+    int cell_size;  // bytes per cell: 1 unless the tape is for wider cells
+    IoBuffers *io;  // where "." and "," go; NULL for stdout and stdin
+    int blank;      // 1 while the tape is all zeroes with the pointer at 0
 } SystemMemory;
 
+// an execution engine: runs a compiled program to completion, returning 0, or
+// -1 if the program stopped with an error
+typedef int (*Engine)(const Program *program, SystemMemory *mem);
+
+// runs the instruction at op_index, returning the index of the next one to run,
+// or -1 if the program stopped with an error
+typedef int (*Stepper)(SystemMemory *mem, const Program *program, int op_index);
+
+#define PROGRAM_YIELDED 1 // execute_program_with_fuel() ran out of fuel
+#define PROGRAM_WAITING 2 // execute_program_with_fuel() stopped at a "," to wait for input
+
+extern const int NUM_MEMORY_CELLS;
+
 SystemMemory *initialize_memory();
 
+SystemMemory *initialize_memory_with_size(int num_tape_cells);
+
+SystemMemory *initialize_memory_with_cells(int num_tape_cells, int cell_size);
+
 void free_mem(SystemMemory *mem);
 
 int move_memory_pointer_left(SystemMemory *mem);
@@ -21,19 +43,49 @@ int increment_memory_cell_value(SystemMemory *mem);
 
 int decrement_memory_cell_value(SystemMemory *mem);
 
+int add_to_memory_cell_value(SystemMemory *mem, int amount);
+
+int add_to_memory_cell_at_offset(SystemMemory *mem, int offset, int amount);
+
+int move_memory_pointer(SystemMemory *mem, int distance);
+
 int output_current_cell_value(SystemMemory *mem);
 
 int store_input_char_in_current_cell(SystemMemory *mem);
 
-int conditional_loop_entry(SystemMemory *mem, char *instructions,
-                           int instruction_index, Stack *stack);
+int conditional_loop_entry(SystemMemory *mem, const Instruction *ops,
+                           int op_index);
+
+int conditional_continue(SystemMemory *mem, const Instruction *ops,
+                         int op_index);
+
+int set_zero_loop(SystemMemory *mem, const Instruction *ops, int op_index);
+
+int scan_loop(SystemMemory *mem, const Instruction *ops, int op_index);
+
+int clear_range_loop(SystemMemory *mem, const Instruction *ops, int op_index);
+
+int multiply_loop(SystemMemory *mem, const Program *program, int op_index);
+
+int check_range(SystemMemory *mem, const Instruction *ops, int op_index);
+
+int execute_instruction(SystemMemory *mem, const Program *program,
+                        int op_index);
+
+int execute_program(const Program *program, SystemMemory *mem);
+
+int execute_program_with_fuel(const Program *program, SystemMemory *mem,
+                              int *op_index, long *fuel);
+
+int execute_program_threaded(const Program *program, SystemMemory *mem);
+
+Engine find_engine(const char *name);
 
-int conditional_continue(SystemMemory *mem, int instruction_index,
-                         Stack *stack);
+void optimize_for_memory(Program *program, SystemMemory *mem);
 
-void execute_code(char *instructions, SystemMemory *mem);
+int execute_code_with_engine(const char *instructions, long num_instructions,
+                             SystemMemory *mem, Engine engine);
 
-int execute_instruction(SystemMemory *mem, char *instructions,
-                         int instruction_index, Stack *stack);
+int execute_code(const char *instructions, SystemMemory *mem);
 
 #endif
\ No newline at end of file
@@ -2,10 +2,30 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
 
 #include "CUnit/Basic.h"
 #include "interpreter.h"
 #include "stack.h"
+#include "tape_kernels.h"
+#include "jit.h"
+#include "translator.h"
+#include "io.h"
+#include "source_file.h"
+#include "virtual_tape.h"
+#include "cell_models.h"
+#include "bf.h"
+#include "batch.h"
+#include "program_cache.h"
+#include "profiler.h"
+#include "partial_evaluator.h"
+#include "checkpoint.h"
+#include "scheduler.h"
+#include "compiled_file.h"
+#include "perf_counters.h"
 
 int init_suite(void) {
    return 0;
@@ -21,6 +41,10 @@ SystemMemory *create_test_memory(int num_tape_cells, int start_index) {
     mem->tape_size = num_tape_cells;
     mem->curr_index = start_index;
     mem->tape = tape;
+    mem->guard_size = 0;
+    mem->cell_size = 1;
+    mem->io = NULL;
+    mem->blank = 0;
     return mem;
 }
 
@@ -45,6 +69,61 @@ static void test_initialize_memory_has_blank_tape(void) {
     free_mem(mem);
 }
 
+static void test_initialize_memory_with_size(void) {
+    SystemMemory *mem = initialize_memory_with_size(1000000);
+    CU_ASSERT_EQUAL(1000000, mem->tape_size);
+    CU_ASSERT_EQUAL(0, mem->tape[0]);
+    CU_ASSERT_EQUAL(0, mem->tape[999999]);
+    free_mem(mem);
+}
+
+static void test_initialize_virtual_memory(void) {
+    SystemMemory *mem = initialize_virtual_memory(DEFAULT_VIRTUAL_TAPE_SIZE, 1);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(mem);
+    CU_ASSERT_EQUAL(DEFAULT_VIRTUAL_TAPE_SIZE, mem->tape_size);
+    CU_ASSERT_EQUAL(0, mem->curr_index);
+    CU_ASSERT_EQUAL(0, mem->tape[DEFAULT_VIRTUAL_TAPE_SIZE - 1]);
+    mem->tape[DEFAULT_VIRTUAL_TAPE_SIZE - 1] = 5;
+    CU_ASSERT_EQUAL(5, mem->tape[DEFAULT_VIRTUAL_TAPE_SIZE - 1]);
+    free_mem(mem);
+}
+
+/*
+ * Runs code on a virtual tape of tape_size cells in a child process, since an
+ * overrun ends the process. Returns 1 if the run stopped with the overrun error.
+ */
+static int runs_off_virtual_tape(const char *code, int tape_size) {
+    int status;
+    pid_t child = fork();
+    if (child == 0) {
+        SystemMemory *mem = initialize_virtual_memory(tape_size, 1);
+        execute_code_with_engine(code, strlen(code), mem, execute_program);
+        _exit(0);
+    }
+    waitpid(child, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == EXIT_FAILURE;
+}
+
+static void test_virtual_tape_ends_at_guard_regions(void) {
+    long page_size = sysconf(_SC_PAGESIZE);
+    char *code = malloc(page_size + 2);
+    SystemMemory *mem = initialize_virtual_memory(100, 1);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(mem);
+    CU_ASSERT_EQUAL(page_size, mem->tape_size);
+    free_mem(mem);
+    mem = initialize_virtual_memory(100, 4);
+    CU_ASSERT_EQUAL(page_size / 4, mem->tape_size);
+    free_mem(mem);
+    // the last cell of the rounded tape is usable, the one after it is not
+    memset(code, '>', page_size - 1);
+    strcpy(code + page_size - 1, "+");
+    CU_ASSERT_FALSE(runs_off_virtual_tape(code, 100));
+    strcpy(code + page_size - 1, ">+");
+    CU_ASSERT_TRUE(runs_off_virtual_tape(code, 100));
+    CU_ASSERT_TRUE(runs_off_virtual_tape("<+", 100));
+    free(code);
+}
+
 static void test_move_memory_pointer_left(void) {
     SystemMemory *mem = create_test_memory(100, 1);
     int res = move_memory_pointer_left(mem);
@@ -121,131 +200,1155 @@ static void test_output_current_cell_value(void) {
     free_mem(mem);
 }
 
+static void test_add_to_memory_cell_value(void) {
+    SystemMemory *mem = create_test_memory(100, 0);
+    mem->tape[mem->curr_index] = 10;
+    int res = add_to_memory_cell_value(mem, 5);
+    CU_ASSERT_EQUAL(15, mem->tape[mem->curr_index]);
+    CU_ASSERT_EQUAL(15, res);
+    res = add_to_memory_cell_value(mem, -4);
+    CU_ASSERT_EQUAL(11, res);
+    free_mem(mem);
+}
+
+static void test_add_to_memory_cell_value_saturates(void) {
+    SystemMemory *mem = create_test_memory(100, 0);
+    mem->tape[mem->curr_index] = 120;
+    CU_ASSERT_EQUAL(127, add_to_memory_cell_value(mem, 50));
+    CU_ASSERT_EQUAL(0, add_to_memory_cell_value(mem, -500));
+    mem->tape[mem->curr_index] = -1; // e.g. EOF: decrementing has no effect
+    CU_ASSERT_EQUAL(-1, add_to_memory_cell_value(mem, -3));
+    CU_ASSERT_EQUAL(2, add_to_memory_cell_value(mem, 3));
+    free_mem(mem);
+}
+
+static void test_move_memory_pointer_sticks_at_edges(void) {
+    SystemMemory *mem = create_test_memory(100, 50);
+    CU_ASSERT_EQUAL(53, move_memory_pointer(mem, 3));
+    CU_ASSERT_EQUAL(99, move_memory_pointer(mem, 1000));
+    CU_ASSERT_EQUAL(0, move_memory_pointer(mem, -1000));
+    CU_ASSERT_EQUAL(0, mem->curr_index);
+    free_mem(mem);
+}
+
+static void test_compile_program_folds_runs() {
+    Program *program = compile_program("+++ comment -->>><.,", 20);
+    CU_ASSERT_PTR_NOT_NULL(program);
+    CU_ASSERT_EQUAL(6, program->num_ops);
+    CU_ASSERT_EQUAL(OP_ADD, program->ops[0].code);
+    CU_ASSERT_EQUAL(3, program->ops[0].arg);
+    CU_ASSERT_EQUAL(OP_ADD, program->ops[1].code);
+    CU_ASSERT_EQUAL(-2, program->ops[1].arg);
+    CU_ASSERT_EQUAL(OP_MOVE, program->ops[2].code);
+    CU_ASSERT_EQUAL(3, program->ops[2].arg);
+    // a change of direction is not folded: the pointer may stick at an edge
+    CU_ASSERT_EQUAL(OP_MOVE, program->ops[3].code);
+    CU_ASSERT_EQUAL(-1, program->ops[3].arg);
+    CU_ASSERT_EQUAL(OP_OUTPUT, program->ops[4].code);
+    CU_ASSERT_EQUAL(OP_INPUT, program->ops[5].code);
+    free_program(program);
+}
+
+static void test_compile_program_matches_brackets() {
+    Program *program = compile_program("+[>-[++]-]", 10);
+    CU_ASSERT_PTR_NOT_NULL(program);
+    CU_ASSERT_EQUAL(OP_JUMP_IF_ZERO, program->ops[1].code);
+    CU_ASSERT_EQUAL(8, program->ops[1].jump); // outer left bracket -> outer right bracket
+    CU_ASSERT_EQUAL(OP_JUMP_IF_NOT_ZERO, program->ops[8].code);
+    CU_ASSERT_EQUAL(1, program->ops[8].jump);
+    CU_ASSERT_EQUAL(6, program->ops[4].jump); // inner left bracket -> inner right bracket
+    CU_ASSERT_EQUAL(4, program->ops[6].jump);
+    free_program(program);
+}
+
+static void test_compile_program_no_matching_right_bracket() {
+    // the second left bracket nullifies the right bracket
+    CU_ASSERT_PTR_NULL(compile_program("[>-[+]-", 7));
+}
+
+static void test_compile_program_no_matching_left_bracket() {
+    CU_ASSERT_PTR_NULL(compile_program("[+]]", 4));
+}
+
 static void test_conditional_loop_entry_enter_loop() {
     SystemMemory *mem = create_test_memory(100, 0);
     mem->tape[mem->curr_index] = 27; // non-zero memory value
-    char *instruction_snippet = "[>-[++-";
+    Program *program = compile_program("[>-[+]-]", 8);
     int left_bracket_index = 3; // instruction pointer starts at second bracket
-    Stack *left_bracket_stack = new_stack();
-    stack_push(left_bracket_stack, 0); // give stack one value
-    int next_instr_index = conditional_loop_entry(mem, instruction_snippet,
-                                        left_bracket_index, left_bracket_stack);
+    int next_instr_index = conditional_loop_entry(mem, program->ops, left_bracket_index);
     // validate returned instruction index is right after the left bracket
     // (we enter the loop)
     CU_ASSERT_EQUAL(4, next_instr_index);
-    // validate stack contents
-    CU_ASSERT_EQUAL(2, stack_size(left_bracket_stack));
-    CU_ASSERT_EQUAL(3, stack_peek(left_bracket_stack)); // index of left bracket
     free_mem(mem);
-    stack_free(left_bracket_stack);
+    free_program(program);
 }
 
-static void test_conditional_loop_entry_skip_loop_no_matching_right_bracket() {
+static void test_conditional_loop_entry_skip_loop() {
     SystemMemory *mem = create_test_memory(100, 0);
     mem->tape[mem->curr_index] = 0; // zero memory value
-    char *instruction_snippet = "[>-[++-";
-    int left_bracket_index = 3; // instruction pointer starts at second bracket
-    Stack *left_bracket_stack = new_stack();
-    stack_push(left_bracket_stack, 0); // give stack one value
-    int next_instr_index = conditional_loop_entry(mem, instruction_snippet,
-                                        left_bracket_index, left_bracket_stack);
-    // validate returned instruction index is -1: no matching right bracket
-    CU_ASSERT_EQUAL(-1, next_instr_index);
-    // validate stack was not changed
-    CU_ASSERT_EQUAL(1, stack_size(left_bracket_stack));
+    Program *program = compile_program("[>-[+]-]", 8);
+    int left_bracket_index = 3; // instruction pointer starts at second left bracket
+    int next_instr_index = conditional_loop_entry(mem, program->ops, left_bracket_index);
+    // validate returned instruction index follows right bracket
+    // (we skip over the loop)
+    CU_ASSERT_EQUAL(6, next_instr_index);
     free_mem(mem);
-    stack_free(left_bracket_stack);
+    free_program(program);
 }
 
-static void test_conditional_loop_entry_skip_loop_has_matching_right_bracket() {
+static void test_conditional_loop_entry_nested_loop_skip() {
     SystemMemory *mem = create_test_memory(100, 0);
     mem->tape[mem->curr_index] = 0; // zero memory value
-    char *instruction_snippet = "[>-[++]-";
-    int left_bracket_index = 3; // instruction pointer starts at second left bracket
-    Stack *left_bracket_stack = new_stack();
-    stack_push(left_bracket_stack, 0); // give stack one value
-    int next_instr_index = conditional_loop_entry(mem, instruction_snippet,
-                                        left_bracket_index, left_bracket_stack);
-    // validate returned instruction index follows right bracket
-    // (we skip over the loop)
+    Program *program = compile_program("[>-[+]]-", 8);
+    int left_bracket_index = 0; // instruction pointer starts at first left bracket
+    int next_instr_index = conditional_loop_entry(mem, program->ops, left_bracket_index);
+    // validate returned instruction index follows second right bracket
+    // (we skip over the loop and its internal nested loop)
     CU_ASSERT_EQUAL(7, next_instr_index);
-    // validate stack was not changed
-    CU_ASSERT_EQUAL(1, stack_size(left_bracket_stack));
     free_mem(mem);
-    stack_free(left_bracket_stack);
+    free_program(program);
 }
 
-static void test_conditional_loop_entry_nested_loop_skip_no_matching_right_bracket() {
+static void test_conditional_continue_restart_loop() {
     SystemMemory *mem = create_test_memory(100, 0);
-    mem->tape[mem->curr_index] = 0; // zero memory value
-    char *instruction_snippet = "[>-[+]-"; // the second left bracket nullifies the right bracket
-    int left_bracket_index = 0; // instruction pointer at first left bracket
-    Stack *left_bracket_stack = new_stack();
-    int next_instr_index = conditional_loop_entry(mem, instruction_snippet,
-                                        left_bracket_index, left_bracket_stack);
-    // validate returned instruction index is -1: no matching right bracket
-    CU_ASSERT_EQUAL(-1, next_instr_index);
+    mem->tape[mem->curr_index] = 1; // non-zero memory value
+    Program *program = compile_program("+++[>+<-]", 9);
+    int next_instr_index = conditional_continue(mem, program->ops, 6);
+    CU_ASSERT_EQUAL(2, next_instr_index); // next instruction index is after left bracket
     free_mem(mem);
-    stack_free(left_bracket_stack);
+    free_program(program);
 }
 
-static void test_conditional_loop_entry_nested_loop_skip_has_matching_right_bracket() {
+static void test_conditional_continue_end_loop() {
     SystemMemory *mem = create_test_memory(100, 0);
-    mem->tape[mem->curr_index] = 0; // zero memory value
-    char *instruction_snippet = "[>-[++]]-";
-    int left_bracket_index = 0; // instruction pointer starts at first left bracket
-    Stack *left_bracket_stack = new_stack();
-    int next_instr_index = conditional_loop_entry(mem, instruction_snippet,
-                                        left_bracket_index, left_bracket_stack);
-    // validate returned instruction index follows second right bracket
-    // (we skip over the loop and its internal nested loop)
-    CU_ASSERT_EQUAL(8, next_instr_index);
+    mem->tape[mem->curr_index] = 0; // zero memory value--end the loop
+    Program *program = compile_program("+++[>+<-]", 9);
+    int next_instr_index = conditional_continue(mem, program->ops, 6);
+    CU_ASSERT_EQUAL(7, next_instr_index); // next instruction index is after current
     free_mem(mem);
-    stack_free(left_bracket_stack);
+    free_program(program);
 }
 
-static void test_conditional_continue_restart_loop_no_matching_left_bracket() {
+static void test_execute_code_unmatched_bracket_runs_nothing() {
     SystemMemory *mem = create_test_memory(100, 0);
-    mem->tape[mem->curr_index] = 1; // non-zero memory value
-    Stack *left_bracket_stack = new_stack(); // empty stack
-    int next_instr_index = conditional_continue(mem, 0 ,left_bracket_stack);
-    CU_ASSERT_EQUAL(-1, next_instr_index);
+    mem->tape[0] = 0;
+    CU_ASSERT_EQUAL(-1, execute_code("+++[", mem));
+    CU_ASSERT_EQUAL(0, mem->tape[0]); // nothing was executed
     free_mem(mem);
-    stack_free(left_bracket_stack);
 }
 
-static void test_conditional_continue_restart_loop_has_matching_left_bracket() {
+static void test_execute_code_keeps_saturating_semantics() {
     SystemMemory *mem = create_test_memory(100, 0);
-    mem->tape[mem->curr_index] = 1; // non-zero memory value
-    Stack *left_bracket_stack = new_stack();
-    stack_push(left_bracket_stack, 3); // left bracket at instruction 3
-    int next_instr_index = conditional_continue(mem, 17, left_bracket_stack);
-    CU_ASSERT_EQUAL(4, next_instr_index); // next instruction index is after left bracket
-    CU_ASSERT_EQUAL(1, stack_size(left_bracket_stack)); // stack should be unchanged
+    memset(mem->tape, 0, 100);
+    // 130 increments stop at 127; the pointer sticks at the left edge
+    CU_ASSERT_EQUAL(0, execute_code("++++++++++[>+++++++++++++<-]>< <<<<<+", mem));
+    CU_ASSERT_EQUAL(1, mem->tape[0]);
+    CU_ASSERT_EQUAL(127, mem->tape[1]);
+    CU_ASSERT_EQUAL(0, mem->curr_index);
+    free_mem(mem);
+}
+
+static void test_engines_leave_identical_memory() {
+    const char *code = "++++++++[>++++[>++>+++>+++>+<<<<-]>+>+>->>+[<]<-]"
+                       ">[[-]>]<<<<[->>+<<]+++[>>>>>>+<<<<<<-]>>>>>>[<]";
+    Engine engines[] = {execute_program_threaded, execute_program_jit, execute_program_tiered};
+    int i;
+    SystemMemory *expected = create_test_memory(100, 0);
+    memset(expected->tape, 0, 100);
+    CU_ASSERT_EQUAL(0, execute_code_with_engine(code, strlen(code), expected, execute_program));
+    for (i = 0; i < 3; i++) {
+        SystemMemory *mem = create_test_memory(100, 0);
+        memset(mem->tape, 0, 100);
+        CU_ASSERT_EQUAL(0, execute_code_with_engine(code, strlen(code), mem, engines[i]));
+        CU_ASSERT_EQUAL(expected->curr_index, mem->curr_index);
+        CU_ASSERT_EQUAL(0, memcmp(expected->tape, mem->tape, 100));
+        free_mem(mem);
+    }
+    free_mem(expected);
+}
+
+static void test_execute_program_with_fuel_in_turns() {
+    const char *code = "+++++[>+>[-]<<-]";
+    SystemMemory *mem = create_test_memory(10, 0);
+    memset(mem->tape, 0, 10);
+    Program *program = compile_program(code, strlen(code));
+    optimize_program(program);
+    int op_index = 0;
+    long fuel = 1;
+    int turns = 1;
+    CU_ASSERT_EQUAL(PROGRAM_YIELDED, execute_program_with_fuel(program, mem, &op_index, &fuel));
+    void **threaded_code = program->threaded_code;
+    CU_ASSERT_PTR_NOT_NULL(threaded_code);
+    do {
+        fuel = 1;
+        turns++;
+    } while (execute_program_with_fuel(program, mem, &op_index, &fuel) == PROGRAM_YIELDED);
+    CU_ASSERT_EQUAL(5, turns); // four jumps back, then the end
+    CU_ASSERT_EQUAL(5, mem->tape[1]);
+    CU_ASSERT_PTR_EQUAL(threaded_code, program->threaded_code); // translated once
+    free_program(program);
+    free_mem(mem);
+}
+
+static void test_tiered_engine_compiles_hot_loops() {
+    // the innermost loop jumps back more than TIER_UP_ITERATIONS times in all,
+    // so it is compiled partway through and entered compiled afterwards
+    const char *code = "++++++++++++++[>++++++++++++++[>++++++++++++++[-->+<]<-]<-]"
+                       ">>>[>+>++<<-]>>>>>>>>>>+";
+    SystemMemory *expected = create_test_memory(12, 0);
+    SystemMemory *mem = create_test_memory(12, 0);
+    memset(expected->tape, 0, 12);
+    memset(mem->tape, 0, 12);
+    CU_ASSERT_EQUAL(0, execute_code_with_engine(code, strlen(code), expected, execute_program));
+    CU_ASSERT_EQUAL(0, execute_code_with_engine(code, strlen(code), mem, execute_program_tiered));
+    CU_ASSERT_EQUAL(127, mem->tape[4]);
+    CU_ASSERT_EQUAL(expected->curr_index, mem->curr_index);
+    CU_ASSERT_EQUAL(0, memcmp(expected->tape, mem->tape, 12));
+    free_mem(expected);
+    free_mem(mem);
+}
+
+static int jit_test_output_count = 0;
+
+static int count_output(SystemMemory *mem) {
+    jit_test_output_count += mem->tape[mem->curr_index];
+    return mem->tape[mem->curr_index];
+}
+
+static int read_seven(SystemMemory *mem) {
+    mem->tape[mem->curr_index] = 7;
+    return 7;
+}
+
+static void test_jit_calls_io_callbacks() {
+    SystemMemory *mem = create_test_memory(10, 9);
+    memset(mem->tape, 0, 10);
+    Program *program = compile_program(",.>>+++.<<<<.", 13);
+    JitCode *jit_code = jit_compile(program, count_output, read_seven);
+    if (jit_code == NULL) { // no JIT on this host
+        free_program(program);
+        free_mem(mem);
+        return;
+    }
+    jit_run(jit_code, mem);
+    // the pointer sticks at the right edge, so "+++" lands on the input cell
+    CU_ASSERT_EQUAL(7 + 10 + 0, jit_test_output_count);
+    CU_ASSERT_EQUAL(5, mem->curr_index);
+    jit_free(jit_code);
+    free_program(program);
+    free_mem(mem);
+}
+
+static void test_find_engine() {
+    CU_ASSERT_PTR_EQUAL(execute_program, find_engine("switch"));
+    CU_ASSERT_PTR_EQUAL(execute_program_threaded, find_engine("threaded"));
+    CU_ASSERT_PTR_EQUAL(execute_program_jit, find_engine("jit"));
+    CU_ASSERT_PTR_EQUAL(execute_program_tiered, find_engine("tiered"));
+    CU_ASSERT_PTR_NULL(find_engine("nonexistent"));
+}
+
+static void test_translate_to_c() {
+    char *c_source = NULL;
+    size_t c_size = 0;
+    FILE *out = open_memstream(&c_source, &c_size);
+    Program *program = compile_program("+++[>+<-]>.[-]", 14);
+    optimize_program(program);
+    translate_to_c(program, NULL, 500, out);
+    fclose(out);
+    CU_ASSERT_PTR_NOT_NULL(strstr(c_source, "mem.tape_size = 500;"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(c_source, "add(0, 3);"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(c_source, "add(1, (long) CELL * 1);"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(c_source, "putchar(CELL);"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(c_source, "if (CELL > 0) CELL = 0;"));
+    free(c_source);
+    free_program(program);
+}
+
+static void test_hash_source() {
+    CU_ASSERT_EQUAL(hash_source("+.", 2), hash_source("+.", 2));
+    CU_ASSERT_NOT_EQUAL(hash_source("+.", 2), hash_source(".+", 2));
+}
+
+static void test_parse_flush_policy() {
+    FlushPolicy policy = FLUSH_AUTO;
+    CU_ASSERT_EQUAL(0, parse_flush_policy("line", &policy));
+    CU_ASSERT_EQUAL(FLUSH_LINE, policy);
+    CU_ASSERT_EQUAL(0, parse_flush_policy("full", &policy));
+    CU_ASSERT_EQUAL(FLUSH_FULL, policy);
+    CU_ASSERT_EQUAL(-1, parse_flush_policy("sometimes", &policy));
+    CU_ASSERT_EQUAL(FLUSH_FULL, policy);
+}
+
+static void test_virtual_tape_overrun_in_skipped_loop() {
+    // on a blank tape "[-]" never runs, but off a virtual tape it must fault
+    CU_ASSERT_TRUE(runs_off_virtual_tape("<<[-]", 100));
+    CU_ASSERT_TRUE(runs_off_virtual_tape("+<[>+<-]", 100));
+    CU_ASSERT_FALSE(runs_off_virtual_tape("<<", 100)); // nothing read or written
+}
+
+static void test_engines_on_virtual_tape() {
+    const char *code = "++++++++[>++++[>++>+++>+++>+<<<<-]>+>+>->>+[<]<-]"
+                       ">[[-]>]>>>>[->>+<<]+++[>>>>>>+<<<<<<-]>>>>>>";
+    Engine engines[] = {execute_program, execute_program_threaded, execute_program_jit,
+                        execute_program_tiered};
+    int i;
+    SystemMemory *expected = create_test_memory(100, 0);
+    memset(expected->tape, 0, 100);
+    CU_ASSERT_EQUAL(0, execute_code_with_engine(code, strlen(code), expected, execute_program));
+    for (i = 0; i < 4; i++) {
+        SystemMemory *mem = initialize_virtual_memory(100, 1);
+        CU_ASSERT_EQUAL(0, execute_code_with_engine(code, strlen(code), mem, engines[i]));
+        CU_ASSERT_EQUAL(expected->curr_index, mem->curr_index);
+        CU_ASSERT_EQUAL(0, memcmp(expected->tape, mem->tape, 100));
+        free_mem(mem);
+    }
+    free_mem(expected);
+}
+
+static void test_find_cell_model() {
+    CU_ASSERT_PTR_NULL(find_cell_model("saturating-7-bit")->engine);
+    CU_ASSERT_PTR_EQUAL(execute_program_wrap_u8, find_cell_model("wrap-u8")->engine);
+    CU_ASSERT_EQUAL(4, find_cell_model("wrap-u32")->cell_size);
+    CU_ASSERT_PTR_NULL(find_cell_model("wrap-u64"));
+}
+
+static void test_wrapping_cell_models() {
+    // 0 - 1, then 16 * 20 with a multiply loop and [-] on the second cell
+    const char *code = "->++++++++++++++++[>++++++++++++++++++++<-]>>+++[-]";
+    SystemMemory *mem = initialize_memory_with_cells(10, 1);
+    CU_ASSERT_EQUAL(0, execute_code_with_engine(code, strlen(code), mem, execute_program_wrap_u8));
+    CU_ASSERT_EQUAL(255, (unsigned char) mem->tape[0]);
+    CU_ASSERT_EQUAL(320 % 256, (unsigned char) mem->tape[2]);
+    CU_ASSERT_EQUAL(0, mem->tape[3]);
+    free_mem(mem);
+    mem = initialize_memory_with_cells(10, 2);
+    CU_ASSERT_EQUAL(0, execute_code_with_engine(code, strlen(code), mem, execute_program_wrap_u16));
+    CU_ASSERT_EQUAL(65535, ((unsigned short *) mem->tape)[0]);
+    CU_ASSERT_EQUAL(320, ((unsigned short *) mem->tape)[2]);
+    free_mem(mem);
+}
+
+static void test_checked_cell_model_stops_on_overflow() {
+    const char *code = "+++[>++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++<-]";
+    SystemMemory *mem = initialize_memory_with_cells(10, 1);
+    CU_ASSERT_EQUAL(-1, execute_code_with_engine(code, strlen(code), mem, execute_program_checked_u8));
+    free_mem(mem);
+    mem = initialize_memory_with_cells(10, 1);
+    CU_ASSERT_EQUAL(-1, execute_code_with_engine("-", 1, mem, execute_program_checked_u8));
+    CU_ASSERT_EQUAL(0, execute_code_with_engine("+-", 2, mem, execute_program_checked_u8));
+    free_mem(mem);
+}
+
+static void test_bf_compile_reports_unbalanced_brackets() {
+    BfProgram *program = NULL;
+    long error_position = 0;
+    CU_ASSERT_EQUAL(BF_ERROR_UNBALANCED_BRACKETS, bf_compile("+[>[-]", 6, &program, &error_position));
+    CU_ASSERT_EQUAL(1, error_position);
+    CU_ASSERT_EQUAL(BF_ERROR_UNBALANCED_BRACKETS, bf_compile("+]", 2, &program, &error_position));
+    CU_ASSERT_EQUAL(1, error_position);
+    CU_ASSERT_PTR_NULL(program);
+}
+
+static void test_bf_run_reuses_context() {
+    // doubles the first input byte into the third cell, leaving the tape dirty
+    const char *source = ",[>++<-]>[>+<-]>.";
+    BfProgram *program;
+    char output[4];
+    long output_length;
+    CU_ASSERT_EQUAL(BF_OK, bf_compile(source, strlen(source), &program, NULL));
+    BfContext *context = bf_context_new(100000);
+    CU_ASSERT_EQUAL(BF_OK, bf_run(program, context, "\x05", 1, output, 4, &output_length));
+    CU_ASSERT_EQUAL(1, output_length);
+    CU_ASSERT_EQUAL(10, output[0]);
+    CU_ASSERT_EQUAL(BF_OK, bf_run(program, context, "\x03", 1, output, 4, &output_length));
+    CU_ASSERT_EQUAL(1, output_length);
+    CU_ASSERT_EQUAL(6, output[0]);
+    bf_context_free(context);
+    bf_program_free(program);
+}
+
+static void test_bf_run_reports_full_output() {
+    BfProgram *program;
+    char output[2];
+    long output_length;
+    CU_ASSERT_EQUAL(BF_OK, bf_compile("+...", 4, &program, NULL));
+    BfContext *context = bf_context_new(10);
+    CU_ASSERT_EQUAL(BF_ERROR_OUTPUT_FULL, bf_run(program, context, NULL, 0, output, 2, &output_length));
+    CU_ASSERT_EQUAL(2, output_length);
+    bf_context_free(context);
+    bf_program_free(program);
+}
+
+static void test_load_source() {
+    char file_name[] = "/tmp/interpreter_tests_XXXXXX";
+    int fd = mkstemp(file_name);
+    CU_ASSERT_EQUAL(5, write(fd, "+[-].", 5));
+    close(fd);
+    SourceFile *source = load_source(file_name);
+    CU_ASSERT_PTR_NOT_NULL(source);
+    CU_ASSERT_EQUAL(5, source->length);
+    CU_ASSERT_EQUAL(0, memcmp("+[-].", source->data, 5));
+    free_source(source);
+    unlink(file_name);
+    CU_ASSERT_PTR_NULL(load_source(file_name));
+}
+
+static void append_output(void *target, const char *data, long length) {
+    strncat(target, data, length);
+}
+
+static void test_bf_run_streaming() {
+    BfProgram *program;
+    char output[8] = {0};
+    CU_ASSERT_EQUAL(BF_OK, bf_compile(",.,.", 4, &program, NULL));
+    BfContext *context = bf_context_new(10);
+    CU_ASSERT_EQUAL(BF_OK, bf_run_streaming(program, context, "hi", 2, append_output, output));
+    CU_ASSERT_STRING_EQUAL("hi", output);
+    bf_context_free(context);
+    bf_program_free(program);
+}
+
+static void test_evaluate_prefix() {
+    Snapshot *snapshot;
+    Program *program = compile_program("+++[>++<-]>.,.", 14);
+    optimize_program(program);
+    Program *residual = evaluate_prefix(program, 10, PARTIAL_EVALUATION_BUDGET, &snapshot);
+    CU_ASSERT_EQUAL(2, residual->num_ops); // ",."
+    CU_ASSERT_EQUAL(OP_INPUT, residual->ops[0].code);
+    CU_ASSERT_EQUAL(1, snapshot->curr_index);
+    CU_ASSERT_EQUAL(2, snapshot->num_cells);
+    CU_ASSERT_EQUAL(6, snapshot->cells[1]);
+    CU_ASSERT_EQUAL(1, snapshot->output_length);
+    CU_ASSERT_EQUAL(6, snapshot->output[0]);
+    CU_ASSERT_EQUAL(2, snapshot->min_tape_size); // the run never reaches cell 2
+    free_program(residual);
+    free_snapshot(snapshot);
+    free_program(program);
+    // nothing to run before the first ","
+    program = compile_program(",[.,]", 5);
+    CU_ASSERT_PTR_NULL(evaluate_prefix(program, 10, PARTIAL_EVALUATION_BUDGET, &snapshot));
+    free_program(program);
+}
+
+static void test_evaluate_prefix_keeps_unfinished_loops() {
+    Snapshot *snapshot;
+    // the loop never ends, so the run stops before it
+    Program *program = compile_program("+.+[>>+<<]", 10);
+    Program *residual = evaluate_prefix(program, 10, 1000, &snapshot);
+    CU_ASSERT_EQUAL(5, residual->num_ops);
+    CU_ASSERT_EQUAL(OP_JUMP_IF_ZERO, residual->ops[0].code);
+    CU_ASSERT_EQUAL(4, residual->ops[0].jump);
+    CU_ASSERT_EQUAL(1, snapshot->num_cells); // the loop's changes are not kept
+    CU_ASSERT_EQUAL(2, snapshot->cells[0]);
+    CU_ASSERT_EQUAL(1, snapshot->output_length);
+    free_program(residual);
+    free_snapshot(snapshot);
+    free_program(program);
+    // a pointer stuck at the end of the tape only holds for that tape
+    program = compile_program(">>>>+.,", 7);
+    residual = evaluate_prefix(program, 3, PARTIAL_EVALUATION_BUDGET, &snapshot);
+    CU_ASSERT_EQUAL(3, snapshot->min_tape_size);
+    CU_ASSERT_EQUAL(3, snapshot->max_tape_size);
+    free_program(residual);
+    free_snapshot(snapshot);
+    free_program(program);
+}
+
+static void test_bf_run_starts_from_snapshot() {
+    // prints "A" before reading input, which runs ahead of time
+    const char *source = "++++++++[>++++++++<-]>+.,.";
+    BfProgram *program;
+    char output[4];
+    long output_length;
+    int sizes[] = {2, 100000};
+    int i;
+    CU_ASSERT_EQUAL(BF_OK, bf_compile(source, strlen(source), &program, NULL));
+    for (i = 0; i < 2; i++) {
+        BfContext *context = bf_context_new(sizes[i]);
+        CU_ASSERT_EQUAL(BF_OK, bf_run(program, context, "b", 1, output, 4, &output_length));
+        CU_ASSERT_EQUAL(2, output_length);
+        CU_ASSERT_EQUAL(0, memcmp("Ab", output, 2));
+        CU_ASSERT_EQUAL(BF_OK, bf_run(program, context, "c", 1, output, 4, &output_length));
+        CU_ASSERT_EQUAL(0, memcmp("Ac", output, 2));
+        bf_context_free(context);
+    }
+    bf_program_free(program);
+}
+
+static void test_checkpoint_round_trip() {
+    char file_name[] = "/tmp/interpreter_tests_XXXXXX";
+    close(mkstemp(file_name));
+    SystemMemory *mem = initialize_memory_with_size(1 << 20);
+    CheckpointHeader header, loaded;
+    memset(&header, 0, sizeof(header));
+    strcpy(header.cell_model, "saturating-7-bit");
+    header.cell_size = 1;
+    header.tape_size = 1 << 20;
+    header.pc = 7;
+    header.curr_index = 900000;
+    header.input_offset = 12;
+    mem->tape[5] = 3;
+    mem->tape[900000] = 7;
+    CU_ASSERT_EQUAL(0, write_checkpoint(file_name, &header, mem));
+    CU_ASSERT_EQUAL(2, header.num_pages); // only the pages in use are stored
+    free_mem(mem);
+
+    mem = initialize_memory_with_size(1 << 20);
+    CU_ASSERT_EQUAL(0, read_checkpoint_header(file_name, &loaded));
+    CU_ASSERT_EQUAL(0, load_checkpoint(file_name, &loaded, mem));
+    CU_ASSERT_EQUAL(7, loaded.pc);
+    CU_ASSERT_EQUAL(12, loaded.input_offset);
+    CU_ASSERT_EQUAL(900000, mem->curr_index);
+    CU_ASSERT_EQUAL(3, mem->tape[5]);
+    CU_ASSERT_EQUAL(7, mem->tape[900000]);
+    CU_ASSERT_EQUAL(0, mem->tape[6]);
     free_mem(mem);
-    stack_free(left_bracket_stack);
+
+    // another tape, or a file cut short, is rejected
+    mem = initialize_memory_with_size(1000);
+    CU_ASSERT_EQUAL(-1, load_checkpoint(file_name, &loaded, mem));
+    free_mem(mem);
+    mem = initialize_memory_with_size(1 << 20);
+    CU_ASSERT_EQUAL(0, truncate(file_name, 1000));
+    CU_ASSERT_EQUAL(-1, load_checkpoint(file_name, &loaded, mem));
+    free_mem(mem);
+    unlink(file_name);
 }
 
-static void test_conditional_continue_end_loop_has_matching_left_bracket() {
+static void test_execute_code_resumes_checkpoint() {
+    const char *code = "+[->+<]";
+    char file_name[] = "/tmp/interpreter_tests_XXXXXX";
+    close(mkstemp(file_name));
+    SystemMemory *mem = initialize_memory_with_size(100);
+    Program *program = compile_program(code, strlen(code));
+    optimize_for_memory(program, mem);
+    CheckpointHeader header;
+    memset(&header, 0, sizeof(header));
+    header.source_hash = hash_source(code, strlen(code));
+    strcpy(header.cell_model, "saturating-7-bit");
+    header.cell_size = 1;
+    header.tape_size = 100;
+    header.num_ops = program->num_ops;
+    header.pc = 1; // at the loop, with a cell the "+" could not have set
+    mem->tape[0] = 2;
+    CU_ASSERT_EQUAL(0, write_checkpoint(file_name, &header, mem));
+    free_program(program);
+    free_mem(mem);
+
+    CheckpointSettings settings = {file_name, 0, "saturating-7-bit", 0};
+    mem = initialize_memory_with_size(100);
+    CU_ASSERT_EQUAL(0, execute_code_checkpointed(code, strlen(code), mem, execute_instruction,
+                                                 &settings, file_name));
+    CU_ASSERT_EQUAL(0, mem->tape[0]);
+    CU_ASSERT_EQUAL(2, mem->tape[1]);
+    CU_ASSERT_EQUAL(-1, access(file_name, F_OK)); // removed once the program ends
+    free_mem(mem);
+
+    // a checkpoint of another program is rejected
+    mem = initialize_memory_with_size(100);
+    CU_ASSERT_EQUAL(0, write_checkpoint(file_name, &header, mem));
+    CU_ASSERT_EQUAL(-1, execute_code_checkpointed("+[-]", 4, mem, execute_instruction,
+                                                  &settings, file_name));
+    free_mem(mem);
+    unlink(file_name);
+}
+
+static void test_checkpointed_runs_match_engines() {
+    const char *code = "++++[>+++[>++++[>+<-]<-]<-]>>>";
+    Stepper steps[] = {execute_instruction, step_wrap_u8};
+    char file_name[] = "/tmp/interpreter_tests_XXXXXX";
+    int i;
+    close(mkstemp(file_name));
+    unlink(file_name);
+    for (i = 0; i < 2; i++) {
+        // a checkpoint after every loop iteration, taken and replaced as it runs
+        CheckpointSettings settings = {file_name, 1, i == 0 ? "saturating-7-bit" : "wrap-u8", 0};
+        SystemMemory *mem = initialize_memory_with_size(100);
+        CU_ASSERT_EQUAL(0, execute_code_checkpointed(code, strlen(code), mem, steps[i],
+                                                     &settings, NULL));
+        CU_ASSERT_EQUAL(48, mem->tape[3]);
+        CU_ASSERT_EQUAL(3, mem->curr_index);
+        CU_ASSERT_EQUAL(-1, access(file_name, F_OK));
+        free_mem(mem);
+    }
+}
+
+static void test_compiled_file_round_trip() {
+    const char *code = ",[->++>+<<]>.>[>]";
+    char file_name[] = "/tmp/interpreter_tests_XXXXXX";
+    close(mkstemp(file_name));
+    SystemMemory *mem = initialize_memory_with_size(100);
+    Program *program = compile_program(code, strlen(code));
+    optimize_for_memory(program, mem);
+    CU_ASSERT_EQUAL(0, write_compiled_file(file_name, program, code, strlen(code), mem));
+
+    CompiledFile *file = load_compiled_file(file_name, code, strlen(code), mem);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+    CU_ASSERT_EQUAL(program->num_ops, file->program.num_ops);
+    CU_ASSERT_EQUAL(program->num_targets, file->program.num_targets);
+    CU_ASSERT_EQUAL(0, memcmp(program->ops, file->program.ops,
+                              sizeof(Instruction) * program->num_ops));
+    CU_ASSERT_EQUAL(0, memcmp(program->targets, file->program.targets,
+                              sizeof(MultiplyTarget) * program->num_targets));
+    free_compiled_file(file);
+
+    // a changed program, another tape or a damaged file is rejected
+    CU_ASSERT_PTR_NULL(load_compiled_file(file_name, ",[->++>+<<]>.>[<]", strlen(code), mem));
+    SystemMemory *other = initialize_memory_with_size(200);
+    CU_ASSERT_PTR_NULL(load_compiled_file(file_name, code, strlen(code), other));
+    free_mem(other);
+    FILE *damaged = fopen(file_name, "r+b");
+    fseek(damaged, -1, SEEK_END);
+    fputc('!', damaged);
+    fclose(damaged);
+    CU_ASSERT_PTR_NULL(load_compiled_file(file_name, code, strlen(code), mem));
+    free_program(program);
+    free_mem(mem);
+    unlink(file_name);
+}
+
+static void test_execute_compiled_file() {
+    const char *code = "++++[->++>+<<]>[>]";
+    char file_name[] = "/tmp/interpreter_tests_XXXXXX";
+    close(mkstemp(file_name));
+    SystemMemory *mem = initialize_memory_with_size(100);
+    CU_ASSERT_EQUAL(0, compile_to_file(file_name, code, strlen(code), mem));
+    free_mem(mem);
+    mem = initialize_memory_with_size(100);
+    CU_ASSERT_EQUAL(0, execute_compiled_file(file_name, code, strlen(code), mem,
+                                             execute_program));
+    CU_ASSERT_EQUAL(8, mem->tape[1]);
+    CU_ASSERT_EQUAL(4, mem->tape[2]);
+    CU_ASSERT_EQUAL(3, mem->curr_index);
+    free_mem(mem);
+    unlink(file_name);
+}
+
+static void test_perf_counters_count_or_fall_back() {
+    const char *code = "++++[->++>+<<]>[>]";
+    PerfCounters counters;
+    int i, open = 0;
+    int available = start_perf_counters(&counters);
+    SystemMemory *mem = initialize_memory_with_size(100);
+    CU_ASSERT_EQUAL(0, execute_code(code, mem));
+    stop_perf_counters(&counters);
+    for (i = 0; i < NUM_PERF_COUNTERS; i++) {
+        if (counters.fds[i] >= 0) {
+            open++;
+        } else {
+            CU_ASSERT_EQUAL(0, counters.values[i]);
+        }
+    }
+    CU_ASSERT_EQUAL(available, open);
+    if (counters.fds[PERF_INSTRUCTIONS] >= 0) {
+        CU_ASSERT(counters.values[PERF_INSTRUCTIONS] > 0);
+    }
+    free_mem(mem);
+    // the run itself is unaffected either way
+    mem = initialize_memory_with_size(100);
+    CU_ASSERT_EQUAL(0, execute_code_with_perf_counters(code, strlen(code), mem,
+                                                       execute_program));
+    CU_ASSERT_EQUAL(8, mem->tape[1]);
+    CU_ASSERT_EQUAL(4, mem->tape[2]);
+    CU_ASSERT_EQUAL(3, mem->curr_index);
+    free_mem(mem);
+}
+
+static void test_program_cache_evicts_least_recently_used() {
+    ProgramCache *cache = new_program_cache(2);
+    BfStatus status;
+    long hits, misses;
+    int size;
+    CacheEntry *first = program_cache_acquire(cache, "+.", 2, &status);
+    CU_ASSERT_EQUAL(BF_OK, status);
+    CacheEntry *second = program_cache_acquire(cache, "-.", 2, &status);
+    CU_ASSERT_PTR_EQUAL(first, program_cache_acquire(cache, "+.", 2, &status));
+    program_cache_release(cache, first);
+    // "-." is now the least recently used program and makes room for ">."
+    program_cache_release(cache, program_cache_acquire(cache, ">.", 2, &status));
+    program_cache_stats(cache, &hits, &misses, &size);
+    CU_ASSERT_EQUAL(1, hits);
+    CU_ASSERT_EQUAL(3, misses);
+    CU_ASSERT_EQUAL(2, size);
+    CU_ASSERT_PTR_NOT_NULL(cache_entry_program(second)); // still usable until released
+    program_cache_release(cache, second);
+    program_cache_release(cache, first);
+    CU_ASSERT_PTR_NULL(program_cache_acquire(cache, "[", 1, &status));
+    CU_ASSERT_EQUAL(BF_ERROR_UNBALANCED_BRACKETS, status);
+    program_cache_free(cache);
+}
+
+static void test_execute_program_profiled() {
+    const char *code = "++[>+++[-]<-]\n>[>]";
     SystemMemory *mem = create_test_memory(100, 0);
-    mem->tape[mem->curr_index] = 0; // zero memory value--end the loop
-    Stack *left_bracket_stack = new_stack();
-    stack_push(left_bracket_stack, 3); // left bracket at instruction 3
-    int next_instr_index = conditional_continue(mem, 17, left_bracket_stack);
-    CU_ASSERT_EQUAL(18, next_instr_index); // next instruction index is after current
-    CU_ASSERT_EQUAL(0, stack_size(left_bracket_stack)); // left bracket removed from stack
+    memset(mem->tape, 0, 100);
+    Program *program = compile_program(code, strlen(code));
+    optimize_program(program);
+    Profile *profile = new_profile(program);
+    CU_ASSERT_EQUAL(0, execute_program_profiled(program, mem, profile,
+                                                 execute_instruction));
+    CU_ASSERT_EQUAL(1, profile->executions[1]); // the outer loop is reached once
+    CU_ASSERT_EQUAL(2, profile->iterations[1]); // and runs twice
+    CU_ASSERT_EQUAL(2, profile->executions[4]); // "[-]" runs in one step
+    CU_ASSERT_EQUAL(0, profile->iterations[4]);
+    CU_ASSERT_EQUAL(1, profile->executions[11]); // the scan on line 2
+    CU_ASSERT_EQUAL(15, program->ops[11].position);
+    free_profile(profile);
+    free_program(program);
+
+    // another cell model's single-step engine
+    program = compile_program("-[+>]", 5);
+    optimize_program(program);
+    profile = new_profile(program);
+    memset(mem->tape, 0, 100);
+    mem->curr_index = 0;
+    CU_ASSERT_EQUAL(0, execute_program_profiled(program, mem, profile, step_wrap_u8));
+    CU_ASSERT_EQUAL(0, mem->tape[0]);
+    CU_ASSERT_EQUAL(1, mem->curr_index);
+    CU_ASSERT_EQUAL(1, profile->iterations[1]);
+    free_profile(profile);
+    free_program(program);
     free_mem(mem);
-    stack_free(left_bracket_stack);
+
+    // counts of code after a range check that passes once and fails twice
+    Stepper steps[] = {execute_instruction, step_wrap_u8};
+    int i;
+    for (i = 0; i < 2; i++) {
+        mem = create_test_memory(4, 0);
+        memset(mem->tape, 1, 4);
+        mem->curr_index = 3;
+        program = compile_program("[>+<-<]", 7);
+        optimize_program(program);
+        CU_ASSERT_EQUAL(OP_CHECK_RANGE, program->ops[1].code);
+        CU_ASSERT_EQUAL(OP_JUMP, program->ops[5].code);
+        profile = new_profile(program);
+        CU_ASSERT_EQUAL(0, execute_program_profiled(program, mem, profile, steps[i]));
+        CU_ASSERT_EQUAL(1, profile->executions[0]);
+        CU_ASSERT_EQUAL(3, profile->iterations[0]);
+        CU_ASSERT_EQUAL(3, profile->executions[1]);
+        CU_ASSERT_EQUAL(1, profile->executions[2]); // the offset-addressed code
+        CU_ASSERT_EQUAL(1, profile->executions[5]);
+        CU_ASSERT_EQUAL(2, profile->executions[6]); // the original code
+        CU_ASSERT_EQUAL(2, profile->executions[10]);
+        CU_ASSERT_EQUAL(3, profile->executions[11]);
+        free_profile(profile);
+        free_program(program);
+        free_mem(mem);
+    }
+}
+
+/*
+ * Writes contents to a new temporary file whose name is stored in file_name.
+ */
+static void write_temp_file(char *file_name, const char *contents) {
+    int fd = mkstemp(file_name);
+    CU_ASSERT_EQUAL((ssize_t) strlen(contents), write(fd, contents, strlen(contents)));
+    close(fd);
+}
+
+static void test_run_batch() {
+    char program[] = "/tmp/interpreter_tests_XXXXXX";
+    char input[] = "/tmp/interpreter_tests_XXXXXX";
+    char output[] = "/tmp/interpreter_tests_XXXXXX";
+    char manifest[] = "/tmp/interpreter_tests_XXXXXX";
+    char manifest_contents[256];
+    char result[4] = {0};
+    write_temp_file(program, ",+.,+.");
+    write_temp_file(input, "ab");
+    write_temp_file(output, "");
+    snprintf(manifest_contents, sizeof(manifest_contents), "# jobs\n%s %s %s\n%s - -\n",
+             program, input, output, program);
+    write_temp_file(manifest, manifest_contents);
+    CU_ASSERT_EQUAL(0, run_batch(manifest, 2, 100, 0));
+    CU_ASSERT_EQUAL(0, run_batch(manifest, 2, 100, 1000)); // as green threads
+    FILE *file = fopen(output, "rb");
+    CU_ASSERT_EQUAL(2, fread(result, 1, sizeof(result), file));
+    CU_ASSERT_STRING_EQUAL("bc", result);
+    fclose(file);
+    unlink(program);
+    CU_ASSERT_EQUAL(-1, run_batch(manifest, 2, 100, 0)); // the program is gone
+    unlink(input);
+    unlink(output);
+    unlink(manifest);
+}
+
+static void test_run_green_threads() {
+    BfProgram *endless, *echo;
+    GreenThread threads[200];
+    char outputs[200][8] = {{0}};
+    int i;
+    CU_ASSERT_EQUAL(BF_OK, bf_compile(",+[]", 4, &endless, NULL));
+    CU_ASSERT_EQUAL(BF_OK, bf_compile(",+[-.,+]", 8, &echo, NULL));
+    for (i = 0; i < 200; i++) {
+        threads[i].task = bf_task_new(i % 2 ? endless : echo, 100, "abc", 3,
+                                      append_output, outputs[i]);
+        threads[i].fuel = i % 2 ? 1000 : 0;
+    }
+    // the endless programs take turns with the others until they are stopped
+    run_green_threads(threads, 200, 2, 10);
+    for (i = 0; i < 200; i++) {
+        if (i % 2) {
+            CU_ASSERT_EQUAL(BF_ERROR_OUT_OF_FUEL, threads[i].status);
+            CU_ASSERT_EQUAL(1000, threads[i].fuel_used);
+        } else {
+            CU_ASSERT_EQUAL(BF_OK, threads[i].status);
+            CU_ASSERT_EQUAL(2, threads[i].fuel_used); // the "]" jumps back twice
+            CU_ASSERT_STRING_EQUAL("abc", outputs[i]);
+        }
+        bf_task_free(threads[i].task);
+    }
+    bf_program_free(endless);
+    bf_program_free(echo);
+}
+
+static void test_bf_task_waits_for_streamed_input() {
+    BfProgram *echo;
+    char output[8] = {0};
+    long fuel = 1000;
+    CU_ASSERT_EQUAL(BF_OK, bf_compile(",+[-.,+]", 8, &echo, NULL));
+    BfTask *task = bf_task_new(echo, 100, NULL, 0, append_output, output);
+    CU_ASSERT_EQUAL(BF_WAITING, bf_task_run(task, &fuel));
+    CU_ASSERT_EQUAL(1000, fuel);
+    CU_ASSERT_EQUAL(BF_OK, bf_task_add_input(task, "ab", 2));
+    CU_ASSERT_EQUAL(BF_WAITING, bf_task_run(task, &fuel));
+    CU_ASSERT_EQUAL(BF_OK, bf_task_add_input(task, "c", 1));
+    CU_ASSERT_EQUAL(BF_OK, bf_task_add_input(task, NULL, 0)); // the end of the input
+    CU_ASSERT_EQUAL(BF_OK, bf_task_run(task, &fuel));
+    CU_ASSERT_STRING_EQUAL("abc", output);
+    bf_task_free(task);
+    bf_program_free(echo);
 }
 
-static void test_conditional_continue_end_loop_no_matching_left_bracket() {
+static void *write_inputs_later(void *argument) {
+    int *fds = argument;
+    usleep(50000);
+    CU_ASSERT_EQUAL(2, write(fds[0], "hi", 2));
+    CU_ASSERT_EQUAL(2, write(fds[1], "yo", 2));
+    close(fds[0]);
+    close(fds[1]);
+    return NULL;
+}
+
+static void test_green_threads_wait_for_input() {
+    BfProgram *echo, *count;
+    GreenThread threads[3];
+    char outputs[3][8] = {{0}};
+    int pipe_fds[2], socket_fds[2], write_fds[2];
+    pthread_t writer;
+    int i;
+    CU_ASSERT_EQUAL(BF_OK, bf_compile(",+[-.,+]", 8, &echo, NULL));
+    CU_ASSERT_EQUAL(BF_OK, bf_compile("++++++[>++++++++<-]>+.", 22, &count, NULL));
+    CU_ASSERT_EQUAL(0, pipe(pipe_fds));
+    CU_ASSERT_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, socket_fds));
+    threads[0].input_fd = pipe_fds[0];
+    threads[1].input_fd = socket_fds[0];
+    threads[2].input_fd = -1;
+    for (i = 0; i < 3; i++) {
+        threads[i].task = bf_task_new(i < 2 ? echo : count, 100, i < 2 ? NULL : "", 0,
+                                      append_output, outputs[i]);
+        threads[i].fuel = 0;
+    }
+    write_fds[0] = pipe_fds[1];
+    write_fds[1] = socket_fds[1];
+    pthread_create(&writer, NULL, write_inputs_later, write_fds);
+    // one worker: the programs waiting for input must not hold it
+    run_green_threads(threads, 3, 1, 10);
+    pthread_join(writer, NULL);
+    CU_ASSERT_STRING_EQUAL("hi", outputs[0]);
+    CU_ASSERT_STRING_EQUAL("yo", outputs[1]);
+    CU_ASSERT_STRING_EQUAL("1", outputs[2]);
+    CU_ASSERT(threads[2].milliseconds < threads[0].milliseconds);
+    for (i = 0; i < 3; i++) {
+        CU_ASSERT_EQUAL(BF_OK, threads[i].status);
+        bf_task_free(threads[i].task);
+    }
+    close(pipe_fds[0]);
+    close(socket_fds[0]);
+    bf_program_free(echo);
+    bf_program_free(count);
+}
+
+static void test_set_zero_loop() {
     SystemMemory *mem = create_test_memory(100, 0);
-    mem->tape[mem->curr_index] = 0; // zero memory value--end the loop
-    Stack *left_bracket_stack = new_stack(); // empty stack
-    int next_instr_index = conditional_continue(mem, 17, left_bracket_stack);
-    CU_ASSERT_EQUAL(-1, next_instr_index); // no matching left bracket found--syntax error
+    Program *program = compile_program("[-]+", 4);
+    recognize_loop_idioms(program);
+    CU_ASSERT_EQUAL(OP_SET_ZERO, program->ops[0].code);
+    mem->tape[0] = 42;
+    CU_ASSERT_EQUAL(3, set_zero_loop(mem, program->ops, 0)); // loop skipped
+    CU_ASSERT_EQUAL(0, mem->tape[0]);
+    mem->tape[0] = -1; // "[-]" never terminates: fall into the loop body
+    CU_ASSERT_EQUAL(1, set_zero_loop(mem, program->ops, 0));
+    CU_ASSERT_EQUAL(-1, mem->tape[0]);
+    free_mem(mem);
+    free_program(program);
+}
+
+static void test_scan_loop() {
+    SystemMemory *mem = create_test_memory(100, 10);
+    memset(mem->tape, 1, 100);
+    mem->tape[16] = 0;
+    Program *program = compile_program("[>>]", 4);
+    recognize_loop_idioms(program);
+    CU_ASSERT_EQUAL(OP_SCAN, program->ops[0].code);
+    CU_ASSERT_EQUAL(2, program->ops[0].arg);
+    CU_ASSERT_EQUAL(3, scan_loop(mem, program->ops, 0));
+    CU_ASSERT_EQUAL(16, mem->curr_index);
+    free_mem(mem);
+    free_program(program);
+}
+
+static void test_scan_loop_stops_before_tape_edge() {
+    SystemMemory *mem = create_test_memory(100, 95);
+    memset(mem->tape, 1, 100);
+    Program *program = compile_program("[>>]", 4);
+    recognize_loop_idioms(program);
+    // the pointer would stick at the edge: the loop body takes over
+    CU_ASSERT_EQUAL(1, scan_loop(mem, program->ops, 0));
+    CU_ASSERT_EQUAL(99, mem->curr_index);
     free_mem(mem);
-    stack_free(left_bracket_stack);
+    free_program(program);
+}
+
+static void test_recognize_multiply_loop() {
+    Program *program = compile_program("[->++>+++<<]", 12);
+    recognize_loop_idioms(program);
+    CU_ASSERT_EQUAL(OP_MULTIPLY_LOOP, program->ops[0].code);
+    CU_ASSERT_EQUAL(2, program->ops[0].arg);
+    CU_ASSERT_EQUAL(1, program->targets[program->ops[0].offset].offset);
+    CU_ASSERT_EQUAL(2, program->targets[program->ops[0].offset].factor);
+    CU_ASSERT_EQUAL(2, program->targets[program->ops[0].offset + 1].offset);
+    CU_ASSERT_EQUAL(3, program->targets[program->ops[0].offset + 1].factor);
+    free_program(program);
+}
+
+static void test_recognize_multiply_loop_rejects_other_loops() {
+    // counter changes by 2, pointer drifts, and a target is updated twice
+    Program *program = compile_program("[-->+<][->+][->+<>+<]", 21);
+    recognize_loop_idioms(program);
+    CU_ASSERT_EQUAL(OP_JUMP_IF_ZERO, program->ops[0].code);
+    CU_ASSERT_EQUAL(OP_JUMP_IF_ZERO, program->ops[program->ops[0].jump + 1].code);
+    CU_ASSERT_EQUAL(OP_JUMP_IF_ZERO, program->ops[program->num_ops - 9].code);
+    CU_ASSERT_EQUAL(0, program->num_targets);
+    free_program(program);
+}
+
+static void test_multiply_loop_saturates() {
+    SystemMemory *mem = create_test_memory(100, 1);
+    Program *program = compile_program("[->++<<--->]", 12);
+    recognize_loop_idioms(program);
+    mem->tape[0] = 50;
+    mem->tape[1] = 40;
+    mem->tape[2] = 10;
+    CU_ASSERT_EQUAL(program->num_ops, multiply_loop(mem, program, 0));
+    CU_ASSERT_EQUAL(0, mem->tape[0]);
+    CU_ASSERT_EQUAL(0, mem->tape[1]);
+    CU_ASSERT_EQUAL(90, mem->tape[2]);
+    free_mem(mem);
+    free_program(program);
+}
+
+static void test_multiply_loop_at_tape_edge_falls_back() {
+    SystemMemory *mem = create_test_memory(100, 99);
+    Program *program = compile_program("[->+<]", 6);
+    recognize_loop_idioms(program);
+    mem->tape[99] = 5;
+    CU_ASSERT_EQUAL(1, multiply_loop(mem, program, 0));
+    CU_ASSERT_EQUAL(5, mem->tape[99]);
+    free_mem(mem);
+    free_program(program);
+}
+
+static void test_find_zero_cell_matches_single_steps() {
+    int strides[] = {1, 2, 3, 4, 8, 16, 32, 40, -1, -2, -3, -4, -8, -32};
+    char tape[1000];
+    int i, j, start;
+    for (i = 0; i < 1000; i++) {
+        tape[i] = (i % 7) + 1;
+    }
+    tape[5] = 0;
+    tape[611] = 0;
+    tape[612] = -3;
+    tape[998] = 0;
+    for (i = 0; i < (int) (sizeof(strides) / sizeof(int)); i++) {
+        for (start = 0; start < 1000; start += 37) {
+            long expected = -1;
+            for (j = start; j >= 0 && j < 1000; j += strides[i]) {
+                if (tape[j] == 0) {
+                    expected = j;
+                    break;
+                }
+            }
+            CU_ASSERT_EQUAL(expected, find_zero_cell(tape, 1000, start, strides[i]));
+        }
+    }
+}
+
+static void test_find_non_positive_cell() {
+    char tape[200];
+    memset(tape, 9, 200);
+    tape[150] = -4;
+    CU_ASSERT_EQUAL(150, find_non_positive_cell(tape, 200, 3, 1));
+    CU_ASSERT_EQUAL(-1, find_zero_cell(tape, 200, 3, 1));
+    CU_ASSERT_EQUAL(-1, find_non_positive_cell(tape, 200, 151, 1));
+    CU_ASSERT_EQUAL(199, last_cell_in_range(200, 151, 1));
+    CU_ASSERT_EQUAL(198, last_cell_in_range(200, 150, 2));
+    CU_ASSERT_EQUAL(1, last_cell_in_range(200, 151, -3));
+}
+
+static void test_clear_range_loop() {
+    SystemMemory *mem = create_test_memory(100, 10);
+    memset(mem->tape, 5, 100);
+    mem->tape[20] = 0;
+    Program *program = compile_program("[[-]>]", 6);
+    recognize_loop_idioms(program);
+    CU_ASSERT_EQUAL(OP_CLEAR_RANGE, program->ops[0].code);
+    CU_ASSERT_EQUAL(6, clear_range_loop(mem, program->ops, 0));
+    CU_ASSERT_EQUAL(20, mem->curr_index);
+    CU_ASSERT_EQUAL(5, mem->tape[9]);
+    CU_ASSERT_EQUAL(0, mem->tape[10]);
+    CU_ASSERT_EQUAL(0, mem->tape[19]);
+    CU_ASSERT_EQUAL(5, mem->tape[21]);
+    free_mem(mem);
+    free_program(program);
+}
+
+static void test_use_unchecked_moves() {
+    const char *code = ">>+<<<<>>>>";
+    Program *program = compile_program(code, strlen(code));
+    use_unchecked_moves(program, 4);
+    CU_ASSERT_EQUAL(OP_MOVE_UNCHECKED, program->ops[0].code); // >>
+    CU_ASSERT_EQUAL(OP_MOVE_UNCHECKED, program->ops[2].code); // <<<<, after a cell access
+    CU_ASSERT_EQUAL(OP_MOVE, program->ops[3].code);           // >>>>, 8 cells since one
+    free_program(program);
+}
+
+static void test_address_cells_by_offset() {
+    Program *program = compile_program(">+>++<<-.>", 10);
+    address_cells_by_offset(program);
+    CU_ASSERT_EQUAL(13, program->num_ops);
+    CU_ASSERT_EQUAL(OP_CHECK_RANGE, program->ops[0].code);
+    CU_ASSERT_EQUAL(0, program->ops[0].offset);
+    CU_ASSERT_EQUAL(2, program->ops[0].arg);
+    CU_ASSERT_EQUAL(4, program->ops[0].jump);
+    CU_ASSERT_EQUAL(1, program->ops[1].offset); // +
+    CU_ASSERT_EQUAL(2, program->ops[2].offset); // ++
+    CU_ASSERT_EQUAL(0, program->ops[3].offset); // -
+    CU_ASSERT_EQUAL(OP_JUMP, program->ops[4].code);
+    CU_ASSERT_EQUAL(10, program->ops[4].jump);
+    CU_ASSERT_EQUAL(OP_MOVE, program->ops[5].code); // the original code
+    CU_ASSERT_EQUAL(OP_OUTPUT, program->ops[11].code);
+    free_program(program);
+}
+
+static void test_offset_addressed_code_sticks_at_edges() {
+    const char *code = "+[>+>++<<-]";
+    Engine engines[] = {execute_program, execute_program_threaded, execute_program_jit};
+    int i;
+    for (i = 0; i < 3; i++) {
+        SystemMemory *mem = create_test_memory(10, 0);
+        memset(mem->tape, 0, 10);
+        CU_ASSERT_EQUAL(0, execute_code_with_engine(code, strlen(code), mem, engines[i]));
+        CU_ASSERT_EQUAL(1, mem->tape[1]);
+        CU_ASSERT_EQUAL(2, mem->tape[2]);
+        free_mem(mem);
+        // on a 3-cell tape from the middle, the second ">" sticks at the edge
+        mem = create_test_memory(3, 1);
+        memset(mem->tape, 0, 3);
+        CU_ASSERT_EQUAL(0, execute_code_with_engine(code, strlen(code), mem, engines[i]));
+        CU_ASSERT_EQUAL(0, mem->curr_index);
+        CU_ASSERT_EQUAL(1, mem->tape[1]);
+        CU_ASSERT_EQUAL(3, mem->tape[2]);
+        free_mem(mem);
+    }
+}
+
+static void test_specialize_for_blank_tape_removes_dead_loops() {
+    // the comment loop and the "[-]" of a cell never written cannot run
+    Program *program = compile_program("[-.]+>[-]<.", 11);
+    optimize_program(program);
+    specialize_for_blank_tape(program, 10);
+    CU_ASSERT_EQUAL(4, program->num_ops);
+    CU_ASSERT_EQUAL(OP_ADD, program->ops[0].code);
+    CU_ASSERT_EQUAL(OP_MOVE_UNCHECKED, program->ops[1].code);
+    CU_ASSERT_EQUAL(OP_MOVE_UNCHECKED, program->ops[2].code);
+    CU_ASSERT_EQUAL(OP_OUTPUT, program->ops[3].code);
+    free_program(program);
+    // after a loop its cell is 0, so the second loop cannot run
+    program = compile_program("+[-.][.]", 8);
+    optimize_program(program);
+    specialize_for_blank_tape(program, 10);
+    CU_ASSERT_EQUAL(5, program->num_ops);
+    CU_ASSERT_EQUAL(OP_JUMP_IF_NOT_ZERO, program->ops[4].code);
+    CU_ASSERT_EQUAL(1, program->ops[4].jump);
+    free_program(program);
+}
+
+static void test_specialize_for_blank_tape_keeps_needed_checks() {
+    // "<" sticks at cell 0 and ">>>" reaches the end of a 3-cell tape
+    Program *program = compile_program("<.>>>.", 6);
+    optimize_program(program);
+    specialize_for_blank_tape(program, 3);
+    CU_ASSERT_EQUAL(OP_MOVE, program->ops[0].code);
+    CU_ASSERT_EQUAL(OP_MOVE, program->ops[2].code);
+    free_program(program);
+    // the loop moves the pointer right an unknown number of times
+    program = compile_program(",[>,]<", 6);
+    optimize_program(program);
+    specialize_for_blank_tape(program, 100);
+    CU_ASSERT_EQUAL(6, program->num_ops);
+    CU_ASSERT_EQUAL(OP_MOVE, program->ops[2].code);
+    CU_ASSERT_EQUAL(OP_MOVE, program->ops[5].code);
+    free_program(program);
+    // the offset code of ">+>+<<" fits on a blank tape, so its check goes
+    program = compile_program(">+>+<<", 6);
+    optimize_program(program);
+    specialize_for_blank_tape(program, 100);
+    CU_ASSERT_EQUAL(2, program->num_ops);
+    CU_ASSERT_EQUAL(OP_ADD, program->ops[0].code);
+    CU_ASSERT_EQUAL(2, program->ops[1].offset);
+    free_program(program);
+}
+
+static void test_blank_tape_specialization_keeps_results() {
+    const char *codes[] = {
+        "<<[.]+>>>>>[-]<[<]>[->+>+<<]+[>+++<-]>>>>>>>+[<]>[[-]>]",
+        "+>+>+[>>+<<-]>>>[<]>+++[>>>>>>>>>+<<<<<<<<<-]>>[-<+>]<[>>>+<<<-]<<[-]"
+    };
+    Engine engines[] = {execute_program, execute_program_threaded, execute_program_jit};
+    int sizes[] = {4, 12, 100};
+    int i, j, k;
+    for (i = 0; i < 2; i++) {
+        for (j = 0; j < 3; j++) {
+            for (k = 0; k < 3; k++) {
+                SystemMemory *blank = initialize_memory_with_size(sizes[k]);
+                SystemMemory *unknown = initialize_memory_with_size(sizes[k]);
+                unknown->blank = 0;
+                CU_ASSERT_EQUAL(0, execute_code_with_engine(codes[i], strlen(codes[i]),
+                                                            blank, engines[j]));
+                CU_ASSERT_EQUAL(0, execute_code_with_engine(codes[i], strlen(codes[i]),
+                                                            unknown, engines[j]));
+                CU_ASSERT_EQUAL(unknown->curr_index, blank->curr_index);
+                CU_ASSERT_EQUAL(0, memcmp(unknown->tape, blank->tape, sizes[k]));
+                CU_ASSERT_EQUAL(0, blank->blank);
+                free_mem(blank);
+                free_mem(unknown);
+            }
+        }
+    }
+}
+
+static void test_clear_range_loop_stops_at_negative_cell() {
+    SystemMemory *mem = create_test_memory(100, 10);
+    memset(mem->tape, 5, 100);
+    mem->tape[14] = -1; // "[-]" never clears this cell
+    Program *program = compile_program("[[-]>]", 6);
+    recognize_loop_idioms(program);
+    CU_ASSERT_EQUAL(1, clear_range_loop(mem, program->ops, 0));
+    CU_ASSERT_EQUAL(14, mem->curr_index);
+    CU_ASSERT_EQUAL(0, mem->tape[13]);
+    CU_ASSERT_EQUAL(-1, mem->tape[14]);
+    free_mem(mem);
+    free_program(program);
 }
 
 static void test_stack_size(void) {
@@ -357,6 +1460,7 @@ static void test_stack_pop_three_items(void) {
 
 int main() {
     CU_pSuite interpreter_suite;
+    CU_pSuite optimizer_suite;
     CU_pSuite stack_suite;
 
     /* initialize the CUnit test registry */
@@ -364,11 +1468,15 @@ int main() {
 
     /* add a suite to the registry */
     interpreter_suite = CU_add_suite("Interpreter Suite", init_suite, clean_suite);
+    optimizer_suite = CU_add_suite("Optimizer Suite", init_suite, clean_suite);
     stack_suite = CU_add_suite("Stack Suite", init_suite, clean_suite);
 
     /* add tests to the interpreter suite */
     CU_add_test(interpreter_suite, "test_initialize_memory", test_initialize_memory);
     CU_add_test(interpreter_suite, "test_initialize_memory_has_blank_tape", test_initialize_memory_has_blank_tape);
+    CU_add_test(interpreter_suite, "test_initialize_memory_with_size", test_initialize_memory_with_size);
+    CU_add_test(interpreter_suite, "test_initialize_virtual_memory", test_initialize_virtual_memory);
+    CU_add_test(interpreter_suite, "test_virtual_tape_ends_at_guard_regions", test_virtual_tape_ends_at_guard_regions);
     CU_add_test(interpreter_suite, "test_move_memory_pointer_left", test_move_memory_pointer_left);
     CU_add_test(interpreter_suite, "test_move_memory_pointer_right", test_move_memory_pointer_right);
     CU_add_test(interpreter_suite, "test_move_memory_pointer_left_at_left_end_of_tape", test_move_memory_pointer_left_at_left_end_of_tape);
@@ -378,15 +1486,76 @@ int main() {
     CU_add_test(interpreter_suite, "test_decrement_memory_cell_value", test_decrement_memory_cell_value);
     CU_add_test(interpreter_suite, "test_decrement_memory_cell_value_stays_above_zero", test_decrement_memory_cell_value_stays_above_zero);
     CU_add_test(interpreter_suite, "test_output_current_cell_value", test_output_current_cell_value);
+    CU_add_test(interpreter_suite, "test_add_to_memory_cell_value", test_add_to_memory_cell_value);
+    CU_add_test(interpreter_suite, "test_add_to_memory_cell_value_saturates", test_add_to_memory_cell_value_saturates);
+    CU_add_test(interpreter_suite, "test_move_memory_pointer_sticks_at_edges", test_move_memory_pointer_sticks_at_edges);
+    CU_add_test(interpreter_suite, "test_compile_program_folds_runs", test_compile_program_folds_runs);
+    CU_add_test(interpreter_suite, "test_compile_program_matches_brackets", test_compile_program_matches_brackets);
+    CU_add_test(interpreter_suite, "test_compile_program_no_matching_right_bracket", test_compile_program_no_matching_right_bracket);
+    CU_add_test(interpreter_suite, "test_compile_program_no_matching_left_bracket", test_compile_program_no_matching_left_bracket);
     CU_add_test(interpreter_suite, "test_conditional_loop_entry_enter_loop", test_conditional_loop_entry_enter_loop);
-    CU_add_test(interpreter_suite, "test_conditional_loop_entry_skip_loop_no_matching_right_bracket", test_conditional_loop_entry_skip_loop_no_matching_right_bracket);
-    CU_add_test(interpreter_suite, "test_conditional_loop_entry_skip_loop_has_matching_right_bracket", test_conditional_loop_entry_skip_loop_has_matching_right_bracket);
-    CU_add_test(interpreter_suite, "test_conditional_loop_entry_nested_loop_skip_no_matching_right_bracket", test_conditional_loop_entry_nested_loop_skip_no_matching_right_bracket);
-    CU_add_test(interpreter_suite, "test_conditional_loop_entry_nested_loop_skip_has_matching_right_bracket", test_conditional_loop_entry_nested_loop_skip_has_matching_right_bracket);
-    CU_add_test(interpreter_suite, "test_conditional_continue_restart_loop_no_matching_left_bracket", test_conditional_continue_restart_loop_no_matching_left_bracket);
-    CU_add_test(interpreter_suite, "test_conditional_continue_restart_loop_has_matching_left_bracket", test_conditional_continue_restart_loop_has_matching_left_bracket);
-    CU_add_test(interpreter_suite, "test_conditional_continue_end_loop_has_matching_left_bracket", test_conditional_continue_end_loop_has_matching_left_bracket);
-    CU_add_test(interpreter_suite, "test_conditional_continue_end_loop_no_matching_left_bracket", test_conditional_continue_end_loop_no_matching_left_bracket);
+    CU_add_test(interpreter_suite, "test_conditional_loop_entry_skip_loop", test_conditional_loop_entry_skip_loop);
+    CU_add_test(interpreter_suite, "test_conditional_loop_entry_nested_loop_skip", test_conditional_loop_entry_nested_loop_skip);
+    CU_add_test(interpreter_suite, "test_conditional_continue_restart_loop", test_conditional_continue_restart_loop);
+    CU_add_test(interpreter_suite, "test_conditional_continue_end_loop", test_conditional_continue_end_loop);
+    CU_add_test(interpreter_suite, "test_execute_code_unmatched_bracket_runs_nothing", test_execute_code_unmatched_bracket_runs_nothing);
+    CU_add_test(interpreter_suite, "test_execute_code_keeps_saturating_semantics", test_execute_code_keeps_saturating_semantics);
+    CU_add_test(interpreter_suite, "test_engines_leave_identical_memory", test_engines_leave_identical_memory);
+    CU_add_test(interpreter_suite, "test_engines_on_virtual_tape", test_engines_on_virtual_tape);
+    CU_add_test(interpreter_suite, "test_virtual_tape_overrun_in_skipped_loop", test_virtual_tape_overrun_in_skipped_loop);
+    CU_add_test(interpreter_suite, "test_execute_program_with_fuel_in_turns", test_execute_program_with_fuel_in_turns);
+    CU_add_test(interpreter_suite, "test_tiered_engine_compiles_hot_loops", test_tiered_engine_compiles_hot_loops);
+    CU_add_test(interpreter_suite, "test_find_engine", test_find_engine);
+    CU_add_test(interpreter_suite, "test_find_cell_model", test_find_cell_model);
+    CU_add_test(interpreter_suite, "test_wrapping_cell_models", test_wrapping_cell_models);
+    CU_add_test(interpreter_suite, "test_checked_cell_model_stops_on_overflow", test_checked_cell_model_stops_on_overflow);
+    CU_add_test(interpreter_suite, "test_jit_calls_io_callbacks", test_jit_calls_io_callbacks);
+    CU_add_test(interpreter_suite, "test_translate_to_c", test_translate_to_c);
+    CU_add_test(interpreter_suite, "test_hash_source", test_hash_source);
+    CU_add_test(interpreter_suite, "test_parse_flush_policy", test_parse_flush_policy);
+    CU_add_test(interpreter_suite, "test_load_source", test_load_source);
+    CU_add_test(interpreter_suite, "test_bf_compile_reports_unbalanced_brackets", test_bf_compile_reports_unbalanced_brackets);
+    CU_add_test(interpreter_suite, "test_bf_run_reuses_context", test_bf_run_reuses_context);
+    CU_add_test(interpreter_suite, "test_bf_run_reports_full_output", test_bf_run_reports_full_output);
+    CU_add_test(interpreter_suite, "test_run_batch", test_run_batch);
+    CU_add_test(interpreter_suite, "test_run_green_threads", test_run_green_threads);
+    CU_add_test(interpreter_suite, "test_bf_task_waits_for_streamed_input",
+                test_bf_task_waits_for_streamed_input);
+    CU_add_test(interpreter_suite, "test_green_threads_wait_for_input",
+                test_green_threads_wait_for_input);
+    CU_add_test(interpreter_suite, "test_bf_run_streaming", test_bf_run_streaming);
+    CU_add_test(interpreter_suite, "test_evaluate_prefix", test_evaluate_prefix);
+    CU_add_test(interpreter_suite, "test_evaluate_prefix_keeps_unfinished_loops", test_evaluate_prefix_keeps_unfinished_loops);
+    CU_add_test(interpreter_suite, "test_bf_run_starts_from_snapshot", test_bf_run_starts_from_snapshot);
+    CU_add_test(interpreter_suite, "test_execute_program_profiled", test_execute_program_profiled);
+    CU_add_test(interpreter_suite, "test_checkpoint_round_trip", test_checkpoint_round_trip);
+    CU_add_test(interpreter_suite, "test_execute_code_resumes_checkpoint",
+                test_execute_code_resumes_checkpoint);
+    CU_add_test(interpreter_suite, "test_checkpointed_runs_match_engines",
+                test_checkpointed_runs_match_engines);
+    CU_add_test(interpreter_suite, "test_compiled_file_round_trip", test_compiled_file_round_trip);
+    CU_add_test(interpreter_suite, "test_execute_compiled_file", test_execute_compiled_file);
+    CU_add_test(interpreter_suite, "test_perf_counters_count_or_fall_back", test_perf_counters_count_or_fall_back);
+    CU_add_test(interpreter_suite, "test_program_cache_evicts_least_recently_used", test_program_cache_evicts_least_recently_used);
+
+    /* add tests to the optimizer suite */
+    CU_add_test(optimizer_suite, "test_set_zero_loop", test_set_zero_loop);
+    CU_add_test(optimizer_suite, "test_scan_loop", test_scan_loop);
+    CU_add_test(optimizer_suite, "test_scan_loop_stops_before_tape_edge", test_scan_loop_stops_before_tape_edge);
+    CU_add_test(optimizer_suite, "test_recognize_multiply_loop", test_recognize_multiply_loop);
+    CU_add_test(optimizer_suite, "test_recognize_multiply_loop_rejects_other_loops", test_recognize_multiply_loop_rejects_other_loops);
+    CU_add_test(optimizer_suite, "test_multiply_loop_saturates", test_multiply_loop_saturates);
+    CU_add_test(optimizer_suite, "test_multiply_loop_at_tape_edge_falls_back", test_multiply_loop_at_tape_edge_falls_back);
+    CU_add_test(optimizer_suite, "test_find_zero_cell_matches_single_steps", test_find_zero_cell_matches_single_steps);
+    CU_add_test(optimizer_suite, "test_find_non_positive_cell", test_find_non_positive_cell);
+    CU_add_test(optimizer_suite, "test_clear_range_loop", test_clear_range_loop);
+    CU_add_test(optimizer_suite, "test_clear_range_loop_stops_at_negative_cell", test_clear_range_loop_stops_at_negative_cell);
+    CU_add_test(optimizer_suite, "test_use_unchecked_moves", test_use_unchecked_moves);
+    CU_add_test(optimizer_suite, "test_address_cells_by_offset", test_address_cells_by_offset);
+    CU_add_test(optimizer_suite, "test_offset_addressed_code_sticks_at_edges", test_offset_addressed_code_sticks_at_edges);
+    CU_add_test(optimizer_suite, "test_specialize_for_blank_tape_removes_dead_loops", test_specialize_for_blank_tape_removes_dead_loops);
+    CU_add_test(optimizer_suite, "test_specialize_for_blank_tape_keeps_needed_checks", test_specialize_for_blank_tape_keeps_needed_checks);
+    CU_add_test(optimizer_suite, "test_blank_tape_specialization_keeps_results", test_blank_tape_specialization_keeps_results);
     
     /* add tests to the stack suite */
     CU_add_test(stack_suite, "test_stack_size", test_stack_size);
@@ -0,0 +1,154 @@
+/*
+ * Buffered program input and output. Output bytes collect in a large buffer
+ * that is written with one write(2) when it fills up, at a newline (depending on
+ * the flush policy) or when io_flush() is called at the end of a program. Input
+ * is read from stdin in large blocks with read(2). This replaces a printf() or
+ * getchar() call (with its format parsing and stream locking) per byte.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "io.h"
+
+#define IO_BUFFER_SIZE 65536
+
+static char output_buffer[IO_BUFFER_SIZE];
+static int output_length = 0;
+static int flush_on_newline = -1; // -1 until the policy is resolved
+
+static char input_buffer[IO_BUFFER_SIZE];
+static int input_position = 0;
+static int input_length = 0;
+static int input_at_eof = 0;
+static long input_bytes_read = 0; // returned by io_read_byte(), for checkpoints
+
+/*
+ * Sets policy to the flush policy called name ("auto", "line" or "full").
+ * Returns 0 on success, or -1 if there is no such policy.
+ */
+int parse_flush_policy(const char *name, FlushPolicy *policy) {
+    if (strcmp(name, "auto") == 0) {
+        *policy = FLUSH_AUTO;
+    } else if (strcmp(name, "line") == 0) {
+        *policy = FLUSH_LINE;
+    } else if (strcmp(name, "full") == 0) {
+        *policy = FLUSH_FULL;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Chooses when buffered output is written. The default is FLUSH_AUTO.
+ */
+void io_set_flush_policy(FlushPolicy policy) {
+    if (policy == FLUSH_AUTO) {
+        flush_on_newline = isatty(STDOUT_FILENO);
+    } else {
+        flush_on_newline = policy == FLUSH_LINE;
+    }
+}
+
+/*
+ * Writes all buffered output to stdout, using only async-signal-safe calls.
+ */
+void io_flush_signal_safe() {
+    int written = 0;
+    while (written < output_length) {
+        ssize_t result = write(STDOUT_FILENO, output_buffer + written,
+                               output_length - written);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            break; // nowhere to write to (e.g. a closed pipe): drop the output
+        }
+        written += result;
+    }
+    output_length = 0;
+}
+
+/*
+ * Writes all buffered output to stdout.
+ */
+void io_flush() {
+    // anything already sitting in stdio's buffer was printed first
+    fflush(stdout);
+    io_flush_signal_safe();
+}
+
+/*
+ * Adds a byte to the output.
+ */
+void io_write_byte(char byte) {
+    if (flush_on_newline == -1) {
+        io_set_flush_policy(FLUSH_AUTO);
+    }
+    output_buffer[output_length++] = byte;
+    if (output_length == IO_BUFFER_SIZE || (byte == '\n' && flush_on_newline)) {
+        io_flush();
+    }
+}
+
+/*
+ * Returns the next byte of input, or EOF once stdin is exhausted.
+ */
+int io_read_byte() {
+    if (input_position == input_length) {
+        if (input_at_eof) {
+            return EOF;
+        }
+        // an interactive program's prompt must be visible before it blocks
+        io_flush();
+        ssize_t result;
+        do {
+            result = read(STDIN_FILENO, input_buffer, IO_BUFFER_SIZE);
+        } while (result < 0 && errno == EINTR);
+        if (result <= 0) {
+            input_at_eof = 1;
+            return EOF;
+        }
+        input_position = 0;
+        input_length = result;
+    }
+    input_bytes_read++;
+    return (unsigned char) input_buffer[input_position++];
+}
+
+/*
+ * Returns the number of bytes io_read_byte() has returned so far.
+ */
+long io_input_bytes_read() {
+    return input_bytes_read;
+}
+
+/*
+ * Appends byte to the caller's output buffer. When the buffer is full, it is
+ * handed to the caller's flush_output function and emptied, or, without one,
+ * the byte is dropped and the buffer is marked as overflowed.
+ */
+void io_buffers_write(IoBuffers *buffers, char byte) {
+    if (buffers->output_length == buffers->output_capacity) {
+        if (buffers->flush_output == NULL) {
+            buffers->output_overflowed = 1;
+            return;
+        }
+        buffers->flush_output(buffers->flush_target, buffers->output,
+                              buffers->output_length);
+        buffers->output_length = 0;
+    }
+    buffers->output[buffers->output_length++] = byte;
+}
+
+/*
+ * Returns the next byte of the caller's input buffer, or EOF (-1) at its end.
+ */
+int io_buffers_read(IoBuffers *buffers) {
+    if (buffers->input_position == buffers->input_length) {
+        return EOF;
+    }
+    return (unsigned char) buffers->input[buffers->input_position++];
+}
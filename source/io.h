@@ -0,0 +1,46 @@
+#ifndef IO_HEADER
+#define IO_HEADER
+
+typedef enum {
+    FLUSH_AUTO, // FLUSH_LINE when stdout is a terminal, FLUSH_FULL otherwise
+    FLUSH_LINE, // flush after every newline
+    FLUSH_FULL  // flush only when the buffer is full or the program ends
+} FlushPolicy;
+
+/*
+ * Caller-supplied input and output for one run of a program, used instead of
+ * stdin and stdout (see bf_run()).
+ */
+typedef struct {
+    const char *input;
+    long input_length;
+    long input_position;
+    char *output;
+    long output_capacity;
+    long output_length;
+    int output_overflowed; // set when output did not fit and was dropped
+    // if set, called with the full output buffer instead of dropping output
+    void (*flush_output)(void *target, const char *data, long length);
+    void *flush_target;
+    int input_open; // more input may be added: "," then waits for it instead of reading EOF
+} IoBuffers;
+
+int parse_flush_policy(const char *name, FlushPolicy *policy);
+
+void io_set_flush_policy(FlushPolicy policy);
+
+void io_write_byte(char byte);
+
+int io_read_byte();
+
+long io_input_bytes_read();
+
+void io_flush();
+
+void io_flush_signal_safe();
+
+void io_buffers_write(IoBuffers *buffers, char byte);
+
+int io_buffers_read(IoBuffers *buffers);
+
+#endif
@@ -0,0 +1,435 @@
+/*
+ * A just-in-time compiler from compiled Programs to x86-64 machine code. The
+ * code is written into an anonymous mapping that is made executable (and no
+ * longer writable) before it is called. "+", "-", ">", "<" and the brackets are
+ * translated into inline instructions with exactly the interpreter's semantics;
+ * recognized loops call the interpreter's helpers (scan_loop() and friends) and
+ * "." and "," call back into C. On other architectures execute_program_jit()
+ * runs the switch interpreter instead.
+ *
+ * Register use in the generated code:
+ *   rbx  mem->tape
+ *   r12  mem->curr_index
+ *   r13  mem->tape_size - 1
+ *   r14  mem
+ */
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "jit.h"
+
+#if defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#define HAVE_JIT
+#endif
+
+struct JitCode {
+    unsigned char *code;
+    size_t size;
+    void (*entry)(SystemMemory *mem);
+};
+
+#ifdef HAVE_JIT
+
+#define MAX_OP_SIZE 64 // upper bound on the bytes emitted for one instruction
+#define PROLOGUE_SIZE 32
+#define EPILOGUE_SIZE 16
+
+typedef struct {
+    unsigned char *code;
+    size_t size;
+} CodeBuffer;
+
+// a rel32 operand that must be pointed at the start of an instruction
+typedef struct {
+    size_t position;
+    int target_op;
+} JumpPatch;
+
+static void emit_bytes(CodeBuffer *buffer, const unsigned char *bytes, int count) {
+    memcpy(buffer->code + buffer->size, bytes, count);
+    buffer->size += count;
+}
+
+static void emit_u8(CodeBuffer *buffer, unsigned char byte) {
+    buffer->code[buffer->size++] = byte;
+}
+
+static void emit_u32(CodeBuffer *buffer, unsigned int value) {
+    memcpy(buffer->code + buffer->size, &value, 4);
+    buffer->size += 4;
+}
+
+static void emit_u64(CodeBuffer *buffer, unsigned long value) {
+    memcpy(buffer->code + buffer->size, &value, 8);
+    buffer->size += 8;
+}
+
+/*
+ * Emits a rel32 jump (opcode bytes given) to the start of instruction
+ * target_op, to be patched once every instruction's address is known.
+ */
+static void emit_jump(CodeBuffer *buffer, const unsigned char *opcode,
+                      int opcode_size, int target_op, JumpPatch *patches,
+                      int *num_patches) {
+    emit_bytes(buffer, opcode, opcode_size);
+    patches[*num_patches].position = buffer->size;
+    patches[*num_patches].target_op = target_op;
+    *num_patches += 1;
+    emit_u32(buffer, 0);
+}
+
+static void emit_store_index(CodeBuffer *buffer) {
+    // mov [r14 + curr_index], r12d
+    emit_bytes(buffer, (unsigned char[]) {0x45, 0x89, 0x66}, 3);
+    emit_u8(buffer, offsetof(SystemMemory, curr_index));
+}
+
+static void emit_load_index(CodeBuffer *buffer) {
+    // movsxd r12, [r14 + curr_index] (negative after an unchecked move off the tape)
+    emit_bytes(buffer, (unsigned char[]) {0x4D, 0x63, 0x66}, 3);
+    emit_u8(buffer, offsetof(SystemMemory, curr_index));
+}
+
+/*
+ * Emits a call to function(mem, second_arg, third_arg) with the pointer
+ * written back to mem first and reloaded afterwards.
+ */
+static void emit_call(CodeBuffer *buffer, void *function, const void *second_arg,
+                      int third_arg) {
+    emit_store_index(buffer);
+    emit_bytes(buffer, (unsigned char[]) {0x4C, 0x89, 0xF7}, 3); // mov rdi, r14
+    emit_bytes(buffer, (unsigned char[]) {0x48, 0xBE}, 2);       // mov rsi, imm64
+    emit_u64(buffer, (unsigned long) second_arg);
+    emit_u8(buffer, 0xBA);                                       // mov edx, imm32
+    emit_u32(buffer, third_arg);
+    emit_bytes(buffer, (unsigned char[]) {0x48, 0xB8}, 2);       // mov rax, imm64
+    emit_u64(buffer, (unsigned long) function);
+    emit_bytes(buffer, (unsigned char[]) {0xFF, 0xD0}, 2);       // call rax
+    emit_load_index(buffer);
+}
+
+/*
+ * Emits the opcode bytes (with their REX prefix) of an instruction whose memory
+ * operand is the cell offset cells from the pointer, [rbx + r12 + offset], with
+ * al or eax as the register operand.
+ */
+static void emit_cell_operand(CodeBuffer *buffer, const unsigned char *opcode,
+                              int opcode_size, int offset) {
+    emit_u8(buffer, 0x42);                                     // REX.X (r12 as index)
+    emit_bytes(buffer, opcode, opcode_size);
+    if (offset == 0) {
+        emit_bytes(buffer, (unsigned char[]) {0x04, 0x23}, 2); // [rbx + r12]
+    } else {
+        emit_bytes(buffer, (unsigned char[]) {0x84, 0x23}, 2); // [rbx + r12 + disp32]
+        emit_u32(buffer, offset);
+    }
+}
+
+/*
+ * Emits the code for a saturating OP_ADD: the same result as
+ * add_to_memory_cell_at_offset().
+ */
+static void emit_add(CodeBuffer *buffer, int amount, int offset) {
+    // any amount beyond 255 saturates exactly like 255 does
+    amount = amount > 255 ? 255 : (amount < -255 ? -255 : amount);
+    emit_cell_operand(buffer, (unsigned char[]) {0x0F, 0xBE}, 2, offset); // movsx eax, byte [cell]
+    if (amount > 0) {
+        emit_u8(buffer, 0x05);                                 // add eax, amount
+        emit_u32(buffer, amount);
+        emit_u8(buffer, 0x3D);                                 // cmp eax, 127
+        emit_u32(buffer, 127);
+        emit_u8(buffer, 0xB9);                                 // mov ecx, 127
+        emit_u32(buffer, 127);
+        emit_bytes(buffer, (unsigned char[]) {0x0F, 0x4F, 0xC1}, 3); // cmovg eax, ecx
+        emit_cell_operand(buffer, (unsigned char[]) {0x88}, 1, offset); // mov [cell], al
+    } else {
+        // cells at 0 or below are never decremented: skip the 12 bytes below and
+        // the store
+        emit_bytes(buffer, (unsigned char[]) {0x85, 0xC0, 0x7E}, 3); // test eax, eax; jle
+        emit_u8(buffer, 12 + (offset == 0 ? 4 : 8));
+        emit_u8(buffer, 0x2D);                                 // sub eax, -amount
+        emit_u32(buffer, -amount);
+        emit_bytes(buffer, (unsigned char[]) {0x31, 0xC9}, 2); // xor ecx, ecx
+        emit_bytes(buffer, (unsigned char[]) {0x85, 0xC0}, 2); // test eax, eax
+        emit_bytes(buffer, (unsigned char[]) {0x0F, 0x48, 0xC1}, 3); // cmovs eax, ecx
+        emit_cell_operand(buffer, (unsigned char[]) {0x88}, 1, offset); // mov [cell], al
+    }
+}
+
+/*
+ * Emits the code for OP_MOVE: the same result as move_memory_pointer().
+ */
+static void emit_move(CodeBuffer *buffer, int distance) {
+    emit_bytes(buffer, (unsigned char[]) {0x4C, 0x89, 0xE0}, 3); // mov rax, r12
+    emit_bytes(buffer, (unsigned char[]) {0x48, 0x05}, 2);       // add rax, distance
+    emit_u32(buffer, distance);
+    if (distance > 0) {
+        emit_bytes(buffer, (unsigned char[]) {0x4C, 0x39, 0xE8}, 3);       // cmp rax, r13
+        emit_bytes(buffer, (unsigned char[]) {0x49, 0x0F, 0x47, 0xC5}, 4); // cmova rax, r13
+    } else {
+        emit_bytes(buffer, (unsigned char[]) {0x31, 0xC9}, 2);             // xor ecx, ecx
+        emit_bytes(buffer, (unsigned char[]) {0x48, 0x85, 0xC0}, 3);       // test rax, rax
+        emit_bytes(buffer, (unsigned char[]) {0x48, 0x0F, 0x48, 0xC1}, 4); // cmovs rax, rcx
+    }
+    emit_bytes(buffer, (unsigned char[]) {0x49, 0x89, 0xC4}, 3); // mov r12, rax
+}
+
+/*
+ * Emits a call to one of the interpreter's loop helpers, which return either
+ * op_index + 1 (enter the loop body) or the index after the loop.
+ */
+static void emit_loop_helper(CodeBuffer *buffer, void *helper, const void *second_arg,
+                             int op_index, int loop_end, JumpPatch *patches,
+                             int *num_patches) {
+    emit_call(buffer, helper, second_arg, op_index);
+    emit_u8(buffer, 0x3D);                                      // cmp eax, op_index + 1
+    emit_u32(buffer, op_index + 1);
+    emit_jump(buffer, (unsigned char[]) {0x0F, 0x85}, 2, loop_end + 1,
+              patches, num_patches);                            // jne after the loop
+}
+
+/*
+ * Translates the instructions of program from first up to (not including) end
+ * into machine code that starts at first and returns when it reaches end. "."
+ * and "," call output and input. Returns NULL if executable memory cannot be
+ * allocated, or if some instruction in the range jumps outside of it.
+ */
+JitCode *jit_compile_range(const Program *program, int first, int end,
+                           CellCallback output, CellCallback input) {
+    int i;
+    int num_ops = end - first;
+    size_t capacity = PROLOGUE_SIZE + EPILOGUE_SIZE
+                      + (size_t) MAX_OP_SIZE * num_ops;
+    unsigned char *code = mmap(NULL, capacity, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) {
+        return NULL;
+    }
+    CodeBuffer buffer = {code, 0};
+    // indexed from first
+    size_t *op_addresses = malloc(sizeof(size_t) * (num_ops + 1));
+    // at most two jumps per instruction
+    JumpPatch *patches = malloc(sizeof(JumpPatch) * (2 * num_ops + 1));
+    int num_patches = 0;
+
+    // push rbx, r12, r13, r14, r15 (leaves the stack 16-byte aligned for calls)
+    emit_bytes(&buffer, (unsigned char[]) {0x53, 0x41, 0x54, 0x41, 0x55,
+                                           0x41, 0x56, 0x41, 0x57}, 9);
+    emit_bytes(&buffer, (unsigned char[]) {0x49, 0x89, 0xFE}, 3);       // mov r14, rdi
+    emit_bytes(&buffer, (unsigned char[]) {0x49, 0x8B, 0x1E}, 3);       // mov rbx, [r14 + tape]
+    emit_load_index(&buffer);
+    emit_bytes(&buffer, (unsigned char[]) {0x4D, 0x63, 0x6E}, 3);       // movsxd r13, [r14 + tape_size]
+    emit_u8(&buffer, offsetof(SystemMemory, tape_size));
+    emit_bytes(&buffer, (unsigned char[]) {0x49, 0xFF, 0xCD}, 3);       // dec r13
+
+    for (i = first; i < end; i++) {
+        const Instruction *op = &program->ops[i];
+        op_addresses[i - first] = buffer.size;
+        switch (op->code) {
+            case OP_ADD:
+                emit_add(&buffer, op->arg, op->offset);
+                break;
+            case OP_MOVE:
+                emit_move(&buffer, op->arg);
+                break;
+            case OP_MOVE_UNCHECKED:
+                emit_bytes(&buffer, (unsigned char[]) {0x49, 0x81, 0xC4}, 3); // add r12, distance
+                emit_u32(&buffer, op->arg);
+                break;
+            case OP_OUTPUT:
+                emit_call(&buffer, output, NULL, 0);
+                break;
+            case OP_INPUT:
+                emit_call(&buffer, input, NULL, 0);
+                break;
+            case OP_JUMP_IF_ZERO:
+                emit_bytes(&buffer, (unsigned char[]) {0x42, 0x80, 0x3C, 0x23, 0x00}, 5); // cmp byte [rbx + r12], 0
+                emit_jump(&buffer, (unsigned char[]) {0x0F, 0x84}, 2, op->jump + 1,
+                          patches, &num_patches);               // je after the loop
+                break;
+            case OP_JUMP_IF_NOT_ZERO:
+                emit_bytes(&buffer, (unsigned char[]) {0x42, 0x80, 0x3C, 0x23, 0x00}, 5); // cmp byte [rbx + r12], 0
+                emit_jump(&buffer, (unsigned char[]) {0x0F, 0x85}, 2, op->jump + 1,
+                          patches, &num_patches);               // jne to the loop body
+                break;
+            case OP_SET_ZERO:
+                emit_loop_helper(&buffer, set_zero_loop, program->ops, i, op->jump,
+                                 patches, &num_patches);
+                break;
+            case OP_SCAN:
+                emit_loop_helper(&buffer, scan_loop, program->ops, i, op->jump,
+                                 patches, &num_patches);
+                break;
+            case OP_MULTIPLY_LOOP:
+                emit_loop_helper(&buffer, multiply_loop, program, i, op->jump,
+                                 patches, &num_patches);
+                break;
+            case OP_CLEAR_RANGE:
+                emit_loop_helper(&buffer, clear_range_loop, program->ops, i, op->jump,
+                                 patches, &num_patches);
+                break;
+            case OP_CHECK_RANGE:
+                emit_bytes(&buffer, (unsigned char[]) {0x4C, 0x89, 0xE0}, 3); // mov rax, r12
+                emit_bytes(&buffer, (unsigned char[]) {0x48, 0x05}, 2);       // add rax, offset
+                emit_u32(&buffer, op->offset);
+                emit_jump(&buffer, (unsigned char[]) {0x0F, 0x88}, 2, op->jump + 1,
+                          patches, &num_patches);               // js the original code
+                emit_bytes(&buffer, (unsigned char[]) {0x4C, 0x89, 0xE0}, 3); // mov rax, r12
+                emit_bytes(&buffer, (unsigned char[]) {0x48, 0x05}, 2);       // add rax, arg
+                emit_u32(&buffer, op->arg);
+                emit_bytes(&buffer, (unsigned char[]) {0x4C, 0x39, 0xE8}, 3); // cmp rax, r13
+                emit_jump(&buffer, (unsigned char[]) {0x0F, 0x8F}, 2, op->jump + 1,
+                          patches, &num_patches);               // jg the original code
+                break;
+            case OP_JUMP:
+                emit_jump(&buffer, (unsigned char[]) {0xE9}, 1, op->jump + 1,
+                          patches, &num_patches);               // jmp past the original code
+                break;
+        }
+    }
+    op_addresses[num_ops] = buffer.size;
+
+    emit_store_index(&buffer);
+    // pop r15, r14, r13, r12, rbx; ret
+    emit_bytes(&buffer, (unsigned char[]) {0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D,
+                                           0x41, 0x5C, 0x5B, 0xC3}, 10);
+
+    for (i = 0; i < num_patches; i++) {
+        int target = patches[i].target_op - first;
+        if (target < 0 || target > num_ops) {
+            break;
+        }
+        int relative = op_addresses[target] - (patches[i].position + 4);
+        memcpy(code + patches[i].position, &relative, 4);
+    }
+    free(op_addresses);
+    free(patches);
+    if (i < num_patches) {
+        munmap(code, capacity);
+        return NULL;
+    }
+
+    if (mprotect(code, capacity, PROT_READ | PROT_EXEC) != 0) {
+        munmap(code, capacity);
+        return NULL;
+    }
+    JitCode *jit_code = malloc(sizeof(JitCode));
+    jit_code->code = code;
+    jit_code->size = capacity;
+    jit_code->entry = (void (*)(SystemMemory *)) code;
+    return jit_code;
+}
+
+/*
+ * Translates program into machine code. "." and "," call output and input.
+ * Returns NULL if executable memory cannot be allocated.
+ */
+JitCode *jit_compile(const Program *program, CellCallback output,
+                     CellCallback input) {
+    return jit_compile_range(program, 0, program->num_ops, output, input);
+}
+
+/*
+ * Runs compiled code to completion using the provided SystemMemory.
+ */
+void jit_run(JitCode *jit_code, SystemMemory *mem) {
+    jit_code->entry(mem);
+}
+
+/*
+ * Releases compiled code.
+ */
+void jit_free(JitCode *jit_code) {
+    munmap(jit_code->code, jit_code->size);
+    free(jit_code);
+}
+
+#else
+
+JitCode *jit_compile_range(const Program *program, int first, int end,
+                           CellCallback output, CellCallback input) {
+    return NULL;
+}
+
+JitCode *jit_compile(const Program *program, CellCallback output,
+                     CellCallback input) {
+    return NULL;
+}
+
+void jit_run(JitCode *jit_code, SystemMemory *mem) {
+}
+
+void jit_free(JitCode *jit_code) {
+}
+
+#endif
+
+/*
+ * Executes a compiled program by translating it to machine code first. Falls
+ * back to execute_program() where the JIT is unavailable.
+ */
+int execute_program_jit(const Program *program, SystemMemory *mem) {
+    JitCode *jit_code = jit_compile(program, output_current_cell_value,
+                                    store_input_char_in_current_cell);
+    if (jit_code == NULL) {
+        return execute_program(program, mem);
+    }
+    jit_run(jit_code, mem);
+    jit_free(jit_code);
+    return 0;
+}
+
+/*
+ * Executes a compiled program in tiers: it starts in the switch interpreter,
+ * which costs nothing up front, and counts the times each loop's "]" jumps
+ * back to its start. A loop that reaches TIER_UP_ITERATIONS is compiled on its
+ * own (see jit_compile_range()) and the run moves into the compiled code right
+ * there, in the middle of the loop: at the jump back the loop's cell is
+ * nonzero, so entering at "[" is the same as continuing with the body. The
+ * compiled loop returns to the interpreter after its "]", and later entries
+ * into the loop run the compiled code from the start. Short programs never
+ * pay for compiling and hot loops run as native code.
+ */
+int execute_program_tiered(const Program *program, SystemMemory *mem) {
+    int curr_op_index = 0;
+    int i;
+    int *iterations = calloc(program->num_ops, sizeof(int));
+    // indexed by the first instruction of each compiled loop
+    JitCode **compiled = calloc(program->num_ops, sizeof(JitCode *));
+    if (iterations == NULL || compiled == NULL) {
+        free(iterations);
+        free(compiled);
+        return execute_program(program, mem);
+    }
+    while (curr_op_index < program->num_ops) {
+        if (compiled[curr_op_index] != NULL) {
+            jit_run(compiled[curr_op_index], mem);
+            curr_op_index = program->ops[curr_op_index].jump + 1;
+            continue;
+        }
+        int next_op_index = execute_instruction(mem, program, curr_op_index);
+        if (next_op_index <= curr_op_index) {
+            int loop = program->ops[curr_op_index].jump;
+            if (++iterations[loop] == TIER_UP_ITERATIONS) {
+                compiled[loop] = jit_compile_range(program, loop, curr_op_index + 1,
+                                                   output_current_cell_value,
+                                                   store_input_char_in_current_cell);
+            }
+            if (compiled[loop] != NULL) {
+                jit_run(compiled[loop], mem);
+                next_op_index = curr_op_index + 1;
+            }
+        }
+        curr_op_index = next_op_index;
+    }
+    for (i = 0; i < program->num_ops; i++) {
+        if (compiled[i] != NULL) {
+            jit_free(compiled[i]);
+        }
+    }
+    free(iterations);
+    free(compiled);
+    return 0;
+}
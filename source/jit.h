@@ -0,0 +1,29 @@
+#include "interpreter.h"
+
+#ifndef JIT_HEADER
+#define JIT_HEADER
+
+// called by compiled code for "." and ","; same contract as
+// output_current_cell_value() and store_input_char_in_current_cell()
+typedef int (*CellCallback)(SystemMemory *mem);
+
+typedef struct JitCode JitCode;
+
+// times a loop jumps back to its start before execute_program_tiered() compiles it
+#define TIER_UP_ITERATIONS 1000
+
+JitCode *jit_compile_range(const Program *program, int first, int end,
+                           CellCallback output, CellCallback input);
+
+JitCode *jit_compile(const Program *program, CellCallback output,
+                     CellCallback input);
+
+void jit_run(JitCode *jit_code, SystemMemory *mem);
+
+void jit_free(JitCode *jit_code);
+
+int execute_program_jit(const Program *program, SystemMemory *mem);
+
+int execute_program_tiered(const Program *program, SystemMemory *mem);
+
+#endif
@@ -0,0 +1,578 @@
+/*
+ * Optimization passes over a compiled Program. Every pass rewrites the program
+ * in place and keeps the interpreter's semantics exactly: cells saturate at 0
+ * and 127 and the pointer sticks at the ends of the tape.
+ */
+
+#include <stdlib.h>
+#include <limits.h>
+#include "optimizer.h"
+
+/*
+ * Appends a multiply target to the program's target table.
+ */
+static void add_target(Program *program, int offset, int factor) {
+    program->targets = realloc(program->targets,
+                               sizeof(MultiplyTarget) * (program->num_targets + 1));
+    program->targets[program->num_targets].offset = offset;
+    program->targets[program->num_targets].factor = factor;
+    program->num_targets += 1;
+}
+
+/*
+ * Returns 1 if the multiply targets from first_target onward already include
+ * offset.
+ */
+static int has_target(Program *program, int first_target, int offset) {
+    int i;
+    for (i = first_target; i < program->num_targets; i++) {
+        if (program->targets[i].offset == offset) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Checks whether the loop starting at loop_index is a multiply loop: a body of
+ * only OP_ADD and OP_MOVE that returns to where it started, decrements the loop
+ * counter by exactly one and adds to every other cell at most once. Such a loop
+ * runs counter-value times and can be replaced by one multiply-accumulate per
+ * target. The pointer must never go further than the outermost target, so that
+ * checking the targets against the tape edges is enough at run time. Returns 1
+ * and rewrites the loop if it matches.
+ */
+static int recognize_multiply_loop(Program *program, int loop_index) {
+    int i;
+    int loop_end = program->ops[loop_index].jump;
+    int first_target = program->num_targets;
+    int offset = 0;
+    int counter_seen = 0;
+    int min_visited = 0, max_visited = 0;
+    int min_target = 0, max_target = 0;
+    for (i = loop_index + 1; i < loop_end; i++) {
+        Instruction *op = &program->ops[i];
+        if (op->code == OP_MOVE) {
+            offset += op->arg;
+            min_visited = offset < min_visited ? offset : min_visited;
+            max_visited = offset > max_visited ? offset : max_visited;
+        } else if (op->code == OP_ADD && offset == 0) {
+            if (counter_seen || op->arg != -1) {
+                break;
+            }
+            counter_seen = 1;
+        } else if (op->code == OP_ADD && !has_target(program, first_target, offset)) {
+            add_target(program, offset, op->arg);
+            min_target = offset < min_target ? offset : min_target;
+            max_target = offset > max_target ? offset : max_target;
+        } else {
+            break;
+        }
+    }
+    if (i != loop_end || offset != 0 || !counter_seen
+            || min_visited < min_target || max_visited > max_target) {
+        program->num_targets = first_target; // forget this loop's targets
+        return 0;
+    }
+    program->ops[loop_index].code = OP_MULTIPLY_LOOP;
+    program->ops[loop_index].arg = program->num_targets - first_target;
+    program->ops[loop_index].offset = first_target;
+    return 1;
+}
+
+/*
+ * Returns 1 if the loop starting at loop_index is "[-]" (or "[---]") whether or
+ * not it has been recognized yet.
+ */
+static int is_clear_loop(Program *program, int loop_index) {
+    Instruction *op = &program->ops[loop_index];
+    return (op->code == OP_JUMP_IF_ZERO || op->code == OP_SET_ZERO)
+        && op->jump == loop_index + 2
+        && program->ops[loop_index + 1].code == OP_ADD
+        && program->ops[loop_index + 1].arg < 0;
+}
+
+/*
+ * Replaces common loops with dedicated instructions:
+ *   [-] [---] [+]        OP_SET_ZERO
+ *   [>] [<] [>>>>]       OP_SCAN
+ *   [->+<] [->++>+++<<]  OP_MULTIPLY_LOOP
+ *   [[-]>] [[-]<<]       OP_CLEAR_RANGE
+ * "[+]" is only recognized with a single "+": larger steps can jump over 0
+ * and end up stuck at 127.
+ */
+void recognize_loop_idioms(Program *program) {
+    int i;
+    for (i = 0; i < program->num_ops; i++) {
+        Instruction *op = &program->ops[i];
+        if (op->code != OP_JUMP_IF_ZERO) {
+            continue;
+        }
+        if (op->jump == i + 2) { // single-instruction body
+            Instruction *body = &program->ops[i + 1];
+            if (body->code == OP_ADD && (body->arg < 0 || body->arg == 1)) {
+                op->code = OP_SET_ZERO;
+                op->arg = body->arg;
+            } else if (body->code == OP_MOVE) {
+                op->code = OP_SCAN;
+                op->arg = body->arg;
+            }
+        } else if (op->jump == i + 5 && is_clear_loop(program, i + 1)
+                   && program->ops[i + 4].code == OP_MOVE) {
+            op->code = OP_CLEAR_RANGE;
+            op->arg = program->ops[i + 4].arg;
+        } else {
+            recognize_multiply_loop(program, i);
+        }
+    }
+}
+
+/*
+ * Appends count instructions from source to ops, recording their new indices
+ * in new_index.
+ */
+static int copy_ops(Instruction *ops, int num_ops, const Instruction *source,
+                    int first, int count, int *new_index) {
+    int i;
+    for (i = first; i < first + count; i++) {
+        new_index[i] = num_ops;
+        ops[num_ops++] = source[i];
+    }
+    return num_ops;
+}
+
+/*
+ * Rewrites runs of OP_ADD and OP_MOVE ("straight-line code") that move the
+ * pointer more than once: every OP_ADD addresses its cell at an offset from
+ * the pointer instead, and the pointer moves once, at the end. Sticking at a
+ * tape edge depends on every single move, so the rewritten run is guarded by an
+ * OP_CHECK_RANGE of the furthest cells it reaches and the original run is kept
+ * for when the pointer is that close to an edge:
+ *   >+>++<<-  =>  CHECK_RANGE(0, 2) ADD(1)@1 ADD(2)@2 ADD(-1)@0 JUMP  >+>++<<-
+ * The bodies of recognized loops are left alone, since they are only run when
+ * their shortcut does not apply.
+ */
+void address_cells_by_offset(Program *program) {
+    const Instruction *old_ops = program->ops;
+    int *new_index = malloc(sizeof(int) * (program->num_ops + 1));
+    // a rewritten run of n >= 2 instructions becomes at most 2n + 3 <= 4n
+    Instruction *ops = malloc(sizeof(Instruction) * (4 * program->num_ops + 1));
+    int num_ops = 0;
+    int i = 0, j;
+    while (i < program->num_ops) {
+        const Instruction *op = &old_ops[i];
+        if (is_loop_start(op->code) && op->code != OP_JUMP_IF_ZERO) {
+            num_ops = copy_ops(ops, num_ops, old_ops, i, op->jump + 1 - i, new_index);
+            i = op->jump + 1;
+            continue;
+        }
+        if (op->code != OP_ADD && op->code != OP_MOVE) {
+            num_ops = copy_ops(ops, num_ops, old_ops, i, 1, new_index);
+            i++;
+            continue;
+        }
+        int end = i;
+        int num_moves = 0;
+        long offset = 0, min_offset = 0, max_offset = 0;
+        for (; end < program->num_ops
+               && (old_ops[end].code == OP_ADD || old_ops[end].code == OP_MOVE); end++) {
+            if (old_ops[end].code == OP_MOVE) {
+                offset += old_ops[end].arg;
+                min_offset = offset < min_offset ? offset : min_offset;
+                max_offset = offset > max_offset ? offset : max_offset;
+                num_moves++;
+            }
+        }
+        // the check and the final move must cost less than the moves they replace
+        if (num_moves <= 1 + (offset != 0) || min_offset < INT_MIN / 2
+                || max_offset > INT_MAX / 2) {
+            num_ops = copy_ops(ops, num_ops, old_ops, i, end - i, new_index);
+            i = end;
+            continue;
+        }
+        int check = num_ops++;
+        ops[check] = *op;
+        ops[check].code = OP_CHECK_RANGE;
+        ops[check].offset = min_offset;
+        ops[check].arg = max_offset;
+        offset = 0;
+        for (j = i; j < end; j++) {
+            if (old_ops[j].code == OP_MOVE) {
+                offset += old_ops[j].arg;
+            } else {
+                ops[num_ops] = old_ops[j];
+                ops[num_ops++].offset = offset;
+            }
+        }
+        if (offset != 0) {
+            ops[num_ops] = old_ops[end - 1];
+            ops[num_ops].code = OP_MOVE_UNCHECKED;
+            ops[num_ops++].arg = offset;
+        }
+        int jump = num_ops++;
+        ops[jump] = old_ops[end - 1];
+        ops[jump].code = OP_JUMP;
+        ops[check].jump = jump;
+        num_ops = copy_ops(ops, num_ops, old_ops, i, end - i, new_index);
+        ops[jump].jump = num_ops - 1;
+        i = end;
+    }
+    for (i = 0; i < num_ops; i++) {
+        if (is_loop_start(ops[i].code) || ops[i].code == OP_JUMP_IF_NOT_ZERO) {
+            ops[i].jump = new_index[ops[i].jump];
+        }
+    }
+    free(program->ops);
+    free(new_index);
+    program->ops = ops;
+    program->num_ops = num_ops;
+}
+
+#define TRACKED_CELLS 256      // cells whose values the analysis follows one by one
+#define UNKNOWN_VALUE INT_MIN
+#define MAX_LOOP_ITERATIONS 4   // analyses of a loop body before giving up on precision
+#define MAX_LOOP_DEPTH 64       // deeper loops make the analysis give up
+#define ANALYSIS_BUDGET (1 << 24)
+
+/*
+ * What the analysis knows about the machine at one point of the program: the
+ * pointer is in low..high, and the first TRACKED_CELLS cells hold the known
+ * values (or UNKNOWN_VALUE). Cells after those are 0 until rest_unknown.
+ */
+typedef struct {
+    long low, high;
+    int values[TRACKED_CELLS];
+    int rest_unknown;
+} TapeState;
+
+typedef struct {
+    const Program *program;
+    long last_index;
+    char *visited;
+    char *needed;  // a visit found the check (or loop) at this instruction could matter
+    long budget;   // instructions left to analyze before giving up
+} Analysis;
+
+static int cell_value(const TapeState *state, long index) {
+    if (index < TRACKED_CELLS) {
+        return state->values[index];
+    }
+    return state->rest_unknown ? UNKNOWN_VALUE : 0;
+}
+
+/*
+ * Returns the value every cell in low..high is known to hold, or UNKNOWN_VALUE.
+ */
+static int common_value(const TapeState *state, long low, long high) {
+    int value = cell_value(state, low);
+    long i;
+    for (i = low + 1; i <= high && i < TRACKED_CELLS; i++) {
+        if (state->values[i] != value) {
+            return UNKNOWN_VALUE;
+        }
+    }
+    if (high >= TRACKED_CELLS && cell_value(state, TRACKED_CELLS) != value) {
+        return UNKNOWN_VALUE;
+    }
+    return value;
+}
+
+/*
+ * Records that one cell in low..high (the exact cell if low == high) now holds
+ * value, which may be UNKNOWN_VALUE.
+ */
+static void set_cells(TapeState *state, long low, long high, int value) {
+    long i;
+    for (i = low; i <= high && i < TRACKED_CELLS; i++) {
+        if (low == high || state->values[i] != value) {
+            state->values[i] = low == high ? value : UNKNOWN_VALUE;
+        }
+    }
+    if (high >= TRACKED_CELLS && value != 0) {
+        state->rest_unknown = 1;
+    }
+}
+
+static void forget_everything(TapeState *state, long last_index) {
+    int i;
+    state->low = 0;
+    state->high = last_index;
+    for (i = 0; i < TRACKED_CELLS; i++) {
+        state->values[i] = UNKNOWN_VALUE;
+    }
+    state->rest_unknown = 1;
+}
+
+/*
+ * Widens state to also cover other. Returns 1 if state changed.
+ */
+static int join_states(TapeState *state, const TapeState *other) {
+    int changed = 0;
+    int i;
+    if (other->low < state->low) {
+        state->low = other->low;
+        changed = 1;
+    }
+    if (other->high > state->high) {
+        state->high = other->high;
+        changed = 1;
+    }
+    for (i = 0; i < TRACKED_CELLS; i++) {
+        if (state->values[i] != other->values[i] && state->values[i] != UNKNOWN_VALUE) {
+            state->values[i] = UNKNOWN_VALUE;
+            changed = 1;
+        }
+    }
+    if (other->rest_unknown && !state->rest_unknown) {
+        state->rest_unknown = 1;
+        changed = 1;
+    }
+    return changed;
+}
+
+/*
+ * Moves the pointer by distance. Returns 1 if the move might hit a tape edge.
+ */
+static int move_pointer(TapeState *state, long distance, long last_index) {
+    long low = state->low + distance, high = state->high + distance;
+    state->low = low < 0 ? 0 : (low > last_index ? last_index : low);
+    state->high = high < 0 ? 0 : (high > last_index ? last_index : high);
+    return low < 0 || high > last_index;
+}
+
+static void analyze_ops(Analysis *analysis, int first, int end, TapeState *state,
+                        int depth);
+
+/*
+ * Analyzes the loop from loop_index to its closing bracket, entered in state,
+ * and leaves state as it is after the loop. The body is analyzed again from the
+ * joined states of every iteration until nothing changes.
+ */
+static void analyze_loop(Analysis *analysis, int loop_index, TapeState *state,
+                         int depth) {
+    int loop_end = analysis->program->ops[loop_index].jump;
+    TapeState body;
+    int iteration;
+    if (depth == MAX_LOOP_DEPTH) {
+        analysis->budget = 0;
+        return;
+    }
+    for (iteration = 0; analysis->budget > 0; iteration++) {
+        if (iteration == MAX_LOOP_ITERATIONS) {
+            forget_everything(state, analysis->last_index);
+        }
+        body = *state;
+        analyze_ops(analysis, loop_index + 1, loop_end, &body, depth + 1);
+        long low = state->low, high = state->high;
+        if (!join_states(state, &body)) {
+            break;
+        }
+        // a pointer that keeps moving in one direction can reach that edge
+        state->low = state->low < low ? 0 : state->low;
+        state->high = state->high > high ? analysis->last_index : state->high;
+    }
+    set_cells(state, state->low, state->high, 0);
+}
+
+/*
+ * Analyzes the instructions from first up to (not including) end, starting
+ * in state, and leaves state as it is after them.
+ */
+static void analyze_ops(Analysis *analysis, int first, int end, TapeState *state,
+                        int depth) {
+    const Program *program = analysis->program;
+    long last_index = analysis->last_index;
+    int i = first;
+    while (i < end && analysis->budget-- > 0) {
+        const Instruction *op = &program->ops[i];
+        int next = i + 1;
+        long low = state->low + op->offset, high = state->high + op->offset;
+        analysis->visited[i] = 1;
+        if (is_loop_start(op->code)) {
+            next = op->jump + 1;
+            if (common_value(state, state->low, state->high) == 0) {
+                i = next;
+                continue;
+            }
+            analysis->needed[i] = 1;
+        }
+        switch (op->code) {
+            case OP_ADD: {
+                int value = cell_value(state, low);
+                if (low != high || value == UNKNOWN_VALUE || value + op->arg < 0
+                        || value + op->arg > 127) {
+                    set_cells(state, low, high, UNKNOWN_VALUE);
+                } else {
+                    set_cells(state, low, low, value + op->arg);
+                }
+                break;
+            }
+            case OP_MOVE:
+                if (move_pointer(state, op->arg, last_index)) {
+                    analysis->needed[i] = 1;
+                }
+                break;
+            case OP_MOVE_UNCHECKED:
+                move_pointer(state, op->arg, last_index);
+                break;
+            case OP_INPUT:
+                set_cells(state, state->low, state->high, UNKNOWN_VALUE);
+                break;
+            case OP_JUMP_IF_ZERO:
+                analyze_loop(analysis, i, state, depth);
+                break;
+            case OP_SET_ZERO:
+                set_cells(state, state->low, state->high, 0);
+                break;
+            case OP_SCAN:
+            case OP_CLEAR_RANGE:
+                // ends at some zero cell in the direction it moves
+                if (op->arg > 0) {
+                    state->high = last_index;
+                } else {
+                    state->low = 0;
+                }
+                if (op->code == OP_CLEAR_RANGE) {
+                    set_cells(state, state->low, state->high, UNKNOWN_VALUE);
+                }
+                break;
+            case OP_MULTIPLY_LOOP: {
+                long min_target = 0, max_target = 0;
+                int j;
+                for (j = op->offset; j < op->offset + op->arg; j++) {
+                    long offset = program->targets[j].offset;
+                    min_target = offset < min_target ? offset : min_target;
+                    max_target = offset > max_target ? offset : max_target;
+                }
+                if (state->low + min_target < 0 || state->high + max_target > last_index) {
+                    // the body runs instead, and may stick at an edge
+                    forget_everything(state, last_index);
+                    break;
+                }
+                for (j = op->offset; j < op->offset + op->arg; j++) {
+                    set_cells(state, state->low + program->targets[j].offset,
+                              state->high + program->targets[j].offset, UNKNOWN_VALUE);
+                }
+                set_cells(state, state->low, state->high, 0);
+                break;
+            }
+            case OP_CHECK_RANGE: {
+                // CHECK_RANGE, the offset code up to a JUMP, then the original code
+                int jump = op->jump;
+                TapeState original = *state;
+                next = program->ops[jump].jump + 1;
+                if (state->low + op->offset < 0 || state->high + op->arg > last_index) {
+                    analysis->needed[i] = 1;
+                    analyze_ops(analysis, jump + 1, next, &original, depth);
+                }
+                if (state->high + op->offset < 0 || state->low + op->arg > last_index) {
+                    *state = original; // the check never passes
+                    break;
+                }
+                state->low = state->low < -op->offset ? -op->offset : state->low;
+                state->high = state->high > last_index - op->arg ? last_index - op->arg
+                                                                 : state->high;
+                analyze_ops(analysis, i + 1, jump, state, depth);
+                if (analysis->needed[i]) {
+                    join_states(state, &original);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        i = next;
+    }
+}
+
+/*
+ * Specializes the program for running on a blank tape of tape_size cells with
+ * the pointer at cell 0. A dataflow analysis follows the known cell values and
+ * the range the pointer can be in, and with them
+ *   - removes loops that can only start on a zero cell, such as a leading
+ *     comment loop or a "[-]" of a cell that was never written,
+ *   - removes OP_CHECK_RANGE checks that always pass, with the original code
+ *     they guard,
+ *   - turns OP_MOVE into OP_MOVE_UNCHECKED where the pointer cannot reach an
+ *     edge of the tape.
+ * Values are only known while they stay in 0..127, where every cell model
+ * agrees. A program too large or deeply nested to analyze is left alone.
+ */
+void specialize_for_blank_tape(Program *program, int tape_size) {
+    Analysis analysis = {program, tape_size - 1L, calloc(program->num_ops + 1, 1),
+                         calloc(program->num_ops + 1, 1), ANALYSIS_BUDGET};
+    TapeState *state = calloc(1, sizeof(TapeState));
+    int *new_index = malloc(sizeof(int) * (program->num_ops + 1));
+    int num_ops = 0;
+    int i;
+    analyze_ops(&analysis, 0, program->num_ops, state, 0);
+    for (i = 0; i < program->num_ops && analysis.budget > 0; i++) {
+        Instruction op = program->ops[i];
+        new_index[i] = num_ops;
+        if (!analysis.visited[i] || analysis.needed[i]) {
+            program->ops[num_ops++] = op;
+        } else if (is_loop_start(op.code)) {
+            i = op.jump; // never runs
+        } else if (op.code == OP_CHECK_RANGE) {
+            int original_end = program->ops[op.jump].jump;
+            int j;
+            for (j = i + 1; j < op.jump; j++) {
+                new_index[j] = num_ops;
+                program->ops[num_ops++] = program->ops[j];
+            }
+            for (j = op.jump; j <= original_end; j++) {
+                new_index[j] = num_ops - 1; // never runs
+            }
+            i = original_end;
+        } else {
+            if (op.code == OP_MOVE) {
+                op.code = OP_MOVE_UNCHECKED;
+            }
+            program->ops[num_ops++] = op;
+        }
+    }
+    if (analysis.budget > 0) {
+        for (i = 0; i < num_ops; i++) {
+            OpCode code = program->ops[i].code;
+            if (is_loop_start(code) || code == OP_JUMP_IF_NOT_ZERO
+                    || code == OP_CHECK_RANGE || code == OP_JUMP) {
+                program->ops[i].jump = new_index[program->ops[i].jump];
+            }
+        }
+        program->num_ops = num_ops;
+    }
+    free(analysis.visited);
+    free(analysis.needed);
+    free(state);
+    free(new_index);
+}
+
+/*
+ * Runs all optimization passes over the program.
+ */
+void optimize_program(Program *program) {
+    recognize_loop_idioms(program);
+    address_cells_by_offset(program);
+}
+
+/*
+ * Rewrites OP_MOVE into OP_MOVE_UNCHECKED for programs running on a virtual
+ * tape whose guard regions are max_distance cells wide. A run of moves that
+ * touches no cell could otherwise jump over a guard region, so a move stays
+ * checked once the moves since the last cell access add up to more than that.
+ */
+void use_unchecked_moves(Program *program, int max_distance) {
+    int i;
+    long distance = 0; // moved since the last instruction that read a cell
+    for (i = 0; i < program->num_ops; i++) {
+        Instruction *op = &program->ops[i];
+        if (op->code != OP_MOVE) {
+            distance = 0;
+            continue;
+        }
+        distance += op->arg < 0 ? -(long) op->arg : op->arg;
+        if (distance <= max_distance) {
+            op->code = OP_MOVE_UNCHECKED;
+        }
+    }
+}
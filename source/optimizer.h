@@ -0,0 +1,16 @@
+#include "compiler.h"
+
+#ifndef OPTIMIZER_HEADER
+#define OPTIMIZER_HEADER
+
+void recognize_loop_idioms(Program *program);
+
+void address_cells_by_offset(Program *program);
+
+void optimize_program(Program *program);
+
+void use_unchecked_moves(Program *program, int max_distance);
+
+void specialize_for_blank_tape(Program *program, int tape_size);
+
+#endif
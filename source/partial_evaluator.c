@@ -0,0 +1,231 @@
+/*
+ * Partial evaluation: a program's work up to its first "," does not depend on
+ * its input, so it can be done once, ahead of time, instead of on every run.
+ * evaluate_prefix() runs that part of a compiled program on a blank tape and
+ * returns a snapshot of the tape, the pointer and the output, together with
+ * the residual program: the instructions still to run from the snapshot.
+ *
+ * The program is only ever cut between whole top-level loops, so the
+ * residual is a well-formed program of its own and every engine can run it.
+ * A loop that reads input, runs out of the instruction budget or never ends
+ * is left in the residual program with everything after it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "partial_evaluator.h"
+
+typedef struct {
+    char *data;
+    long length;
+    long capacity;
+} OutputRecord;
+
+static void record_output(void *target, const char *data, long length) {
+    OutputRecord *record = target;
+    if (record->length + length > record->capacity) {
+        record->capacity = 2 * (record->length + length);
+        record->data = realloc(record->data, record->capacity);
+    }
+    memcpy(record->data + record->length, data, length);
+    record->length += length;
+}
+
+/*
+ * Returns the index after the top-level unit that starts at index: a whole
+ * loop, offset-addressed code with the original code after it, or a single
+ * instruction.
+ */
+static int unit_end(const Program *program, int index) {
+    const Instruction *op = &program->ops[index];
+    if (op->code == OP_CHECK_RANGE) {
+        return program->ops[op->jump].jump + 1;
+    }
+    return is_loop_start(op->code) ? op->jump + 1 : index + 1;
+}
+
+static int reads_input(const Program *program, int first, int end) {
+    int i;
+    for (i = first; i < end; i++) {
+        if (program->ops[i].code == OP_INPUT) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Returns the furthest cell to the right that running op with the pointer at
+ * index may move to, change or check against the end of the tape.
+ */
+static long op_reach(const Program *program, const Instruction *op, long index) {
+    int i;
+    long reach = index;
+    switch (op->code) {
+        case OP_ADD:
+            return index + op->offset;
+        case OP_MOVE:
+        case OP_MOVE_UNCHECKED:
+        case OP_CHECK_RANGE:
+        case OP_SCAN:
+        case OP_CLEAR_RANGE:
+            return op->arg > 0 ? index + op->arg : index;
+        case OP_MULTIPLY_LOOP:
+            for (i = op->offset; i < op->offset + op->arg; i++) {
+                long target = index + program->targets[i].offset;
+                reach = target > reach ? target : reach;
+            }
+            return reach;
+        default:
+            return index;
+    }
+}
+
+/*
+ * Runs whole top-level units of program on mem, from the first one up to
+ * stop_at (or as far as possible if stop_at is -1) and within max_steps
+ * instructions. Stores the furthest cell reached in *reach and whether a
+ * unit was left unfinished on the tape in *unfinished. Returns the index of
+ * the first unit not run.
+ */
+static int run_units(const Program *program, SystemMemory *mem, long max_steps,
+                     int stop_at, long *reach, int *unfinished) {
+    long steps = 0;
+    int index = 0;
+    *unfinished = 0;
+    while (index < program->num_ops && index != stop_at) {
+        int end = unit_end(program, index);
+        int pc = index;
+        long unit_start = steps;
+        if (reads_input(program, index, end)) {
+            break;
+        }
+        while (pc != end && pc >= 0 && steps < max_steps) {
+            long furthest = op_reach(program, &program->ops[pc], mem->curr_index);
+            *reach = furthest > *reach ? furthest : *reach;
+            pc = execute_instruction(mem, program, pc);
+            *reach = mem->curr_index > *reach ? mem->curr_index : *reach;
+            steps++;
+        }
+        if (pc != end) {
+            *unfinished = steps > unit_start;
+            break;
+        }
+        index = end;
+    }
+    return index;
+}
+
+/*
+ * Returns the program without its first resume_at instructions, which must
+ * end a top-level unit.
+ */
+static Program *residual_program(const Program *program, int resume_at) {
+    Program *residual = malloc(sizeof(Program));
+    int i;
+    residual->num_ops = program->num_ops - resume_at;
+    residual->ops = malloc(sizeof(Instruction) * (residual->num_ops + 1));
+    residual->threaded_code = NULL;
+    memcpy(residual->ops, program->ops + resume_at, sizeof(Instruction) * residual->num_ops);
+    for (i = 0; i < residual->num_ops; i++) {
+        OpCode code = residual->ops[i].code;
+        if (is_loop_start(code) || code == OP_JUMP_IF_NOT_ZERO
+                || code == OP_CHECK_RANGE || code == OP_JUMP) {
+            residual->ops[i].jump -= resume_at;
+        }
+    }
+    residual->num_targets = program->num_targets;
+    residual->targets = malloc(sizeof(MultiplyTarget) * (program->num_targets + 1));
+    memcpy(residual->targets, program->targets, sizeof(MultiplyTarget) * program->num_targets);
+    return residual;
+}
+
+/*
+ * Runs the input-independent prefix of program on a blank tape of tape_size
+ * cells, with the interpreter's saturating cells, for at most max_steps
+ * instructions. Returns the residual program and stores the state it starts
+ * from in *snapshot, or returns NULL if no part of the program could be run.
+ * Free the results with free_program() and free_snapshot().
+ */
+Program *evaluate_prefix(const Program *program, int tape_size, long max_steps,
+                         Snapshot **snapshot) {
+    SystemMemory *mem = initialize_memory_with_size(tape_size);
+    OutputRecord output = {NULL, 0, 0};
+    char buffer[4096];
+    IoBuffers buffers = {.output = buffer, .output_capacity = sizeof(buffer),
+                         .flush_output = record_output, .flush_target = &output};
+    long reach = 0;
+    int unfinished;
+    mem->io = &buffers;
+    int resume_at = run_units(program, mem, max_steps, -1, &reach, &unfinished);
+    if (unfinished && resume_at > 0) {
+        // run again without the unit that did not finish
+        free_mem(mem);
+        mem = initialize_memory_with_size(tape_size);
+        mem->io = &buffers;
+        buffers.output_length = 0;
+        output.length = 0;
+        reach = 0;
+        run_units(program, mem, LONG_MAX, resume_at, &reach, &unfinished);
+    }
+    if (resume_at == 0) {
+        free_mem(mem);
+        free(output.data);
+        return NULL;
+    }
+    record_output(&output, buffer, buffers.output_length);
+
+    Snapshot *result = malloc(sizeof(Snapshot));
+    int num_cells = tape_size;
+    while (num_cells > 0 && mem->tape[num_cells - 1] == 0) {
+        num_cells--;
+    }
+    // without a move past the end of the tape, any tape that long behaves the same
+    result->min_tape_size = reach < tape_size ? reach + 1 : tape_size;
+    result->max_tape_size = reach < tape_size ? INT_MAX : tape_size;
+    result->curr_index = mem->curr_index;
+    result->num_cells = num_cells;
+    result->cells = malloc(num_cells + 1);
+    memcpy(result->cells, mem->tape, num_cells);
+    result->output = output.data;
+    result->output_length = output.length;
+    free_mem(mem);
+    *snapshot = result;
+    return residual_program(program, resume_at);
+}
+
+/*
+ * Returns 1 if the snapshot holds on mem's tape.
+ */
+int snapshot_fits(const Snapshot *snapshot, const SystemMemory *mem) {
+    return mem->cell_size == 1 && mem->tape_size >= snapshot->min_tape_size
+           && mem->tape_size <= snapshot->max_tape_size;
+}
+
+/*
+ * Puts mem, whose tape must be blank and fit the snapshot, in the state of the
+ * snapshot, and writes the snapshot's output.
+ */
+void restore_snapshot(const Snapshot *snapshot, SystemMemory *mem) {
+    long i;
+    memcpy(mem->tape, snapshot->cells, snapshot->num_cells);
+    mem->curr_index = snapshot->curr_index;
+    mem->blank = 0;
+    for (i = 0; i < snapshot->output_length; i++) {
+        if (mem->io != NULL) {
+            io_buffers_write(mem->io, snapshot->output[i]);
+        } else {
+            io_write_byte(snapshot->output[i]);
+        }
+    }
+}
+
+/*
+ * Free a Snapshot and all internal pointers.
+ */
+void free_snapshot(Snapshot *snapshot) {
+    free(snapshot->cells);
+    free(snapshot->output);
+    free(snapshot);
+}
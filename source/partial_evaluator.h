@@ -0,0 +1,32 @@
+#include "interpreter.h"
+
+#ifndef PARTIAL_EVALUATOR_HEADER
+#define PARTIAL_EVALUATOR_HEADER
+
+#define PARTIAL_EVALUATION_BUDGET 10000000L // instructions run ahead of time at most
+
+/*
+ * The state a program leaves on a blank tape after the instructions that do
+ * not depend on its input. It only holds on tapes of min_tape_size to
+ * max_tape_size cells, where the pointer stuck at the same edges.
+ */
+typedef struct {
+    int min_tape_size;
+    int max_tape_size;
+    int curr_index;
+    char *cells;        // the first num_cells cells; the rest are 0
+    int num_cells;
+    char *output;       // what the program printed meanwhile
+    long output_length;
+} Snapshot;
+
+Program *evaluate_prefix(const Program *program, int tape_size, long max_steps,
+                         Snapshot **snapshot);
+
+int snapshot_fits(const Snapshot *snapshot, const SystemMemory *mem);
+
+void restore_snapshot(const Snapshot *snapshot, SystemMemory *mem);
+
+void free_snapshot(Snapshot *snapshot);
+
+#endif
@@ -0,0 +1,202 @@
+/*
+ * Hardware performance counters around a run (run --perf-counters): cycles,
+ * instructions, branch misses and L1 data cache misses of this process, in
+ * user space only, read with perf_event_open(). Where an event cannot be
+ * counted (another operating system, a virtual machine without a PMU, or a
+ * perf_event_paranoid setting that forbids it) it is reported as unavailable
+ * and the program runs as usual.
+ *
+ * When the kernel has more events than counters it multiplexes them, so every
+ * count is scaled by the share of the run its counter was actually running.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "perf_counters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#define HAVE_PERF_EVENTS
+#endif
+
+static const char *EVENT_NAMES[NUM_PERF_COUNTERS] = {
+    "cycles", "instructions", "branch misses", "L1d misses"
+};
+
+#ifdef HAVE_PERF_EVENTS
+
+static const struct {
+    unsigned int type;
+    unsigned long long config;
+} EVENTS[NUM_PERF_COUNTERS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                         | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)}
+};
+
+static int open_counter(int event) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = EVENTS[event].type;
+    attr.config = EVENTS[event].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/*
+ * Opens and starts the counters for this process. Returns the number of
+ * events that can be counted; the error of the first one that cannot is kept
+ * in counters->error.
+ */
+int start_perf_counters(PerfCounters *counters) {
+    int available = 0;
+    int i;
+    counters->error = 0;
+    for (i = 0; i < NUM_PERF_COUNTERS; i++) {
+        counters->values[i] = 0;
+        counters->fds[i] = open_counter(i);
+        if (counters->fds[i] < 0) {
+            counters->error = counters->error ? counters->error : errno;
+            continue;
+        }
+        available++;
+    }
+    // started together, after the setup, so that they count the same code
+    for (i = 0; i < NUM_PERF_COUNTERS; i++) {
+        if (counters->fds[i] >= 0) {
+            ioctl(counters->fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(counters->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+    return available;
+}
+
+/*
+ * Stops the counters, stores their totals in counters->values and closes them.
+ */
+void stop_perf_counters(PerfCounters *counters) {
+    int i;
+    for (i = 0; i < NUM_PERF_COUNTERS; i++) {
+        if (counters->fds[i] >= 0) {
+            ioctl(counters->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+    for (i = 0; i < NUM_PERF_COUNTERS; i++) {
+        // the count, the time enabled and the time running
+        unsigned long long reading[3];
+        if (counters->fds[i] < 0) {
+            continue;
+        }
+        if (read(counters->fds[i], reading, sizeof(reading)) != sizeof(reading)
+                || reading[2] == 0) {
+            counters->values[i] = 0;
+        } else if (reading[2] < reading[1]) {
+            counters->values[i] = (long long) ((double) reading[0] * reading[1] / reading[2]);
+        } else {
+            counters->values[i] = reading[0];
+        }
+        close(counters->fds[i]);
+    }
+}
+
+#else
+
+int start_perf_counters(PerfCounters *counters) {
+    int i;
+    for (i = 0; i < NUM_PERF_COUNTERS; i++) {
+        counters->fds[i] = -1;
+        counters->values[i] = 0;
+    }
+    counters->error = ENOSYS;
+    return 0;
+}
+
+void stop_perf_counters(PerfCounters *counters) {
+}
+
+#endif
+
+/*
+ * Prints the totals of the counters, the instructions per cycle and, if
+ * ops_executed (the compiled instructions the program ran) is known, the
+ * average of every event per instruction. ops_executed is 0 when unknown.
+ */
+void print_perf_counters(const PerfCounters *counters, long ops_executed, FILE *out) {
+    int i;
+    fprintf(out, "\nPerformance counters:\n");
+    fprintf(out, "  %-14s %16s %12s\n", "event", "total", "per op");
+    for (i = 0; i < NUM_PERF_COUNTERS; i++) {
+        if (counters->fds[i] < 0) {
+            fprintf(out, "  %-14s %16s\n", EVENT_NAMES[i], "not available");
+        } else if (ops_executed > 0) {
+            fprintf(out, "  %-14s %16lld %12.3f\n", EVENT_NAMES[i], counters->values[i],
+                    (double) counters->values[i] / ops_executed);
+        } else {
+            fprintf(out, "  %-14s %16lld %12s\n", EVENT_NAMES[i], counters->values[i], "-");
+        }
+    }
+    if (counters->fds[PERF_CYCLES] >= 0 && counters->fds[PERF_INSTRUCTIONS] >= 0
+            && counters->values[PERF_CYCLES] > 0) {
+        fprintf(out, "  IPC %.2f\n", (double) counters->values[PERF_INSTRUCTIONS]
+                                     / counters->values[PERF_CYCLES]);
+    }
+    if (ops_executed > 0) {
+        fprintf(out, "  %ld instructions of the program executed\n", ops_executed);
+    } else {
+        fprintf(out, "  (per-op averages need the executed instructions, which only "
+                "--engine=switch counts)\n");
+    }
+    if (counters->error != 0) {
+        fprintf(out, "  (cannot count every event: %s)\n", strerror(counters->error));
+    }
+}
+
+/*
+ * The switch engine (execute_program()), counting the instructions it runs.
+ */
+static long execute_program_counted(const Program *program, SystemMemory *mem) {
+    int curr_op_index = 0;
+    long ops_executed = 0;
+    while (curr_op_index < program->num_ops) {
+        curr_op_index = execute_instruction(mem, program, curr_op_index);
+        ops_executed++;
+    }
+    return ops_executed;
+}
+
+/*
+ * Like execute_code_with_engine(), but counts hardware events while engine
+ * runs (the compiling and optimizing are left out) and reports them on stderr
+ * afterwards. Returns what execute_code_with_engine() would.
+ */
+int execute_code_with_perf_counters(const char *source, long source_length,
+                                    SystemMemory *mem, Engine engine) {
+    PerfCounters counters;
+    long ops_executed = 0;
+    int status = 0;
+    Program *program = compile_program(source, source_length);
+    if (program == NULL) {
+        return -1;
+    }
+    optimize_for_memory(program, mem);
+    start_perf_counters(&counters);
+    if (engine == execute_program) {
+        ops_executed = execute_program_counted(program, mem);
+    } else {
+        status = engine(program, mem);
+    }
+    stop_perf_counters(&counters);
+    io_flush();
+    print_perf_counters(&counters, ops_executed, stderr);
+    free_program(program);
+    return status;
+}
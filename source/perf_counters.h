@@ -0,0 +1,32 @@
+#include <stdio.h>
+#include "interpreter.h"
+
+#ifndef PERF_COUNTERS_HEADER
+#define PERF_COUNTERS_HEADER
+
+#define NUM_PERF_COUNTERS 4
+
+// the hardware events counted, in this order
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_MISSES
+} PerfEvent;
+
+typedef struct {
+    int fds[NUM_PERF_COUNTERS];        // -1 where the event cannot be counted
+    long long values[NUM_PERF_COUNTERS];
+    int error;                         // errno of the first counter that failed to open
+} PerfCounters;
+
+int start_perf_counters(PerfCounters *counters);
+
+void stop_perf_counters(PerfCounters *counters);
+
+void print_perf_counters(const PerfCounters *counters, long ops_executed, FILE *out);
+
+int execute_code_with_perf_counters(const char *source, long source_length,
+                                    SystemMemory *mem, Engine engine);
+
+#endif
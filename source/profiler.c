@@ -0,0 +1,566 @@
+/*
+ * The execution profiler (run --profile). execute_program_profiled() is an
+ * engine that counts how often every instruction runs and how many iterations
+ * and how much time every loop takes. It counts only at the loops, the way a
+ * scheduler's fuel is counted at the "]" of each loop, and works out the
+ * counts of the straight-line code in between from them afterwards, so the
+ * program runs in a threaded engine nearly as fast as without the profiler
+ * (cell models other than the default step through it one instruction at a
+ * time). Loop times are read from the CPU's time-stamp counter where there is
+ * one (a few cycles per read) and only when the body of a loop is entered and
+ * left, not per iteration; they are converted to nanoseconds by comparing the
+ * counter with the clock over the whole run.
+ *
+ * Results are reported against the source: every instruction knows the
+ * position of its first command, which becomes a line:column. Since the loops
+ * of a program nest statically, a loop's stack (for the folded-stack output)
+ * is simply the chain of loops around it in the source.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include "profiler.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define read_timer() __rdtsc()
+#else
+static unsigned long long read_timer() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000000ULL + time.tv_nsec;
+}
+#endif
+
+#define REPORT_ROWS 20 // entries in each ranking of the report
+
+// a loop that is running, on the profiler's loop stack
+typedef struct {
+    int op_index;
+    unsigned long long start;
+} ActiveLoop;
+
+static double now_in_nanoseconds() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1e9 + time.tv_nsec;
+}
+
+static int opens_loop(OpCode code) {
+    return code == OP_JUMP_IF_ZERO || code == OP_SET_ZERO || code == OP_SCAN
+           || code == OP_MULTIPLY_LOOP || code == OP_CLEAR_RANGE;
+}
+
+/*
+ * Creates an empty profile for program.
+ */
+Profile *new_profile(const Program *program) {
+    Profile *profile = malloc(sizeof(Profile));
+    profile->num_ops = program->num_ops;
+    profile->executions = calloc(program->num_ops + 1, sizeof(long));
+    profile->iterations = calloc(program->num_ops + 1, sizeof(long));
+    profile->loop_ticks = calloc(program->num_ops + 1, sizeof(unsigned long long));
+    profile->total_ticks = 0;
+    profile->total_nanoseconds = 0;
+    return profile;
+}
+
+void free_profile(Profile *profile) {
+    free(profile->executions);
+    free(profile->iterations);
+    free(profile->loop_ticks);
+    free(profile);
+}
+
+/*
+ * Records that the loop at op_index started running its body at start.
+ */
+static void enter_loop(Profile *profile, ActiveLoop *loops, int *depth, int op_index,
+                       unsigned long long start) {
+    loops[*depth].op_index = op_index;
+    loops[*depth].start = start;
+    (*depth)++;
+    profile->iterations[op_index]++;
+}
+
+/*
+ * Records that the innermost running loop has ended.
+ */
+static void leave_loop(Profile *profile, ActiveLoop *loops, int *depth) {
+    (*depth)--;
+    profile->loop_ticks[loops[*depth].op_index] += read_timer() - loops[*depth].start;
+}
+
+/*
+ * Runs a compiled program like run_threaded() in interpreter.c, counting only
+ * at the loops: the iterations of every loop (entering its body at the start
+ * and each jump back at its "]"), the failed checks of every OP_CHECK_RANGE,
+ * and the time of every loop whose body runs. The shortcut of a recognized
+ * loop ("[-]", "[>]", ...) is not timed on its own, since two timer reads
+ * cost about as much as most shortcuts; its time counts toward the loop
+ * around it. The rest of the code runs as fast as in the
+ * threaded engine; count_executions() works out how often it ran.
+ * Returns num_ops, the index the program ends at.
+ */
+#ifdef __GNUC__
+static int run_profiled_threaded(const Program *program, SystemMemory *mem,
+                                 Profile *profile, long *failed_checks,
+                                 ActiveLoop *loops) {
+    const Instruction *ops = program->ops;
+    int pc = 0;
+    int depth = 0;
+    int next;
+    int i;
+    static void *op_labels[] = {
+        [OP_ADD] = &&op_add,
+        [OP_MOVE] = &&op_move,
+        [OP_OUTPUT] = &&op_output,
+        [OP_INPUT] = &&op_input,
+        [OP_JUMP_IF_ZERO] = &&op_jump_if_zero,
+        [OP_JUMP_IF_NOT_ZERO] = &&op_jump_if_not_zero,
+        [OP_SET_ZERO] = &&op_set_zero,
+        [OP_SCAN] = &&op_scan,
+        [OP_MULTIPLY_LOOP] = &&op_multiply_loop,
+        [OP_CLEAR_RANGE] = &&op_clear_range,
+        [OP_MOVE_UNCHECKED] = &&op_move_unchecked,
+        [OP_CHECK_RANGE] = &&op_check_range,
+        [OP_JUMP] = &&op_jump
+    };
+    void **code = malloc(sizeof(void *) * (program->num_ops + 1));
+    for (i = 0; i < program->num_ops; i++) {
+        code[i] = op_labels[ops[i].code];
+    }
+    code[program->num_ops] = &&done;
+    goto *code[pc];
+
+op_add:
+    add_to_memory_cell_at_offset(mem, ops[pc].offset, ops[pc].arg);
+    goto *code[++pc];
+op_move:
+    move_memory_pointer(mem, ops[pc].arg);
+    goto *code[++pc];
+op_move_unchecked:
+    mem->curr_index += ops[pc].arg;
+    goto *code[++pc];
+op_output:
+    output_current_cell_value(mem);
+    goto *code[++pc];
+op_input:
+    store_input_char_in_current_cell(mem);
+    goto *code[++pc];
+op_jump_if_zero:
+    next = conditional_loop_entry(mem, ops, pc);
+    if (next == pc + 1) {
+        enter_loop(profile, loops, &depth, pc, read_timer());
+    }
+    pc = next;
+    goto *code[pc];
+op_jump_if_not_zero:
+    next = conditional_continue(mem, ops, pc);
+    if (next == pc + 1) {
+        leave_loop(profile, loops, &depth);
+    } else {
+        profile->iterations[ops[pc].jump]++;
+    }
+    pc = next;
+    goto *code[pc];
+op_set_zero:
+    next = set_zero_loop(mem, ops, pc);
+    goto loop_shortcut;
+op_scan:
+    next = scan_loop(mem, ops, pc);
+    goto loop_shortcut;
+op_multiply_loop:
+    next = multiply_loop(mem, program, pc);
+    goto loop_shortcut;
+op_clear_range:
+    next = clear_range_loop(mem, ops, pc);
+    goto loop_shortcut;
+loop_shortcut:
+    if (next == pc + 1) { // the shortcut does not apply: run the body
+        enter_loop(profile, loops, &depth, pc, read_timer());
+    }
+    pc = next;
+    goto *code[pc];
+op_check_range:
+    next = check_range(mem, ops, pc);
+    if (next != pc + 1) {
+        failed_checks[pc]++;
+    }
+    pc = next;
+    goto *code[pc];
+op_jump:
+    pc = ops[pc].jump + 1;
+    goto *code[pc];
+done:
+    free(code);
+    return pc;
+}
+#endif
+
+/*
+ * Runs a compiled program one instruction at a time with step, counting what
+ * run_profiled_threaded() counts. Returns the index it stopped at: num_ops
+ * when the program ended, or that of the instruction that stopped it with an
+ * error.
+ */
+static int run_profiled_stepping(const Program *program, SystemMemory *mem,
+                                 Profile *profile, long *failed_checks,
+                                 ActiveLoop *loops, Stepper step) {
+    const Instruction *ops = program->ops;
+    int pc = 0;
+    int depth = 0;
+    while (pc < program->num_ops) {
+        OpCode code = ops[pc].code;
+        int next;
+        if (opens_loop(code)) {
+            next = step(mem, program, pc);
+            if (next == pc + 1) {
+                enter_loop(profile, loops, &depth, pc, read_timer());
+            }
+        } else if (code == OP_JUMP_IF_NOT_ZERO) {
+            next = step(mem, program, pc);
+            if (next == pc + 1) {
+                leave_loop(profile, loops, &depth);
+            } else {
+                profile->iterations[ops[pc].jump]++;
+            }
+        } else {
+            next = step(mem, program, pc);
+            if (code == OP_CHECK_RANGE && next != pc + 1) {
+                failed_checks[pc]++;
+            }
+        }
+        if (next < 0) {
+            return pc;
+        }
+        pc = next;
+    }
+    return pc;
+}
+
+/*
+ * Adds to profile how often every instruction ran, worked out from the loop
+ * iterations and failed checks of a run that started once at the first
+ * instruction and stopped at stop_index. Control flow is structured: a loop
+ * runs as often as the code it is in, its body as often as it iterated, and
+ * the code after it as often as the loop; the offset-addressed code after an
+ * OP_CHECK_RANGE runs as often as the check passed, and the original code as
+ * often as it failed. A run that stopped early ran the code after the stop
+ * once less, up to the end of every loop around it.
+ */
+static void count_executions(Profile *profile, const Program *program,
+                             const long *failed_checks, int stop_index) {
+    const Instruction *ops = program->ops;
+    long *counts = malloc(sizeof(long) * (program->num_ops + 1));
+    int *opened_by = malloc(sizeof(int) * (program->num_ops + 1)); // open blocks
+    int *ends = malloc(sizeof(int) * (program->num_ops + 1));
+    int depth = 0;
+    int stop_depth = -1; // the blocks at this depth and below ran once less
+    long count = 1;
+    int i;
+    for (i = 0; i < program->num_ops; i++) {
+        const Instruction *op = &ops[i];
+        counts[i] = count;
+        if (opens_loop(op->code)) {
+            opened_by[depth] = i;
+            ends[depth++] = op->jump;
+            count = profile->iterations[i];
+        } else if (op->code == OP_CHECK_RANGE) {
+            opened_by[depth] = i;
+            ends[depth++] = ops[op->jump].jump;
+            count -= failed_checks[i];
+        } else if (op->code == OP_JUMP) {
+            count = failed_checks[opened_by[depth - 1]];
+        }
+        while (depth > 0 && ends[depth - 1] == i) {
+            depth--;
+            count = counts[opened_by[depth]];
+            if (stop_depth > depth) {
+                count--;
+                stop_depth = depth;
+            }
+        }
+        if (i == stop_index) {
+            if (!opens_loop(op->code)) { // a loop stops in its shortcut, before the body
+                count--;
+            }
+            stop_depth = depth;
+        }
+        profile->executions[i] += counts[i];
+    }
+    free(counts);
+    free(opened_by);
+    free(ends);
+}
+
+/*
+ * Executes a compiled program, recording executions, loop iterations and loop
+ * times in profile. Programs on the default cells run in a threaded engine
+ * like run_threaded() in interpreter.c, those of other cell models one
+ * instruction at a time with step; both count only at the loops and leave
+ * the instruction counts to count_executions(). Returns 0, or -1 if the
+ * program stopped with an error.
+ */
+int execute_program_profiled(const Program *program, SystemMemory *mem,
+                             Profile *profile, Stepper step) {
+    long *failed_checks = calloc(program->num_ops + 1, sizeof(long));
+    ActiveLoop *loops = malloc(sizeof(ActiveLoop) * (program->num_ops + 1));
+    double start_nanoseconds = now_in_nanoseconds();
+    unsigned long long start_ticks = read_timer();
+    int stop_index;
+#ifdef __GNUC__
+    if (step == execute_instruction) {
+        stop_index = run_profiled_threaded(program, mem, profile, failed_checks, loops);
+    } else {
+        stop_index = run_profiled_stepping(program, mem, profile, failed_checks, loops,
+                                           step);
+    }
+#else
+    stop_index = run_profiled_stepping(program, mem, profile, failed_checks, loops, step);
+#endif
+    profile->total_ticks += read_timer() - start_ticks;
+    profile->total_nanoseconds += now_in_nanoseconds() - start_nanoseconds;
+    count_executions(profile, program, failed_checks, stop_index);
+    free(failed_checks);
+    free(loops);
+    return stop_index < program->num_ops ? -1 : 0;
+}
+
+/*
+ * Stores the 1-based line and column in source of every instruction in lines
+ * and columns. Instructions are mostly in source order, but
+ * address_cells_by_offset() repeats some, so each is looked up on its own.
+ */
+static void locate_ops(const Program *program, const char *source, int *lines,
+                       int *columns) {
+    long max_position = 0, position;
+    int num_lines = 1;
+    int i;
+    for (i = 0; i < program->num_ops; i++) {
+        if (program->ops[i].position > max_position) {
+            max_position = program->ops[i].position;
+        }
+    }
+    long *line_starts = malloc(sizeof(long) * (max_position + 2));
+    line_starts[0] = 0;
+    for (position = 0; position < max_position; position++) {
+        if (source[position] == '\n') {
+            line_starts[num_lines++] = position + 1;
+        }
+    }
+    for (i = 0; i < program->num_ops; i++) {
+        int first = 0, last = num_lines - 1; // the last line starting at or before
+        position = program->ops[i].position;
+        while (first < last) {
+            int middle = (first + last + 1) / 2;
+            if (line_starts[middle] <= position) {
+                first = middle;
+            } else {
+                last = middle - 1;
+            }
+        }
+        lines[i] = first + 1;
+        columns[i] = position - line_starts[first] + 1;
+    }
+    free(line_starts);
+}
+
+static double ticks_to_milliseconds(const Profile *profile, unsigned long long ticks) {
+    if (profile->total_ticks == 0) {
+        return 0;
+    }
+    return ticks * (profile->total_nanoseconds / profile->total_ticks) / 1e6;
+}
+
+static const char *op_name(OpCode code) {
+    switch (code) {
+        case OP_ADD: return "add";
+        case OP_MOVE: return "move";
+        case OP_MOVE_UNCHECKED: return "move";
+        case OP_OUTPUT: return "output";
+        case OP_INPUT: return "input";
+        case OP_JUMP_IF_ZERO: return "loop";
+        case OP_JUMP_IF_NOT_ZERO: return "loop end";
+        case OP_SET_ZERO: return "set zero";
+        case OP_SCAN: return "scan";
+        case OP_MULTIPLY_LOOP: return "multiply";
+        case OP_CLEAR_RANGE: return "clear range";
+        case OP_CHECK_RANGE: return "range check";
+        case OP_JUMP: return "jump";
+    }
+    return "?";
+}
+
+static const Profile *sorting_profile; // qsort has no context argument
+static int sorting_by_time;
+
+static int compare_ops(const void *a, const void *b) {
+    int first = *(const int *) a, second = *(const int *) b;
+    if (sorting_by_time) {
+        unsigned long long x = sorting_profile->loop_ticks[first];
+        unsigned long long y = sorting_profile->loop_ticks[second];
+        return (x < y) - (x > y);
+    }
+    long x = sorting_profile->executions[first];
+    long y = sorting_profile->executions[second];
+    return (x < y) - (x > y);
+}
+
+/*
+ * Prints the profile's hot spots: the loops that took the most time (including
+ * the loops inside them) and the most executed instructions, at their
+ * line:column in source.
+ */
+void print_profile_report(const Profile *profile, const Program *program,
+                          const char *source, FILE *out) {
+    int *order = malloc(sizeof(int) * (program->num_ops + 1));
+    int *lines = malloc(sizeof(int) * (program->num_ops + 1));
+    int *columns = malloc(sizeof(int) * (program->num_ops + 1));
+    int num_loops = 0;
+    int i;
+    long total_executions = 0;
+    locate_ops(program, source, lines, columns);
+    for (i = 0; i < program->num_ops; i++) {
+        total_executions += profile->executions[i];
+        if (opens_loop(program->ops[i].code) && profile->executions[i] > 0) {
+            order[num_loops++] = i;
+        }
+    }
+    fprintf(out, "\nProfile: %ld instructions executed in %.3f ms\n",
+            total_executions, profile->total_nanoseconds / 1e6);
+
+    sorting_profile = profile;
+    sorting_by_time = 1;
+    qsort(order, num_loops, sizeof(int), compare_ops);
+    fprintf(out, "\nHottest loops (time includes inner loops):\n");
+    fprintf(out, "  %-10s %-12s %12s %14s %12s %7s\n", "line:col", "loop",
+            "entries", "iterations", "time ms", "time %");
+    for (i = 0; i < num_loops && i < REPORT_ROWS; i++) {
+        int op = order[i];
+        double milliseconds = ticks_to_milliseconds(profile, profile->loop_ticks[op]);
+        char location[32];
+        snprintf(location, sizeof(location), "%d:%d", lines[op], columns[op]);
+        fprintf(out, "  %-10s %-12s %12ld %14ld %12.3f %6.1f%%\n", location,
+                op_name(program->ops[op].code), profile->executions[op],
+                profile->iterations[op], milliseconds,
+                profile->total_nanoseconds > 0
+                    ? 100 * milliseconds * 1e6 / profile->total_nanoseconds : 0);
+    }
+
+    for (i = 0; i < program->num_ops; i++) {
+        order[i] = i;
+    }
+    sorting_by_time = 0;
+    qsort(order, program->num_ops, sizeof(int), compare_ops);
+    fprintf(out, "\nMost executed instructions:\n");
+    fprintf(out, "  %-10s %-12s %12s %7s\n", "line:col", "instruction", "executions",
+            "share");
+    for (i = 0; i < program->num_ops && i < REPORT_ROWS; i++) {
+        int op = order[i];
+        char location[32];
+        snprintf(location, sizeof(location), "%d:%d", lines[op], columns[op]);
+        fprintf(out, "  %-10s %-12s %12ld %6.1f%%\n", location,
+                op_name(program->ops[op].code), profile->executions[op],
+                total_executions > 0 ? 100.0 * profile->executions[op] / total_executions : 0);
+    }
+    free(order);
+    free(lines);
+    free(columns);
+}
+
+/*
+ * Writes one frame of a folded stack: the loop at op, named after its
+ * line:column, after the frames of the loops around it.
+ */
+static void write_frame(FILE *out, const int *parents, const int *lines,
+                        const int *columns, int op) {
+    if (parents[op] >= 0) {
+        write_frame(out, parents, lines, columns, parents[op]);
+    }
+    fprintf(out, ";[@%d:%d", lines[op], columns[op]);
+}
+
+/*
+ * Writes the loop times as folded stacks ("program;[@1:5;[@2:3 1234", one
+ * line per loop, with the nanoseconds spent in the loop itself and not in its
+ * inner loops), the input format of flamegraph.pl and similar tools.
+ */
+void write_folded_stacks(const Profile *profile, const Program *program,
+                         const char *source, FILE *out) {
+    int *parents = malloc(sizeof(int) * (program->num_ops + 1));
+    int *open_loops = malloc(sizeof(int) * (program->num_ops + 1));
+    long long *self_ticks = malloc(sizeof(long long) * (program->num_ops + 1));
+    int *lines = malloc(sizeof(int) * (program->num_ops + 1));
+    int *columns = malloc(sizeof(int) * (program->num_ops + 1));
+    long long program_ticks = profile->total_ticks;
+    int depth = 0;
+    int i;
+    locate_ops(program, source, lines, columns);
+    for (i = 0; i < program->num_ops; i++) {
+        const Instruction *op = &program->ops[i];
+        if (opens_loop(op->code)) {
+            parents[i] = depth > 0 ? open_loops[depth - 1] : -1;
+            self_ticks[i] = profile->loop_ticks[i];
+            if (parents[i] >= 0) {
+                self_ticks[parents[i]] -= profile->loop_ticks[i];
+            } else {
+                program_ticks -= profile->loop_ticks[i];
+            }
+            open_loops[depth++] = i;
+        } else if (op->code == OP_JUMP_IF_NOT_ZERO) {
+            depth--;
+        }
+    }
+    double nanoseconds_per_tick = profile->total_ticks > 0
+        ? profile->total_nanoseconds / profile->total_ticks : 0;
+    fprintf(out, "program %lld\n",
+            (long long) ((program_ticks > 0 ? program_ticks : 0) * nanoseconds_per_tick));
+    for (i = 0; i < program->num_ops; i++) {
+        if (opens_loop(program->ops[i].code) && profile->loop_ticks[i] > 0) {
+            fputs("program", out);
+            write_frame(out, parents, lines, columns, i);
+            fprintf(out, " %lld\n",
+                    (long long) ((self_ticks[i] > 0 ? self_ticks[i] : 0) * nanoseconds_per_tick));
+        }
+    }
+    free(parents);
+    free(open_loops);
+    free(self_ticks);
+    free(lines);
+    free(columns);
+}
+
+/*
+ * Executes source like execute_code_with_engine(), with the profiling engine
+ * running each instruction with step, then prints the profile report to stderr
+ * and, if folded_path is not NULL, writes the folded stacks to that file.
+ * Returns 0 on success, or -1 if the brackets are unbalanced, the program
+ * stopped with an error or the folded stacks cannot be written.
+ */
+int execute_code_profiled(const char *source, long source_length,
+                          SystemMemory *mem, Stepper step, const char *folded_path) {
+    Program *program = compile_program(source, source_length);
+    if (program == NULL) {
+        return -1;
+    }
+    optimize_for_memory(program, mem);
+    Profile *profile = new_profile(program);
+    int status = execute_program_profiled(program, mem, profile, step);
+    io_flush();
+    print_profile_report(profile, program, source, stderr);
+    if (folded_path != NULL) {
+        FILE *folded = fopen(folded_path, "w");
+        if (folded == NULL) {
+            fprintf(stderr, "Error: cannot write \"%s\".\n", folded_path);
+            status = -1;
+        } else {
+            write_folded_stacks(profile, program, source, folded);
+            fclose(folded);
+        }
+    }
+    free_profile(profile);
+    free_program(program);
+    return status;
+}
@@ -0,0 +1,33 @@
+#include <stdio.h>
+#include "interpreter.h"
+
+#ifndef PROFILER_HEADER
+#define PROFILER_HEADER
+
+typedef struct {
+    int num_ops;
+    long *executions;              // per instruction
+    long *iterations;              // per loop (at the index of its "["): bodies run
+    unsigned long long *loop_ticks; // per loop: timer ticks from entering its body to
+                                    // leaving it (a shortcut alone is not timed)
+    unsigned long long total_ticks;
+    double total_nanoseconds;
+} Profile;
+
+Profile *new_profile(const Program *program);
+
+void free_profile(Profile *profile);
+
+int execute_program_profiled(const Program *program, SystemMemory *mem,
+                             Profile *profile, Stepper step);
+
+void print_profile_report(const Profile *profile, const Program *program,
+                          const char *source, FILE *out);
+
+void write_folded_stacks(const Profile *profile, const Program *program,
+                         const char *source, FILE *out);
+
+int execute_code_profiled(const char *source, long source_length,
+                          SystemMemory *mem, Stepper step, const char *folded_path);
+
+#endif
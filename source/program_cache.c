@@ -0,0 +1,206 @@
+/*
+ * A thread-safe cache of compiled programs keyed by their source text, which
+ * keeps the capacity most recently used programs. Entries are found through a
+ * hash table on the FNV-1a hash of the source (hash_source()) and ordered in a
+ * doubly linked list from most to least recently used. A program that is
+ * evicted while a run still uses it is freed when that run releases it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "program_cache.h"
+#include "translator.h"
+
+#define CACHE_BUCKETS 1024
+
+struct CacheEntry {
+    char *source;
+    long source_length;
+    unsigned long hash;
+    BfProgram *program;
+    int references;   // runs using the program, plus one while it is cached
+    CacheEntry *next_in_bucket;
+    CacheEntry *newer; // LRU list neighbours
+    CacheEntry *older;
+};
+
+struct ProgramCache {
+    pthread_mutex_t lock;
+    int capacity;
+    int size;
+    long hits;
+    long misses;
+    CacheEntry *buckets[CACHE_BUCKETS];
+    CacheEntry *newest;
+    CacheEntry *oldest;
+};
+
+/*
+ * Creates an empty cache that keeps up to capacity programs.
+ */
+ProgramCache *new_program_cache(int capacity) {
+    ProgramCache *cache = calloc(1, sizeof(ProgramCache));
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->capacity = capacity > 0 ? capacity : 1;
+    return cache;
+}
+
+static void free_entry(CacheEntry *entry) {
+    bf_program_free(entry->program);
+    free(entry->source);
+    free(entry);
+}
+
+static void unlink_from_list(ProgramCache *cache, CacheEntry *entry) {
+    if (entry->newer != NULL) {
+        entry->newer->older = entry->older;
+    } else {
+        cache->newest = entry->older;
+    }
+    if (entry->older != NULL) {
+        entry->older->newer = entry->newer;
+    } else {
+        cache->oldest = entry->newer;
+    }
+}
+
+static void push_newest(ProgramCache *cache, CacheEntry *entry) {
+    entry->newer = NULL;
+    entry->older = cache->newest;
+    if (cache->newest != NULL) {
+        cache->newest->newer = entry;
+    } else {
+        cache->oldest = entry;
+    }
+    cache->newest = entry;
+}
+
+/*
+ * Removes the least recently used entry. The cache lock must be held.
+ */
+static void evict_oldest(ProgramCache *cache) {
+    CacheEntry *entry = cache->oldest;
+    CacheEntry **link = &cache->buckets[entry->hash % CACHE_BUCKETS];
+    while (*link != entry) {
+        link = &(*link)->next_in_bucket;
+    }
+    *link = entry->next_in_bucket;
+    unlink_from_list(cache, entry);
+    cache->size--;
+    if (--entry->references == 0) {
+        free_entry(entry);
+    }
+}
+
+/*
+ * Returns the cached entry for source, or NULL. The cache lock must be held.
+ */
+static CacheEntry *find_entry(ProgramCache *cache, const char *source,
+                              long source_length, unsigned long hash) {
+    CacheEntry *entry;
+    for (entry = cache->buckets[hash % CACHE_BUCKETS]; entry != NULL;
+         entry = entry->next_in_bucket) {
+        if (entry->hash == hash && entry->source_length == source_length
+                && memcmp(entry->source, source, source_length) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Returns the compiled program for source, compiling and caching it if it is
+ * not cached yet. The caller must hand the entry back with
+ * program_cache_release() when done. Returns NULL (and the reason in status)
+ * if the source does not compile.
+ */
+CacheEntry *program_cache_acquire(ProgramCache *cache, const char *source,
+                                  long source_length, BfStatus *status) {
+    unsigned long hash = hash_source(source, source_length);
+    pthread_mutex_lock(&cache->lock);
+    CacheEntry *entry = find_entry(cache, source, source_length, hash);
+    if (entry != NULL) {
+        cache->hits++;
+        unlink_from_list(cache, entry);
+        push_newest(cache, entry);
+        entry->references++;
+        pthread_mutex_unlock(&cache->lock);
+        *status = BF_OK;
+        return entry;
+    }
+    cache->misses++;
+    pthread_mutex_unlock(&cache->lock);
+
+    // compile without holding the lock
+    BfProgram *program;
+    *status = bf_compile(source, source_length, &program, NULL);
+    if (*status != BF_OK) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    entry = find_entry(cache, source, source_length, hash);
+    if (entry != NULL) { // compiled by another thread in the meantime
+        bf_program_free(program);
+        entry->references++;
+        pthread_mutex_unlock(&cache->lock);
+        return entry;
+    }
+    entry = malloc(sizeof(CacheEntry));
+    entry->source = malloc(source_length > 0 ? source_length : 1);
+    memcpy(entry->source, source, source_length);
+    entry->source_length = source_length;
+    entry->hash = hash;
+    entry->program = program;
+    entry->references = 2;
+    entry->next_in_bucket = cache->buckets[hash % CACHE_BUCKETS];
+    cache->buckets[hash % CACHE_BUCKETS] = entry;
+    push_newest(cache, entry);
+    cache->size++;
+    if (cache->size > cache->capacity) {
+        evict_oldest(cache);
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return entry;
+}
+
+/*
+ * Hands back an entry returned by program_cache_acquire().
+ */
+void program_cache_release(ProgramCache *cache, CacheEntry *entry) {
+    pthread_mutex_lock(&cache->lock);
+    int unused = --entry->references == 0;
+    pthread_mutex_unlock(&cache->lock);
+    if (unused) {
+        free_entry(entry);
+    }
+}
+
+const BfProgram *cache_entry_program(const CacheEntry *entry) {
+    return entry->program;
+}
+
+/*
+ * Reports how many lookups found a cached program, how many had to compile
+ * one and how many programs are cached.
+ */
+void program_cache_stats(ProgramCache *cache, long *hits, long *misses,
+                         int *size) {
+    pthread_mutex_lock(&cache->lock);
+    *hits = cache->hits;
+    *misses = cache->misses;
+    *size = cache->size;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/*
+ * Free the cache and every cached program. No entry may still be in use.
+ */
+void program_cache_free(ProgramCache *cache) {
+    while (cache->oldest != NULL) {
+        evict_oldest(cache);
+    }
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
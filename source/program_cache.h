@@ -0,0 +1,24 @@
+#include "bf.h"
+
+#ifndef PROGRAM_CACHE_HEADER
+#define PROGRAM_CACHE_HEADER
+
+typedef struct ProgramCache ProgramCache;
+
+typedef struct CacheEntry CacheEntry;
+
+ProgramCache *new_program_cache(int capacity);
+
+void program_cache_free(ProgramCache *cache);
+
+CacheEntry *program_cache_acquire(ProgramCache *cache, const char *source,
+                                  long source_length, BfStatus *status);
+
+void program_cache_release(ProgramCache *cache, CacheEntry *entry);
+
+const BfProgram *cache_entry_program(const CacheEntry *entry);
+
+void program_cache_stats(ProgramCache *cache, long *hits, long *misses,
+                         int *size);
+
+#endif
@@ -1,38 +1,374 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <getopt.h>
+#include <unistd.h>
 #include "interpreter.h"
+#include "jit.h"
+#include "translator.h"
+#include "io.h"
+#include "source_file.h"
+#include "virtual_tape.h"
+#include "cell_models.h"
+#include "batch.h"
+#include "daemon.h"
+#include "profiler.h"
+#include "checkpoint.h"
+#include "compiled_file.h"
+#include "perf_counters.h"
 
-char *read_file_as_str(const char *file_name) {
-    FILE *file = fopen(file_name, "rb");
-    if (file == NULL) {
-        printf("Error: File \"%s\" not found.\n", file_name);
-        exit(EXIT_FAILURE);
-    }
-
-    fseek(file, 0, SEEK_END);
-    long file_size = ftell(file);
-    rewind(file);
-    char *instructions = malloc(file_size + 1);
-    fread(instructions, 1, file_size, file);
-    instructions[file_size] = '\0'; // null-terminate string
-    fclose(file);
-    return instructions;
+static void print_usage() {
+    printf("Usage: run [options] file (\"-\" reads the program from stdin)\n"
+           "       run --batch [--threads=N] [--tape-size=N] [--fuel=N] manifest\n"
+           "       run --serve=SOCKET [--threads=N] [--tape-size=N] [--cache-size=N]\n"
+           "                          [--fuel=N]\n"
+           "Options:\n"
+           "  --engine=NAME   execution engine: tiered (default), switch, threaded or jit\n"
+           "  --flush=POLICY  when output is written: auto (default; per line on a\n"
+           "                  terminal, otherwise when the buffer fills), line or full\n"
+           "  --cells=MODEL   what a cell holds: saturating-7-bit (default; 0 to 127),\n"
+           "                  wrap-u8, wrap-u16, wrap-u32 (wrapping unsigned), or\n"
+           "                  checked-u8 (0 to 255, leaving the range is an error);\n"
+           "                  models other than the default have their own engine\n"
+           "  --tape-size=N   number of memory cells (default 30000)\n"
+           "  --virtual-tape  reserve a large tape (default 2^30 cells) that uses memory\n"
+           "                  only where it is touched; moving off it is an error\n"
+           "                  instead of sticking at the edge\n"
+           "  --batch         run the jobs in manifest, one \"program input output\" per\n"
+           "                  line, on a pool of threads and report each job's time\n"
+           "  --threads=N     worker threads for --batch and --serve (default: one\n"
+           "                  per CPU)\n"
+           "  --serve=SOCKET  run as a daemon serving programs sent with bf-client\n"
+           "                  over a Unix domain socket\n"
+           "  --cache-size=N  compiled programs the daemon keeps (default 256)\n"
+           "  --profile[=FILE] report where the program spends its time (on stderr),\n"
+           "                  and write folded stacks for flame graphs to FILE\n"
+           "  --perf-counters report cycles, instructions, branch misses and L1d\n"
+           "                  misses of the run (on stderr), where the CPU and\n"
+           "                  kernel allow counting them\n"
+           "  --bf2c          print the program translated to C instead of running it\n"
+           "  --native        run the program as a native executable built with gcc\n"
+           "                  (cached by source hash in $BF_CACHE_DIR or ~/.cache/bf)\n");
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
+    static struct option long_options[] = {
+        {"engine", required_argument, NULL, 'e'},
+        {"flush", required_argument, NULL, 'f'},
+        {"cells", required_argument, NULL, 'm'},
+        {"tape-size", required_argument, NULL, 't'},
+        {"virtual-tape", no_argument, NULL, 'v'},
+        {"batch", no_argument, NULL, 'b'},
+        {"threads", required_argument, NULL, 'j'},
+        {"fuel", required_argument, NULL, 'F'},
+        {"serve", required_argument, NULL, 's'},
+        {"cache-size", required_argument, NULL, 'k'},
+        {"profile", optional_argument, NULL, 'p'},
+        {"perf-counters", no_argument, NULL, 'P'},
+        {"checkpoint", required_argument, NULL, 'C'},
+        {"checkpoint-every", required_argument, NULL, 'E'},
+        {"resume", required_argument, NULL, 'r'},
+        {"emit-bfc", required_argument, NULL, 'w'},
+        {"bfc", required_argument, NULL, 'B'},
+        {"bf2c", no_argument, NULL, 'c'},
+        {"native", no_argument, NULL, 'n'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    Engine engine = NULL;
+    const CellModel *default_cell_model = find_cell_model("saturating-7-bit");
+    const CellModel *cell_model = default_cell_model;
+    FlushPolicy flush_policy = FLUSH_AUTO;
+    int tape_size = 0; // 0: the default for the kind of tape
+    int virtual_tape = 0;
+    int batch = 0;
+    int num_threads = 0; // 0: one per CPU
+    long fuel = 0;       // 0: no limit
+    const char *socket_path = NULL;
+    int cache_capacity = DEFAULT_CACHE_CAPACITY;
+    int profile = 0;
+    const char *folded_path = NULL;
+    int perf_counters = 0;
+    CheckpointSettings checkpoint = {NULL, 0, NULL, 0};
+    const char *resume_path = NULL;
+    const char *emit_path = NULL;
+    const char *compiled_path = NULL;
+    int translate_only = 0;
+    int native = 0;
+    int option;
+    while ((option = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        switch (option) {
+            case 'e':
+                engine = find_engine(optarg);
+                if (engine == NULL) {
+                    printf("Error: Unknown engine \"%s\".\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'f':
+                if (parse_flush_policy(optarg, &flush_policy) != 0) {
+                    printf("Error: Unknown flush policy \"%s\".\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'm':
+                cell_model = find_cell_model(optarg);
+                if (cell_model == NULL) {
+                    printf("Error: Unknown cell model \"%s\".\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 't':
+                tape_size = atoi(optarg);
+                if (tape_size <= 0) {
+                    printf("Error: Invalid tape size \"%s\".\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'v':
+                virtual_tape = 1;
+                break;
+            case 'b':
+                batch = 1;
+                break;
+            case 'j':
+                num_threads = atoi(optarg);
+                if (num_threads <= 0) {
+                    printf("Error: Invalid number of threads \"%s\".\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'F':
+                fuel = atol(optarg);
+                if (fuel <= 0) {
+                    printf("Error: Invalid fuel \"%s\".\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 's':
+                socket_path = optarg;
+                break;
+            case 'k':
+                cache_capacity = atoi(optarg);
+                if (cache_capacity <= 0) {
+                    printf("Error: Invalid cache size \"%s\".\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'p':
+                profile = 1;
+                folded_path = optarg;
+                break;
+            case 'P':
+                perf_counters = 1;
+                break;
+            case 'C':
+                checkpoint.path = optarg;
+                break;
+            case 'E':
+                checkpoint.interval = atol(optarg);
+                if (checkpoint.interval <= 0) {
+                    printf("Error: Invalid checkpoint interval \"%s\".\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'r':
+                resume_path = optarg;
+                break;
+            case 'w':
+                emit_path = optarg;
+                break;
+            case 'B':
+                compiled_path = optarg;
+                break;
+            case 'c':
+                translate_only = 1;
+                break;
+            case 'n':
+                native = 1;
+                break;
+            case 'h':
+                print_usage();
+                return 0;
+            default:
+                print_usage();
+                exit(EXIT_FAILURE);
+        }
+    }
+    // --batch and --serve run the default engine and cells on their own tapes
+    int single_run_options = engine != NULL || flush_policy != FLUSH_AUTO
+                             || cell_model != default_cell_model || virtual_tape || profile
+                             || perf_counters || checkpoint.path != NULL
+                             || checkpoint.interval > 0 || resume_path != NULL
+                             || emit_path != NULL || compiled_path != NULL
+                             || translate_only || native;
+    if (socket_path != NULL) {
+        if (batch || single_run_options || optind != argc) {
+            printf("Error: --serve takes no file and cannot be combined with --batch, "
+                   "--engine, --flush, --cells, --virtual-tape, --profile, "
+                   "--perf-counters, --checkpoint, --checkpoint-every, --resume, "
+                   "--emit-bfc, --bfc, --bf2c or --native.\n");
+            exit(EXIT_FAILURE);
+        }
+        serve(socket_path, num_threads, tape_size ? tape_size : NUM_MEMORY_CELLS,
+              cache_capacity, fuel);
+        exit(EXIT_FAILURE);
+    }
+    if (optind != argc - 1) {
         printf("Error: Provide one command-line argument to specify the input file.\n");
         exit(EXIT_FAILURE);
     }
 
-    const char *file_name = argv[1];
-    char *instructions = read_file_as_str(file_name);
-    SystemMemory *mem = initialize_memory();
-    execute_code(instructions, mem);
+    if (batch && single_run_options) {
+        printf("Error: --batch runs with the default engine and cells and cannot be "
+               "combined with --engine, --flush, --cells, --virtual-tape, --profile, "
+               "--perf-counters, --checkpoint, --checkpoint-every, --resume, "
+               "--emit-bfc, --bfc, --bf2c or --native.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (batch) {
+        if (run_batch(argv[optind], num_threads,
+                      tape_size ? tape_size : NUM_MEMORY_CELLS, fuel) != 0) {
+            exit(EXIT_FAILURE);
+        }
+        return 0;
+    }
+    if (fuel > 0) {
+        printf("Error: --fuel only applies to --batch and --serve.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (resume_path != NULL) {
+        // the run continues with the cells and tape it was checkpointed with
+        CheckpointHeader header;
+        if (read_checkpoint_header(resume_path, &header) != 0) {
+            exit(EXIT_FAILURE);
+        }
+        cell_model = find_cell_model(header.cell_model);
+        if (cell_model == NULL) {
+            printf("Error: Unknown cell model \"%s\".\n", header.cell_model);
+            exit(EXIT_FAILURE);
+        }
+        tape_size = header.tape_size;
+        virtual_tape = header.virtual_tape;
+        if (checkpoint.path == NULL) {
+            checkpoint.path = resume_path;
+        }
+    }
+    if (checkpoint.path == NULL && checkpoint.interval > 0) {
+        printf("Error: --checkpoint-every needs --checkpoint.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (checkpoint.path != NULL && (engine != NULL || profile || translate_only || native)) {
+        printf("Error: --checkpoint and --resume run their own engine and cannot be "
+               "combined with --engine, --profile, --bf2c or --native.\n");
+        exit(EXIT_FAILURE);
+    }
+    if ((emit_path != NULL || compiled_path != NULL)
+            && (profile || translate_only || native || checkpoint.path != NULL
+                || (emit_path != NULL && compiled_path != NULL))) {
+        printf("Error: --emit-bfc and --bfc cannot be combined with each other or with "
+               "--profile, --bf2c, --native, --checkpoint or --resume.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (perf_counters && (profile || translate_only || native || checkpoint.path != NULL
+                          || emit_path != NULL || compiled_path != NULL)) {
+        printf("Error: --perf-counters cannot be combined with --profile, --bf2c, "
+               "--native, --checkpoint, --resume, --emit-bfc or --bfc.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (virtual_tape && (translate_only || native)) {
+        printf("Error: --virtual-tape cannot be combined with --bf2c or --native; "
+               "translated programs use a --tape-size tape.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (profile && (engine != NULL || translate_only || native)) {
+        printf("Error: --profile runs its own engine and cannot be combined with "
+               "--engine, --bf2c or --native.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (cell_model->engine != NULL && !profile && checkpoint.path == NULL) {
+        if (engine != NULL || translate_only || native) {
+            printf("Error: The %s cell model has its own engine and cannot be "
+                   "combined with --engine, --bf2c or --native.\n", cell_model->name);
+            exit(EXIT_FAILURE);
+        }
+        engine = cell_model->engine;
+    } else if (engine == NULL) {
+        engine = execute_program_tiered;
+    }
 
-    free(instructions);
+    const char *file_name = argv[optind];
+    SourceFile *source = load_source(file_name);
+    if (source == NULL) {
+        printf("Error: File \"%s\" not found.\n", file_name);
+        exit(EXIT_FAILURE);
+    }
+    if (translate_only) {
+        Program *program = compile_program(source->data, source->length);
+        if (program == NULL) {
+            exit(EXIT_FAILURE);
+        }
+        optimize_program(program);
+        translate_specialized(program, tape_size ? tape_size : NUM_MEMORY_CELLS, stdout);
+        free_program(program);
+        free_source(source);
+        return 0;
+    }
+    if (native) {
+        char native_path[4096];
+        if (build_native(source->data, source->length,
+                         tape_size ? tape_size : NUM_MEMORY_CELLS, native_path,
+                         sizeof(native_path)) != 0) {
+            exit(EXIT_FAILURE);
+        }
+        free_source(source);
+        fflush(stdout);
+        execl(native_path, native_path, (char *) NULL);
+        printf("Error: cannot run \"%s\".\n", native_path);
+        exit(EXIT_FAILURE);
+    }
+    io_set_flush_policy(flush_policy);
+    SystemMemory *mem;
+    if (virtual_tape) {
+        mem = initialize_virtual_memory(tape_size ? tape_size : DEFAULT_VIRTUAL_TAPE_SIZE,
+                                        cell_model->cell_size);
+        if (mem == NULL) {
+            printf("Error: cannot reserve memory for the tape.\n");
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        mem = initialize_memory_with_cells(tape_size ? tape_size : NUM_MEMORY_CELLS,
+                                           cell_model->cell_size);
+    }
+    if (emit_path != NULL) {
+        int status = compile_to_file(emit_path, source->data, source->length, mem);
+        free_source(source);
+        free_mem(mem);
+        return status == 0 ? 0 : EXIT_FAILURE;
+    }
+    checkpoint.cell_model = cell_model->name;
+    checkpoint.virtual_tape = virtual_tape;
+    int status = profile
+        ? execute_code_profiled(source->data, source->length, mem, cell_model->step,
+                                folded_path)
+        : checkpoint.path != NULL
+        ? execute_code_checkpointed(source->data, source->length, mem, cell_model->step,
+                                    &checkpoint, resume_path)
+        : perf_counters
+        ? execute_code_with_perf_counters(source->data, source->length, mem, engine)
+        : compiled_path != NULL
+        ? execute_compiled_file(compiled_path, source->data, source->length, mem, engine)
+        : execute_code_with_engine(source->data, source->length, mem, engine);
+
+    free_source(source);
     free_mem(mem);
+    if (status == CHECKPOINT_STOPPED) {
+        fprintf(stderr, "Stopped; resume with --resume=%s.\n", checkpoint.path);
+        exit(EXIT_FAILURE);
+    }
+    if (status != 0) {
+        exit(EXIT_FAILURE);
+    }
     puts("\n");
     return 0;
 }
@@ -0,0 +1,237 @@
+/*
+ * Green threads: runs any number of BfTasks, thousands at once if need be, on
+ * a fixed pool of worker threads. A worker takes the task at the front of a
+ * shared run queue and runs it for a quantum of fuel, that is of loop
+ * iterations (see bf_task_run()); a task that has not ended by then goes to
+ * the back of the queue for its next turn. So a long or endless program holds
+ * a worker for one quantum at a time and cannot keep the others waiting, and
+ * a task stopped at its own limit of fuel has a hard cap on the CPU time it
+ * takes, without a thread per program or a count of every instruction run.
+ *
+ * A task whose input is streamed from a pipe or socket stops at a "," that
+ * finds no input yet and leaves the run queue. Its descriptor is added to an
+ * epoll set that one more thread waits on; when bytes (or the end of the
+ * input) arrive, that thread reads them into the task and puts the task back
+ * in the run queue. So programs waiting for input hold no worker at all.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "scheduler.h"
+
+#define INPUT_READ_SIZE 65536 // bytes read from an input at a time
+#define MAX_EVENTS 64
+
+enum { TURN_AGAIN, TURN_ENDED, TURN_WAITING };
+
+typedef struct {
+    GreenThread *threads;
+    int num_threads;
+    long quantum;
+    int *run_queue;      // a ring of the indices of the threads waiting for a turn
+    int queue_start;
+    int queue_length;
+    int num_running;     // threads that have not ended
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    int epoll_fd;        // the inputs of the threads waiting for input
+    int wake_fd;         // an eventfd that tells the input thread to stop
+    struct timespec start;
+} Scheduler;
+
+/*
+ * Gives the thread at index a turn: runs it for a quantum, or less if that
+ * would take it past its limit. Returns TURN_ENDED if it has ended,
+ * TURN_WAITING if it waits for input, otherwise TURN_AGAIN.
+ */
+static int run_turn(Scheduler *scheduler, int index) {
+    GreenThread *thread = &scheduler->threads[index];
+    long limit = thread->fuel > 0 ? thread->fuel : LONG_MAX;
+    long turn = limit - thread->fuel_used < scheduler->quantum
+                ? limit - thread->fuel_used : scheduler->quantum;
+    long fuel = turn;
+    BfStatus status = bf_task_run(thread->task, &fuel);
+    thread->fuel_used += turn - fuel;
+    if (status == BF_WAITING) {
+        return TURN_WAITING;
+    }
+    if (status == BF_YIELDED && thread->fuel_used < limit) {
+        return TURN_AGAIN;
+    }
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    thread->status = status == BF_YIELDED ? BF_ERROR_OUT_OF_FUEL : status;
+    thread->milliseconds = (end.tv_sec - scheduler->start.tv_sec) * 1e3
+                           + (end.tv_nsec - scheduler->start.tv_nsec) / 1e6;
+    return TURN_ENDED;
+}
+
+/*
+ * Reads what is available of the input of the thread at index into its task;
+ * on the end of the input, or an error, ends the task's input.
+ */
+static void read_input(GreenThread *thread) {
+    char buffer[INPUT_READ_SIZE];
+    ssize_t length;
+    do {
+        length = read(thread->input_fd, buffer, sizeof(buffer));
+    } while (length < 0 && errno == EINTR);
+    if (length < 0 && errno == EAGAIN) {
+        return; // nothing after all: the task runs and waits again
+    }
+    bf_task_add_input(thread->task, buffer, length > 0 ? length : 0);
+}
+
+/*
+ * Puts the thread at index at the back of the run queue. Call with the lock
+ * held.
+ */
+static void make_runnable(Scheduler *scheduler, int index) {
+    int end = (scheduler->queue_start + scheduler->queue_length) % scheduler->num_threads;
+    scheduler->run_queue[end] = index;
+    scheduler->queue_length++;
+    pthread_cond_signal(&scheduler->changed);
+}
+
+/*
+ * Waits for input to arrive for the thread at index, which is waiting for it:
+ * adds its input to the epoll set, or, for an input epoll cannot wait on (a
+ * regular file, which never blocks for long), reads it right away. Returns 1
+ * if the thread can run again now.
+ */
+static int wait_for_input(Scheduler *scheduler, int index) {
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.u32 = index;
+    if (epoll_ctl(scheduler->epoll_fd, EPOLL_CTL_ADD, scheduler->threads[index].input_fd,
+                  &event) == 0) {
+        return 0;
+    }
+    read_input(&scheduler->threads[index]);
+    return 1;
+}
+
+static void *run_scheduler_worker(void *argument) {
+    Scheduler *scheduler = argument;
+    pthread_mutex_lock(&scheduler->lock);
+    while (1) {
+        while (scheduler->queue_length == 0 && scheduler->num_running > 0) {
+            pthread_cond_wait(&scheduler->changed, &scheduler->lock);
+        }
+        if (scheduler->num_running == 0) {
+            break;
+        }
+        int index = scheduler->run_queue[scheduler->queue_start];
+        scheduler->queue_start = (scheduler->queue_start + 1) % scheduler->num_threads;
+        scheduler->queue_length--;
+        pthread_mutex_unlock(&scheduler->lock);
+        int result = run_turn(scheduler, index);
+        if (result == TURN_WAITING && wait_for_input(scheduler, index)) {
+            result = TURN_AGAIN;
+        }
+        pthread_mutex_lock(&scheduler->lock);
+        if (result == TURN_ENDED) {
+            scheduler->num_running--;
+            if (scheduler->num_running == 0) {
+                pthread_cond_broadcast(&scheduler->changed);
+                uint64_t one = 1;
+                write(scheduler->wake_fd, &one, sizeof(one)); // stops the input thread
+            }
+        } else if (result == TURN_AGAIN) {
+            make_runnable(scheduler, index);
+        }
+    }
+    pthread_mutex_unlock(&scheduler->lock);
+    return NULL;
+}
+
+/*
+ * The input thread: reads the input that arrives for waiting threads and puts
+ * them back in the run queue, until every thread has ended.
+ */
+static void *run_input_thread(void *argument) {
+    Scheduler *scheduler = argument;
+    struct epoll_event events[MAX_EVENTS];
+    while (1) {
+        int num_events = epoll_wait(scheduler->epoll_fd, events, MAX_EVENTS, -1);
+        int i;
+        if (num_events < 0 && errno != EINTR) {
+            return NULL;
+        }
+        for (i = 0; i < num_events; i++) {
+            int index = events[i].data.u32;
+            if (index == scheduler->num_threads) {
+                return NULL;
+            }
+            GreenThread *thread = &scheduler->threads[index];
+            epoll_ctl(scheduler->epoll_fd, EPOLL_CTL_DEL, thread->input_fd, NULL);
+            read_input(thread);
+            pthread_mutex_lock(&scheduler->lock);
+            make_runnable(scheduler, index);
+            pthread_mutex_unlock(&scheduler->lock);
+        }
+    }
+}
+
+/*
+ * Runs the tasks of num_threads green threads to their ends, or until they
+ * have used their fuel, on num_workers threads (0: one per online CPU), taking
+ * turns of quantum loop iterations. Sets each thread's status, fuel used and
+ * time.
+ */
+void run_green_threads(GreenThread *threads, int num_threads, int num_workers,
+                       long quantum) {
+    int i;
+    if (num_workers <= 0) {
+        num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (num_workers > num_threads) {
+        num_workers = num_threads > 0 ? num_threads : 1;
+    }
+    Scheduler scheduler;
+    scheduler.threads = threads;
+    scheduler.num_threads = num_threads;
+    scheduler.quantum = quantum;
+    scheduler.run_queue = malloc(sizeof(int) * (num_threads + 1));
+    scheduler.queue_start = 0;
+    scheduler.queue_length = num_threads;
+    scheduler.num_running = num_threads;
+    pthread_mutex_init(&scheduler.lock, NULL);
+    pthread_cond_init(&scheduler.changed, NULL);
+    scheduler.epoll_fd = epoll_create1(0);
+    scheduler.wake_fd = eventfd(num_threads == 0, 0);
+    struct epoll_event wake_event;
+    wake_event.events = EPOLLIN;
+    wake_event.data.u32 = num_threads;
+    epoll_ctl(scheduler.epoll_fd, EPOLL_CTL_ADD, scheduler.wake_fd, &wake_event);
+    clock_gettime(CLOCK_MONOTONIC, &scheduler.start);
+    for (i = 0; i < num_threads; i++) {
+        scheduler.run_queue[i] = i;
+        threads[i].status = BF_OK;
+        threads[i].fuel_used = 0;
+        threads[i].milliseconds = 0;
+    }
+    pthread_t input_thread;
+    pthread_create(&input_thread, NULL, run_input_thread, &scheduler);
+    pthread_t *workers = malloc(sizeof(pthread_t) * num_workers);
+    for (i = 0; i < num_workers; i++) {
+        pthread_create(&workers[i], NULL, run_scheduler_worker, &scheduler);
+    }
+    for (i = 0; i < num_workers; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    pthread_join(input_thread, NULL);
+    close(scheduler.wake_fd);
+    close(scheduler.epoll_fd);
+    pthread_cond_destroy(&scheduler.changed);
+    pthread_mutex_destroy(&scheduler.lock);
+    free(scheduler.run_queue);
+    free(workers);
+}
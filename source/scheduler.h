@@ -0,0 +1,23 @@
+#include "bf.h"
+
+#ifndef SCHEDULER_HEADER
+#define SCHEDULER_HEADER
+
+#define GREEN_THREAD_QUANTUM 65536L // loop iterations a task runs before the next one's turn
+
+/*
+ * A task for run_green_threads() and, once it has run, its result.
+ */
+typedef struct {
+    BfTask *task;
+    long fuel;           // loop iterations it may run in all; 0: no limit
+    int input_fd;        // for a task with streamed input: its own pipe or socket
+    BfStatus status;     // BF_OK, or BF_ERROR_OUT_OF_FUEL if it was stopped
+    long fuel_used;
+    double milliseconds; // from the start of run_green_threads() to the task's end
+} GreenThread;
+
+void run_green_threads(GreenThread *threads, int num_threads, int num_workers,
+                       long quantum);
+
+#endif
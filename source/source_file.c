@@ -0,0 +1,94 @@
+/*
+ * Loads program source. Regular files are memory-mapped read-only, so even very
+ * large generated programs are never copied. Pipes, terminals and stdin
+ * (file name "-") cannot be mapped and are read into a growing buffer instead.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "source_file.h"
+
+/*
+ * Reads everything from fd into a heap buffer. Returns NULL on a read error.
+ */
+static SourceFile *read_stream(int fd) {
+    long capacity = 65536;
+    char *data = malloc(capacity);
+    long length = 0;
+    while (1) {
+        if (length == capacity) {
+            capacity *= 2;
+            data = realloc(data, capacity);
+        }
+        ssize_t result = read(fd, data + length, capacity - length);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result < 0) {
+            free(data);
+            return NULL;
+        }
+        if (result == 0) {
+            break;
+        }
+        length += result;
+    }
+    SourceFile *source = malloc(sizeof(SourceFile));
+    source->data = data;
+    source->length = length;
+    source->is_mapped = 0;
+    return source;
+}
+
+/*
+ * Loads the source in file_name ("-" for stdin). Returns NULL (with errno set)
+ * if it cannot be read. Free the result with free_source().
+ */
+SourceFile *load_source(const char *file_name) {
+    struct stat file_stat;
+    if (strcmp(file_name, "-") == 0) {
+        return read_stream(STDIN_FILENO);
+    }
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        return NULL;
+    }
+    if (!S_ISREG(file_stat.st_mode) || file_stat.st_size == 0) {
+        // e.g. a named pipe; an empty file cannot be mapped either
+        SourceFile *source = read_stream(fd);
+        close(fd);
+        return source;
+    }
+    void *data = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+    madvise(data, file_stat.st_size, MADV_SEQUENTIAL);
+    SourceFile *source = malloc(sizeof(SourceFile));
+    source->data = data;
+    source->length = file_stat.st_size;
+    source->is_mapped = 1;
+    return source;
+}
+
+/*
+ * Releases a loaded source.
+ */
+void free_source(SourceFile *source) {
+    if (source->is_mapped) {
+        munmap((void *) source->data, source->length);
+    } else {
+        free((void *) source->data);
+    }
+    free(source);
+}
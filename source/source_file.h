@@ -0,0 +1,14 @@
+#ifndef SOURCE_FILE_HEADER
+#define SOURCE_FILE_HEADER
+
+typedef struct {
+    const char *data; // not NUL-terminated
+    long length;
+    int is_mapped;
+} SourceFile;
+
+SourceFile *load_source(const char *file_name);
+
+void free_source(SourceFile *source);
+
+#endif
@@ -0,0 +1,198 @@
+/*
+ * Kernels that search the tape for the cell a scan loop ("[>]", "[<<]") or a
+ * clear-run loop ("[[-]>]") stops at. On x86 the search compares 32 (AVX2) or
+ * 16 (SSE2) cells per step; the best kernel the CPU supports is picked the first
+ * time one is needed. Strides that do not divide the vector width, and CPUs
+ * without SSE2, use the scalar kernel.
+ *
+ * Every kernel looks at the cells start, start + stride, start + 2 * stride, ...
+ * (stride may be negative) and returns the index of the first one that matches,
+ * or -1 if the search reaches an end of the tape first. Cells outside
+ * [0, tape_size) are never read.
+ */
+
+#include <stdlib.h>
+#include "tape_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS
+#endif
+
+typedef long (*FindCellKernel)(const char *tape, long tape_size, long start,
+                               int stride, int non_positive);
+
+/*
+ * The scalar kernel. Matches a cell holding 0, or any cell <= 0 if
+ * non_positive is set.
+ */
+static long find_cell_scalar(const char *tape, long tape_size, long start,
+                             int stride, int non_positive) {
+    long i;
+    for (i = start; i >= 0 && i < tape_size; i += stride) {
+        if (tape[i] == 0 || (non_positive && tape[i] < 0)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Returns a movemask selecting the lanes of a width-cell block that are
+ * candidates of a scan with the given stride. Forward scans start each block on
+ * a candidate (lane 0); backward scans start on the last lane.
+ */
+static unsigned int stride_mask(int stride, int width) {
+    int lane;
+    int step = abs(stride);
+    unsigned int mask = 0;
+    for (lane = 0; lane < width; lane++) {
+        int distance = stride > 0 ? lane : width - 1 - lane;
+        if (distance % step == 0) {
+            mask |= 1u << lane;
+        }
+    }
+    return mask;
+}
+
+#ifdef HAVE_X86_KERNELS
+
+__attribute__((target("sse2")))
+static long find_cell_sse2(const char *tape, long tape_size, long start,
+                           int stride, int non_positive) {
+    long i = start;
+    if (16 % abs(stride) != 0) {
+        return find_cell_scalar(tape, tape_size, start, stride, non_positive);
+    }
+    unsigned int lanes = stride_mask(stride, 16);
+    __m128i zero = _mm_setzero_si128();
+    __m128i one = _mm_set1_epi8(1);
+    if (stride > 0) {
+        for (; i + 16 <= tape_size; i += 16) {
+            __m128i cells = _mm_loadu_si128((const __m128i *) (tape + i));
+            __m128i hits = non_positive ? _mm_cmpgt_epi8(one, cells)
+                                        : _mm_cmpeq_epi8(cells, zero);
+            unsigned int mask = _mm_movemask_epi8(hits) & lanes;
+            if (mask != 0) {
+                return i + __builtin_ctz(mask);
+            }
+        }
+    } else {
+        for (; i - 15 >= 0 && i < tape_size; i -= 16) {
+            __m128i cells = _mm_loadu_si128((const __m128i *) (tape + i - 15));
+            __m128i hits = non_positive ? _mm_cmpgt_epi8(one, cells)
+                                        : _mm_cmpeq_epi8(cells, zero);
+            unsigned int mask = _mm_movemask_epi8(hits) & lanes;
+            if (mask != 0) {
+                return i - 15 + (31 - __builtin_clz(mask));
+            }
+        }
+    }
+    // finish the cells that do not fill a whole vector
+    return find_cell_scalar(tape, tape_size, i, stride, non_positive);
+}
+
+__attribute__((target("avx2")))
+static long find_cell_avx2(const char *tape, long tape_size, long start,
+                           int stride, int non_positive) {
+    long i = start;
+    if (32 % abs(stride) != 0) {
+        return find_cell_scalar(tape, tape_size, start, stride, non_positive);
+    }
+    unsigned int lanes = stride_mask(stride, 32);
+    __m256i zero = _mm256_setzero_si256();
+    __m256i one = _mm256_set1_epi8(1);
+    if (stride > 0) {
+        for (; i + 32 <= tape_size; i += 32) {
+            __m256i cells = _mm256_loadu_si256((const __m256i *) (tape + i));
+            __m256i hits = non_positive ? _mm256_cmpgt_epi8(one, cells)
+                                        : _mm256_cmpeq_epi8(cells, zero);
+            unsigned int mask = (unsigned int) _mm256_movemask_epi8(hits) & lanes;
+            if (mask != 0) {
+                return i + __builtin_ctz(mask);
+            }
+        }
+    } else {
+        for (; i - 31 >= 0 && i < tape_size; i -= 32) {
+            __m256i cells = _mm256_loadu_si256((const __m256i *) (tape + i - 31));
+            __m256i hits = non_positive ? _mm256_cmpgt_epi8(one, cells)
+                                        : _mm256_cmpeq_epi8(cells, zero);
+            unsigned int mask = (unsigned int) _mm256_movemask_epi8(hits) & lanes;
+            if (mask != 0) {
+                return i - 31 + (31 - __builtin_clz(mask));
+            }
+        }
+    }
+    return find_cell_sse2(tape, tape_size, i, stride, non_positive);
+}
+
+#endif
+
+static FindCellKernel find_cell_kernel = NULL;
+static const char *find_cell_kernel_name = NULL;
+
+/*
+ * Picks the widest kernel the CPU supports.
+ */
+static void select_kernel() {
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        find_cell_kernel_name = "avx2";
+        find_cell_kernel = find_cell_avx2;
+        return;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        find_cell_kernel_name = "sse2";
+        find_cell_kernel = find_cell_sse2;
+        return;
+    }
+#endif
+    find_cell_kernel_name = "scalar";
+    find_cell_kernel = find_cell_scalar;
+}
+
+/*
+ * Returns the index of the first cell holding 0 that a scan from start with the
+ * given stride reaches, or -1 if the scan runs into an end of the tape first.
+ */
+long find_zero_cell(const char *tape, long tape_size, long start, int stride) {
+    if (find_cell_kernel == NULL) {
+        select_kernel();
+    }
+    return find_cell_kernel(tape, tape_size, start, stride, 0);
+}
+
+/*
+ * Returns the index of the first cell holding 0 or a negative value that a scan
+ * from start with the given stride reaches, or -1 if the scan runs into an end
+ * of the tape first.
+ */
+long find_non_positive_cell(const char *tape, long tape_size, long start,
+                            int stride) {
+    if (find_cell_kernel == NULL) {
+        select_kernel();
+    }
+    return find_cell_kernel(tape, tape_size, start, stride, 1);
+}
+
+/*
+ * Returns the last cell a scan from start with the given stride visits before
+ * the next step would leave the tape.
+ */
+long last_cell_in_range(long tape_size, long start, int stride) {
+    if (stride > 0) {
+        return start + (tape_size - 1 - start) / stride * stride;
+    }
+    return start % -stride;
+}
+
+/*
+ * Returns the name of the kernel in use ("avx2", "sse2" or "scalar").
+ */
+const char *tape_kernel_name() {
+    if (find_cell_kernel == NULL) {
+        select_kernel();
+    }
+    return find_cell_kernel_name;
+}
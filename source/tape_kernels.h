@@ -0,0 +1,13 @@
+#ifndef TAPE_KERNELS_HEADER
+#define TAPE_KERNELS_HEADER
+
+long find_zero_cell(const char *tape, long tape_size, long start, int stride);
+
+long find_non_positive_cell(const char *tape, long tape_size, long start,
+                            int stride);
+
+long last_cell_in_range(long tape_size, long start, int stride);
+
+const char *tape_kernel_name();
+
+#endif
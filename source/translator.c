@@ -0,0 +1,409 @@
+/*
+ * An ahead-of-time translator from compiled Programs to standalone C. The
+ * generated program uses the interpreter's SystemMemory layout and semantics
+ * (saturating cells, a pointer that sticks at the ends of the tape, 30000
+ * cells unless another size is given) and prints the same trailing newlines
+ * as run, so its output is identical.
+ *
+ * build_native() translates a program and compiles it with gcc -O2, caching the
+ * executable by a hash of the source so the same program is only built once.
+ * The cache directory must belong to the user and be writable by nobody else,
+ * and the source is kept next to each executable and compared before the
+ * executable is reused, so neither another user nor a hash collision can
+ * substitute a different program.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "translator.h"
+#include "optimizer.h"
+#include "source_file.h"
+
+// changes whenever the generated code changes, invalidating cached builds
+#define TRANSLATOR_VERSION "bf2c-4"
+#define NATIVE_CC "gcc"
+#define NATIVE_CC_FLAGS "-O2"
+
+static const char *c_prelude =
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "#include <string.h>\n"
+    "\n"
+    "typedef struct {\n"
+    "    char *tape;\n"
+    "    int tape_size;\n"
+    "    int curr_index;\n"
+    "} SystemMemory;\n"
+    "\n"
+    "static SystemMemory mem;\n"
+    "#define CELL mem.tape[mem.curr_index]\n"
+    "\n"
+    "static void add(int offset, long amount) {\n"
+    "    char *cell = &mem.tape[mem.curr_index + offset];\n"
+    "    if (amount > 0) {\n"
+    "        *cell = *cell > 127 - amount ? 127 : *cell + amount;\n"
+    "    } else if (*cell > 0) {\n"
+    "        *cell = *cell < -amount ? 0 : *cell + amount;\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "static void move(long distance) {\n"
+    "    long index = mem.curr_index + distance;\n"
+    "    mem.curr_index = index < 0 ? 0 : (index > mem.tape_size - 1 ? mem.tape_size - 1 : index);\n"
+    "}\n"
+    "\n"
+    "static int fits(int min_offset, int max_offset) {\n"
+    "    return mem.curr_index + min_offset >= 0\n"
+    "        && mem.curr_index + max_offset <= mem.tape_size - 1;\n"
+    "}\n"
+    "\n"
+    "static void scan(int stride) {\n"
+    "    while (CELL != 0 && fits(stride, stride)) {\n"
+    "        mem.curr_index += stride;\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "static void clear_range(int stride) {\n"
+    "    while (CELL > 0 && fits(stride, stride)) {\n"
+    "        CELL = 0;\n"
+    "        mem.curr_index += stride;\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "int main() {\n";
+
+static const char *c_epilogue =
+    "    free(mem.tape);\n"
+    "    puts(\"\\n\");\n"
+    "    return 0;\n"
+    "}\n";
+
+static void indent(FILE *out, int depth) {
+    fprintf(out, "%*s", 4 * depth, "");
+}
+
+/*
+ * Writes the shortcut for a multiply loop: when the counter is positive and all
+ * targets are on the tape, apply the loop in one step and clear the counter.
+ */
+static void translate_multiply_loop(const Program *program, const Instruction *op,
+                                    FILE *out, int depth) {
+    int i;
+    int min_offset = 0, max_offset = 0;
+    const MultiplyTarget *targets = &program->targets[op->offset];
+    for (i = 0; i < op->arg; i++) {
+        min_offset = targets[i].offset < min_offset ? targets[i].offset : min_offset;
+        max_offset = targets[i].offset > max_offset ? targets[i].offset : max_offset;
+    }
+    indent(out, depth);
+    fprintf(out, "if (CELL > 0 && fits(%d, %d)) {\n", min_offset, max_offset);
+    for (i = 0; i < op->arg; i++) {
+        indent(out, depth + 1);
+        fprintf(out, "add(%d, (long) CELL * %d);\n", targets[i].offset,
+                targets[i].factor);
+    }
+    indent(out, depth + 1);
+    fprintf(out, "CELL = 0;\n");
+    indent(out, depth);
+    fprintf(out, "}\n");
+}
+
+/*
+ * Writes the length bytes of data as a C array called name.
+ */
+static void translate_bytes(const char *name, const char *data, long length, FILE *out) {
+    long i;
+    fprintf(out, "    static const char %s[%ld] = {", name, length);
+    for (i = 0; i < length; i++) {
+        fprintf(out, i % 16 == 0 ? "\n        %d," : " %d,", data[i]);
+    }
+    fprintf(out, "\n    };\n");
+}
+
+/*
+ * Writes program as a standalone C program with a tape of tape_size cells to
+ * out, starting from snapshot (if it is not NULL) instead of a blank tape.
+ * Loops become while loops; a recognized loop is preceded by its shortcut,
+ * after which the while loop finds the cell at 0 and is skipped, or runs the
+ * remaining iterations exactly as the interpreter would when the shortcut does
+ * not apply. Offset-addressed code and the original code after it become the
+ * two branches of an if.
+ */
+void translate_to_c(const Program *program, const Snapshot *snapshot, int tape_size,
+                    FILE *out) {
+    int i;
+    int depth = 1;
+    int original_code_end = -1; // index of the last instruction of the original
+                                // code after offset-addressed code
+    fputs(c_prelude, out);
+    fprintf(out, "    mem.tape_size = %d;\n", tape_size);
+    fprintf(out, "    mem.tape = calloc(mem.tape_size, 1);\n");
+    fprintf(out, "    mem.curr_index = 0;\n");
+    if (snapshot != NULL && snapshot->num_cells > 0) {
+        translate_bytes("snapshot_cells", snapshot->cells, snapshot->num_cells, out);
+        fprintf(out, "    memcpy(mem.tape, snapshot_cells, sizeof(snapshot_cells));\n");
+    }
+    if (snapshot != NULL && snapshot->output_length > 0) {
+        translate_bytes("snapshot_output", snapshot->output, snapshot->output_length, out);
+        fprintf(out, "    fwrite(snapshot_output, 1, sizeof(snapshot_output), stdout);\n");
+    }
+    if (snapshot != NULL) {
+        fprintf(out, "    mem.curr_index = %d;\n", snapshot->curr_index);
+    }
+    for (i = 0; i < program->num_ops; i++) {
+        const Instruction *op = &program->ops[i];
+        if (op->code == OP_JUMP_IF_NOT_ZERO) {
+            depth--;
+            indent(out, depth);
+            fprintf(out, "}\n");
+            continue;
+        }
+        switch (op->code) {
+            case OP_ADD:
+                indent(out, depth);
+                fprintf(out, "add(%d, %d);\n", op->offset, op->arg);
+                break;
+            case OP_MOVE:
+                indent(out, depth);
+                fprintf(out, "move(%d);\n", op->arg);
+                break;
+            case OP_MOVE_UNCHECKED:
+                indent(out, depth);
+                fprintf(out, "mem.curr_index += %d;\n", op->arg);
+                break;
+            case OP_CHECK_RANGE:
+                indent(out, depth);
+                fprintf(out, "if (fits(%d, %d)) {\n", op->offset, op->arg);
+                depth++;
+                break;
+            case OP_JUMP:
+                depth--;
+                indent(out, depth);
+                fprintf(out, "} else {\n");
+                depth++;
+                original_code_end = op->jump;
+                break;
+            case OP_OUTPUT:
+                indent(out, depth);
+                fprintf(out, "putchar(CELL);\n");
+                break;
+            case OP_INPUT:
+                indent(out, depth);
+                fprintf(out, "CELL = getchar();\n");
+                break;
+            case OP_SET_ZERO:
+                indent(out, depth);
+                fprintf(out, op->arg < 0 ? "if (CELL > 0) CELL = 0;\n"
+                                         : "if (CELL < 0) CELL = 0;\n");
+                break;
+            case OP_SCAN:
+                indent(out, depth);
+                fprintf(out, "scan(%d);\n", op->arg);
+                break;
+            case OP_CLEAR_RANGE:
+                indent(out, depth);
+                fprintf(out, "clear_range(%d);\n", op->arg);
+                break;
+            case OP_MULTIPLY_LOOP:
+                translate_multiply_loop(program, op, out, depth);
+                break;
+            default:
+                break;
+        }
+        if (i == original_code_end) {
+            depth--;
+            indent(out, depth);
+            fprintf(out, "}\n");
+        }
+        if (op->code != OP_ADD && op->code != OP_MOVE && op->code != OP_OUTPUT
+                && op->code != OP_INPUT && op->code != OP_MOVE_UNCHECKED
+                && op->code != OP_CHECK_RANGE && op->code != OP_JUMP) {
+            // "[" and every recognized loop open a loop
+            indent(out, depth);
+            fprintf(out, "while (CELL) {\n");
+            depth++;
+        }
+    }
+    fputs(c_epilogue, out);
+}
+
+/*
+ * Writes program, which has been optimized, as a standalone C program with a
+ * tape of tape_size cells to out, specialized for the blank tape it starts
+ * on: the part of it that does not read input is run now, and the C program
+ * starts from where it ends.
+ */
+void translate_specialized(Program *program, int tape_size, FILE *out) {
+    Snapshot *snapshot = NULL;
+    specialize_for_blank_tape(program, tape_size);
+    Program *residual = evaluate_prefix(program, tape_size,
+                                        PARTIAL_EVALUATION_BUDGET, &snapshot);
+    if (residual == NULL) {
+        translate_to_c(program, NULL, tape_size, out);
+        return;
+    }
+    translate_to_c(residual, snapshot, tape_size, out);
+    free_program(residual);
+    free_snapshot(snapshot);
+}
+
+/*
+ * Returns a 64-bit FNV-1a hash of the source.
+ */
+unsigned long hash_source(const char *source, long source_length) {
+    long i;
+    unsigned long hash = 14695981039346656037UL;
+    for (i = 0; i < source_length; i++) {
+        hash ^= (unsigned char) source[i];
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+/*
+ * Writes the cache directory for native builds into path: $BF_CACHE_DIR, or
+ * bf under $XDG_CACHE_HOME or ~/.cache, or /tmp/bf-cache-UID. Creates it if
+ * needed. Returns 0, or -1 if it is not a directory of the user's that only
+ * the user can write to.
+ */
+static int cache_directory(char *path, int path_size) {
+    const char *dir = getenv("BF_CACHE_DIR");
+    struct stat status;
+    if (dir != NULL) {
+        snprintf(path, path_size, "%s", dir);
+    } else if (getenv("XDG_CACHE_HOME") != NULL) {
+        snprintf(path, path_size, "%s/bf", getenv("XDG_CACHE_HOME"));
+    } else if (getenv("HOME") != NULL) {
+        snprintf(path, path_size, "%s/.cache", getenv("HOME"));
+        mkdir(path, 0700);
+        snprintf(path, path_size, "%s/.cache/bf", getenv("HOME"));
+    } else {
+        snprintf(path, path_size, "/tmp/bf-cache-%d", (int) getuid());
+    }
+    mkdir(path, 0700);
+    if (lstat(path, &status) != 0 || !S_ISDIR(status.st_mode)
+            || status.st_uid != getuid() || (status.st_mode & (S_IWGRP | S_IWOTH))) {
+        fprintf(stderr, "Error: the cache directory \"%s\" must be a directory that "
+                "belongs to you and only you can write to.\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Returns 1 if the file at path holds exactly the source_length bytes of
+ * source.
+ */
+static int holds_source(const char *path, const char *source, long source_length) {
+    SourceFile *cached = load_source(path);
+    if (cached == NULL) {
+        return 0;
+    }
+    int same = cached->length == source_length
+               && memcmp(cached->data, source, source_length) == 0;
+    free_source(cached);
+    return same;
+}
+
+/*
+ * Writes the length bytes of data to path. Returns 0 on success, or -1.
+ */
+static int write_file(const char *path, const char *data, long length) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        return -1;
+    }
+    int ok = fwrite(data, 1, length, file) == (size_t) length;
+    return fclose(file) == 0 && ok ? 0 : -1;
+}
+
+/*
+ * Runs the C compiler on c_path, writing the executable to output_path.
+ * Returns 0 if it succeeds.
+ */
+static int run_compiler(const char *c_path, const char *output_path) {
+    char *const argv[] = {NATIVE_CC, NATIVE_CC_FLAGS, "-o", (char *) output_path,
+                          (char *) c_path, NULL};
+    int status;
+    pid_t child = fork();
+    if (child < 0) {
+        return -1;
+    }
+    if (child == 0) {
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    while (waitpid(child, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+/*
+ * Makes sure a native executable for the source with a tape of tape_size cells
+ * exists and writes its path into path. A cached executable (keyed by the
+ * source hash, tape size and translator version, and built from the same
+ * source) is reused; otherwise the source is compiled, translated to C and
+ * built with gcc. Returns 0 on success, or -1 if the source has unbalanced
+ * brackets, the cache directory is unsafe or the build fails.
+ */
+int build_native(const char *source, long source_length, int tape_size, char *path,
+                 int path_size) {
+    char dir[4096];
+    char c_path[4200];
+    char temp_path[4200];
+    char source_path[4200];
+    char temp_source_path[4200];
+    struct stat cached;
+    const char *compiler = TRANSLATOR_VERSION NATIVE_CC " " NATIVE_CC_FLAGS;
+    unsigned long hash = hash_source(source, source_length)
+                         ^ hash_source(compiler, strlen(compiler));
+
+    if (cache_directory(dir, sizeof(dir)) != 0) {
+        return -1;
+    }
+    snprintf(path, path_size, "%s/%016lx-%d", dir, hash, tape_size);
+    snprintf(source_path, sizeof(source_path), "%s.bf", path);
+    if (stat(path, &cached) == 0 && (cached.st_mode & S_IXUSR)
+            && holds_source(source_path, source, source_length)) {
+        return 0;
+    }
+
+    Program *program = compile_program(source, source_length);
+    if (program == NULL) {
+        return -1;
+    }
+    optimize_program(program);
+    // build under temporary names so concurrent runs never see partial files
+    snprintf(c_path, sizeof(c_path), "%s.%d.c", path, getpid());
+    snprintf(temp_path, sizeof(temp_path), "%s.%d", path, getpid());
+    snprintf(temp_source_path, sizeof(temp_source_path), "%s.%d.bf", path, getpid());
+    FILE *c_file = fopen(c_path, "w");
+    if (c_file == NULL) {
+        free_program(program);
+        fprintf(stderr, "Error: cannot write to cache directory \"%s\".\n", dir);
+        return -1;
+    }
+    translate_specialized(program, tape_size, c_file);
+    fclose(c_file);
+    free_program(program);
+
+    int status = run_compiler(c_path, temp_path);
+    unlink(c_path);
+    // the source first: an executable is only used next to its own source
+    if (status != 0 || write_file(temp_source_path, source, source_length) != 0
+            || rename(temp_source_path, source_path) != 0 || rename(temp_path, path) != 0) {
+        unlink(temp_path);
+        unlink(temp_source_path);
+        fprintf(stderr, "Error: native build failed.\n");
+        return -1;
+    }
+    return 0;
+}
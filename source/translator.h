@@ -0,0 +1,18 @@
+#include <stdio.h>
+#include "compiler.h"
+#include "partial_evaluator.h"
+
+#ifndef TRANSLATOR_HEADER
+#define TRANSLATOR_HEADER
+
+void translate_to_c(const Program *program, const Snapshot *snapshot, int tape_size,
+                    FILE *out);
+
+void translate_specialized(Program *program, int tape_size, FILE *out);
+
+unsigned long hash_source(const char *source, long source_length);
+
+int build_native(const char *source, long source_length, int tape_size, char *path,
+                 int path_size);
+
+#endif
@@ -0,0 +1,112 @@
+/*
+ * Virtual tapes: a large tape reserved with mmap between two inaccessible guard
+ * regions. The kernel supplies zeroed pages as the program first touches them,
+ * so a tape of a billion cells costs only what is actually used. Pointer moves
+ * on a virtual tape are not bounds-checked (see use_unchecked_moves()); a
+ * program that walks off either end touches a guard region instead, and the
+ * SIGSEGV handler installed here reports the overrun and exits.
+ *
+ * Note that this changes the semantics at the tape edges: on a virtual tape the
+ * pointer does not stick at an edge, moving past one is an error.
+ */
+
+#include <stdlib.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "virtual_tape.h"
+#include "io.h"
+
+static char *guarded_region = NULL; // the tape of the most recent virtual memory,
+static size_t guarded_region_size;  // including its guard regions
+
+static void handle_segmentation_fault(int signal_number, siginfo_t *info,
+                                      void *context) {
+    (void) signal_number;
+    (void) context;
+    char *address = info->si_addr;
+    if (guarded_region != NULL && address >= guarded_region
+            && address < guarded_region + guarded_region_size) {
+        static const char message[] = "\nError: the memory pointer moved off the tape.\n";
+        io_flush_signal_safe();
+        if (write(STDERR_FILENO, message, sizeof(message) - 1) < 0) {
+            // nothing more can be done
+        }
+        _exit(EXIT_FAILURE);
+    }
+    // not an overrun: let the fault happen again with the default handler
+    signal(SIGSEGV, SIG_DFL);
+}
+
+/*
+ * Installs the SIGSEGV handler (on its own stack) the first time it is needed.
+ */
+static void install_overrun_handler() {
+    static int installed = 0;
+    if (installed) {
+        return;
+    }
+    stack_t signal_stack;
+    signal_stack.ss_sp = malloc(SIGSTKSZ);
+    signal_stack.ss_size = SIGSTKSZ;
+    signal_stack.ss_flags = 0;
+    sigaltstack(&signal_stack, NULL);
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = handle_segmentation_fault;
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, NULL);
+    installed = 1;
+}
+
+/*
+ * Initializes system memory with a blank virtual tape of at least tape_size
+ * cells of cell_size bytes and the pointer at 0. Pages are protected as a
+ * whole, so the tape is rounded up to whole pages: both of its ends then touch
+ * a guard region, and the cell just past either end faults. Returns NULL if
+ * the address space cannot be reserved. Free the result with
+ * free_virtual_memory() (or free_mem()).
+ */
+SystemMemory *initialize_virtual_memory(int tape_size, int cell_size) {
+    long page_size = sysconf(_SC_PAGESIZE);
+    long cells_per_page = page_size / cell_size;
+    tape_size = (int) ((tape_size + cells_per_page - 1) / cells_per_page * cells_per_page);
+    size_t tape_bytes = (size_t) tape_size * cell_size;
+    size_t region_size = tape_bytes + 2 * VIRTUAL_TAPE_GUARD_SIZE;
+    char *region = mmap(NULL, region_size, PROT_NONE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (region == MAP_FAILED) {
+        return NULL;
+    }
+    char *tape = region + VIRTUAL_TAPE_GUARD_SIZE;
+    if (mprotect(tape, tape_bytes, PROT_READ | PROT_WRITE) != 0) {
+        munmap(region, region_size);
+        return NULL;
+    }
+    install_overrun_handler();
+    guarded_region = region;
+    guarded_region_size = region_size;
+    SystemMemory *mem = malloc(sizeof(SystemMemory));
+    mem->tape = tape;
+    mem->tape_size = tape_size;
+    mem->curr_index = 0;
+    mem->guard_size = VIRTUAL_TAPE_GUARD_SIZE;
+    mem->cell_size = cell_size;
+    mem->io = NULL;
+    mem->blank = 1;
+    return mem;
+}
+
+/*
+ * Free a virtual tape and its SystemMemory.
+ */
+void free_virtual_memory(SystemMemory *mem) {
+    char *region = mem->tape - mem->guard_size;
+    if (region == guarded_region) {
+        guarded_region = NULL;
+    }
+    munmap(region, (size_t) mem->tape_size * mem->cell_size + 2 * mem->guard_size);
+    free(mem);
+}
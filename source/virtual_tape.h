@@ -0,0 +1,13 @@
+#include "interpreter.h"
+
+#ifndef VIRTUAL_TAPE_HEADER
+#define VIRTUAL_TAPE_HEADER
+
+#define DEFAULT_VIRTUAL_TAPE_SIZE (1 << 30) // cells; pages are only used once touched
+#define VIRTUAL_TAPE_GUARD_SIZE (1 << 24)   // bytes of inaccessible memory per side
+
+SystemMemory *initialize_virtual_memory(int tape_size, int cell_size);
+
+void free_virtual_memory(SystemMemory *mem);
+
+#endif